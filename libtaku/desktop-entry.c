@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A parser for exactly what the menu needs from a desktop file.  GKeyFile
+ * builds a hash of every group and every translation; this maps the file, walks
+ * it once and only remembers where the interesting keys of [Desktop Entry] are.
+ * The results match what g_key_file_get_locale_string() and
+ * g_key_file_get_boolean() would return for the same file; tests/desktop-entries
+ * holds the cases that are easy to get wrong.  Only the values which are used
+ * have to be valid UTF-8, and an invalid translation is skipped for the next
+ * language.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+
+#include "desktop-entry.h"
+#include "launcher-util.h"
+
+static const struct {
+  const char *name;
+  gsize length;
+} key_names[DESKTOP_ENTRY_N_KEYS] = {
+#define KEY(s) { s, sizeof (s) - 1 }
+  KEY ("Name"),
+  KEY ("Comment"),
+  KEY ("Icon"),
+  KEY ("Exec"),
+  KEY ("Categories"),
+  KEY ("StartupNotify"),
+  KEY ("SingleInstance"),
+  KEY ("X-MB-SingleInstance"),
+  KEY ("NoDisplay"),
+  KEY ("Hidden"),
+  KEY ("OnlyShowIn"),
+  KEY ("NotShowIn"),
+#undef KEY
+};
+
+/*
+ * The language fallback chain and the current desktops don't change while we
+ * run, so work them out once.  g_get_language_names() caches per thread, so the
+ * loader threads would each redo it otherwise.
+ */
+static char **languages;
+static guint n_languages;
+static char **desktops;
+
+static void
+init_environment (void)
+{
+  static gsize initialised = 0;
+
+  if (g_once_init_enter (&initialised)) {
+    const char *current;
+
+    languages = g_strdupv ((char **) g_get_language_names ());
+    n_languages = MIN (g_strv_length (languages), DESKTOP_ENTRY_MAX_LANGUAGES);
+
+    current = g_getenv ("XDG_CURRENT_DESKTOP");
+    desktops = g_strsplit (current ? current : "", ":", -1);
+
+    g_once_init_leave (&initialised, 1);
+  }
+}
+
+static int
+find_language (const char *locale, gsize length)
+{
+  guint i;
+
+  for (i = 0; i < n_languages; i++) {
+    if (strncmp (languages[i], locale, length) == 0 &&
+        languages[i][length] == '\0')
+      return i;
+  }
+
+  return -1;
+}
+
+/*
+ * Remember the key=value line between @line and @end, where @equals points at
+ * the =.  Returns FALSE if the line isn't valid.
+ */
+static gboolean
+add_key (DesktopEntry *entry,
+         const char *line, const char *equals, const char *end)
+{
+  const char *key_end, *value, *locale = NULL;
+  gsize locale_length = 0;
+  int i, lang;
+
+  key_end = equals;
+  while (key_end > line && g_ascii_isspace (key_end[-1]))
+    key_end--;
+  if (key_end == line)
+    return FALSE;
+
+  value = equals + 1;
+  while (value < end && g_ascii_isspace (*value))
+    value++;
+
+  /* Split Key[locale] */
+  if (key_end[-1] == ']') {
+    locale = memchr (line, '[', key_end - line);
+    if (locale) {
+      locale_length = key_end - locale - 2;
+      key_end = locale++;
+    }
+  }
+
+  for (i = 0; i < DESKTOP_ENTRY_N_KEYS; i++) {
+    if (key_names[i].length == (gsize) (key_end - line) &&
+        memcmp (key_names[i].name, line, key_names[i].length) == 0)
+      break;
+  }
+  if (i == DESKTOP_ENTRY_N_KEYS)
+    return TRUE;
+
+  /* Later lines replace earlier ones, as in GKeyFile */
+  if (locale == NULL) {
+    entry->values[i].start = value;
+    entry->values[i].length = end - value;
+  } else if (i < DESKTOP_ENTRY_N_LOCALE_KEYS) {
+    lang = find_language (locale, locale_length);
+    if (lang >= 0) {
+      entry->translations[i][lang].start = value;
+      entry->translations[i][lang].length = end - value;
+    }
+  }
+
+  return TRUE;
+}
+
+/*
+ * Walk the file.  Everything has to be well formed for GKeyFile to accept it,
+ * so the other groups are checked too, but only [Desktop Entry] is stored.
+ */
+static gboolean
+parse (DesktopEntry *entry, const char *data, gsize length)
+{
+  const char *end = data + length;
+  const char *line, *eol, *p, *q;
+  gboolean in_group = FALSE, in_desktop = FALSE;
+
+  for (line = data; line < end; line = eol + 1) {
+    eol = memchr (line, '\n', end - line);
+    if (eol == NULL)
+      eol = end;
+
+    /* Trim the line, which also takes care of \r\n */
+    p = line;
+    while (p < eol && g_ascii_isspace (*p))
+      p++;
+    q = eol;
+    while (q > p && g_ascii_isspace (q[-1]))
+      q--;
+
+    if (p == q || *p == '#')
+      continue;
+
+    if (*p == '[') {
+      const char *bracket = memchr (p, ']', q - p);
+
+      if (bracket != q - 1)
+        return FALSE;
+
+      in_group = TRUE;
+      in_desktop = (bracket - p - 1 == sizeof (DESKTOP) - 1 &&
+                    memcmp (p + 1, DESKTOP, sizeof (DESKTOP) - 1) == 0);
+    } else {
+      const char *equals = memchr (p, '=', q - p);
+
+      if (!in_group || equals == NULL)
+        return FALSE;
+
+      if (in_desktop && !add_key (entry, p, equals, q))
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Returns TRUE if the ;-separated @value contains one of the current desktops */
+static gboolean
+shows_in_desktop (const DesktopEntryValue *value)
+{
+  const char *p, *end, *sep;
+  char **d;
+
+  end = value->start + value->length;
+
+  for (d = desktops; *d; d++) {
+    gsize length = strlen (*d);
+
+    if (length == 0)
+      continue;
+
+    for (p = value->start; p < end; p = sep + 1) {
+      sep = memchr (p, ';', end - p);
+      if (sep == NULL)
+        sep = end;
+
+      if ((gsize) (sep - p) == length && memcmp (p, *d, length) == 0)
+        return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static gboolean
+is_shown (DesktopEntry *entry)
+{
+  const DesktopEntryValue *only, *not_shown;
+
+  if (desktop_entry_get_boolean (entry, DESKTOP_ENTRY_NO_DISPLAY, FALSE) ||
+      desktop_entry_get_boolean (entry, DESKTOP_ENTRY_HIDDEN, FALSE))
+    return FALSE;
+
+  only = &entry->values[DESKTOP_ENTRY_ONLY_SHOW_IN];
+  if (only->start && !shows_in_desktop (only))
+    return FALSE;
+
+  not_shown = &entry->values[DESKTOP_ENTRY_NOT_SHOW_IN];
+  if (not_shown->start && shows_in_desktop (not_shown))
+    return FALSE;
+
+  return TRUE;
+}
+
+/*
+ * Load @filename into @entry.  Returns FALSE, leaving nothing to clear, if the
+ * file cannot be read or parsed or shouldn't be displayed in this desktop.
+ */
+gboolean
+desktop_entry_load (DesktopEntry *entry, const char *filename)
+{
+  const char *data;
+  gsize length;
+
+  g_return_val_if_fail (entry, FALSE);
+  g_return_val_if_fail (filename, FALSE);
+
+  init_environment ();
+
+  memset (entry, 0, sizeof (DesktopEntry));
+
+  entry->file = g_mapped_file_new (filename, FALSE, NULL);
+  if (entry->file == NULL)
+    return FALSE;
+
+  data = g_mapped_file_get_contents (entry->file);
+  length = g_mapped_file_get_length (entry->file);
+
+  /* An empty file has no [Desktop Entry], so there is nothing to show */
+  if (data == NULL ||
+      !parse (entry, data, length) ||
+      !is_shown (entry)) {
+    desktop_entry_clear (entry);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+desktop_entry_clear (DesktopEntry *entry)
+{
+  g_return_if_fail (entry);
+
+  if (entry->file) {
+    g_mapped_file_unref (entry->file);
+    entry->file = NULL;
+  }
+}
+
+/*
+ * Unescape @value as g_key_file_get_string() does, returning NULL if it isn't
+ * UTF-8 or contains an invalid escape.
+ */
+static char *
+unescape (const DesktopEntryValue *value)
+{
+  const char *p, *end;
+  char *s, *q;
+
+  if (!g_utf8_validate (value->start, value->length, NULL))
+    return NULL;
+
+  s = q = g_malloc (value->length + 1);
+  end = value->start + value->length;
+
+  for (p = value->start; p < end; p++) {
+    if (*p != '\\') {
+      *q++ = *p;
+      continue;
+    }
+
+    if (++p == end) {
+      g_free (s);
+      return NULL;
+    }
+
+    switch (*p) {
+    case 's': *q++ = ' '; break;
+    case 'n': *q++ = '\n'; break;
+    case 't': *q++ = '\t'; break;
+    case 'r': *q++ = '\r'; break;
+    case '\\': *q++ = '\\'; break;
+    default:
+      g_free (s);
+      return NULL;
+    }
+  }
+  *q = '\0';
+
+  return s;
+}
+
+/*
+ * Get the string for @key in the best language available, stripped of
+ * whitespace.  Returns NULL if it is missing or empty.
+ */
+char *
+desktop_entry_get_string (DesktopEntry *entry, DesktopEntryKey key)
+{
+  char *s = NULL;
+  guint i;
+
+  g_return_val_if_fail (entry, NULL);
+  g_return_val_if_fail (key < DESKTOP_ENTRY_N_KEYS, NULL);
+
+  if (key < DESKTOP_ENTRY_N_LOCALE_KEYS) {
+    for (i = 0; i < n_languages && s == NULL; i++) {
+      if (entry->translations[key][i].start)
+        s = unescape (&entry->translations[key][i]);
+    }
+  }
+
+  if (s == NULL && entry->values[key].start)
+    s = unescape (&entry->values[key]);
+
+  if (s == NULL)
+    return NULL;
+
+  g_strstrip (s);
+  if (s[0] == '\0') {
+    g_free (s);
+    return NULL;
+  }
+
+  return s;
+}
+
+/*
+ * Get the boolean for @key, and if it cannot be parsed or does not exist
+ * return @def.
+ */
+gboolean
+desktop_entry_get_boolean (DesktopEntry *entry,
+                           DesktopEntryKey key,
+                           gboolean def)
+{
+  const DesktopEntryValue *value;
+
+  g_return_val_if_fail (entry, def);
+  g_return_val_if_fail (key < DESKTOP_ENTRY_N_KEYS, def);
+
+  value = &entry->values[key];
+  if (value->start == NULL)
+    return def;
+
+#define IS(s) (value->length == sizeof (s) - 1 && \
+               memcmp (value->start, s, sizeof (s) - 1) == 0)
+  if (IS ("true") || IS ("1"))
+    return TRUE;
+  if (IS ("false") || IS ("0"))
+    return FALSE;
+#undef IS
+
+  return def;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_DESKTOP_ENTRY_H
+#define HAVE_DESKTOP_ENTRY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The keys of the [Desktop Entry] group we care about */
+typedef enum {
+  /* Localised keys come first */
+  DESKTOP_ENTRY_NAME,
+  DESKTOP_ENTRY_COMMENT,
+  DESKTOP_ENTRY_ICON,
+  DESKTOP_ENTRY_EXEC,
+  DESKTOP_ENTRY_CATEGORIES,
+
+  DESKTOP_ENTRY_STARTUP_NOTIFY,
+  DESKTOP_ENTRY_SINGLE_INSTANCE,
+  DESKTOP_ENTRY_MB_SINGLE_INSTANCE,
+  DESKTOP_ENTRY_NO_DISPLAY,
+  DESKTOP_ENTRY_HIDDEN,
+  DESKTOP_ENTRY_ONLY_SHOW_IN,
+  DESKTOP_ENTRY_NOT_SHOW_IN,
+
+  DESKTOP_ENTRY_N_KEYS
+} DesktopEntryKey;
+
+#define DESKTOP_ENTRY_N_LOCALE_KEYS (DESKTOP_ENTRY_CATEGORIES + 1)
+
+/* Translations in languages past this are ignored */
+#define DESKTOP_ENTRY_MAX_LANGUAGES 32
+
+/* A value as it appears in the file, not nul-terminated or unescaped */
+typedef struct {
+  const char *start;
+  gsize length;
+} DesktopEntryValue;
+
+/*
+ * A parsed desktop file.  The values point into the mapped file, so nothing is
+ * copied until it is asked for.  Meant to live on the stack.
+ */
+typedef struct {
+  GMappedFile *file;
+  DesktopEntryValue values[DESKTOP_ENTRY_N_KEYS];
+  /* Indexed by the position of the language in g_get_language_names() */
+  DesktopEntryValue translations[DESKTOP_ENTRY_N_LOCALE_KEYS][DESKTOP_ENTRY_MAX_LANGUAGES];
+} DesktopEntry;
+
+gboolean desktop_entry_load (DesktopEntry *entry, const char *filename);
+
+void desktop_entry_clear (DesktopEntry *entry);
+
+char *desktop_entry_get_string (DesktopEntry *entry, DesktopEntryKey key);
+
+gboolean desktop_entry_get_boolean (DesktopEntry  *entry,
+                                    DesktopEntryKey key,
+                                    gboolean        def);
+
+G_END_DECLS
+
+#endif
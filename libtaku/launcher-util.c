@@ -24,6 +24,7 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include "launcher-util.h"
+#include "taku-icon-loader.h"
 #include "xutil.h"
 
 #ifdef USE_LIBSN
@@ -31,174 +32,118 @@
 #include <libsn/sn.h>
 #endif
 
-/* Convert command line to argv array, stripping % conversions on the way */
-#define MAX_ARGS 255
-char **
-exec_to_argv (const char *exec)
+/*
+ * Copy the next argument of the command line at *@p into @buf, stripping %
+ * conversions on the way, and move *@p past it.  Returns FALSE when there are
+ * no more arguments.
+ */
+static gboolean
+next_arg (const char **p, char *buf)
 {
-  const char *p;
-  char *buf, *bufp, **argv;
-  int nargs;
+  const char *s;
+  char *bufp = buf;
   gboolean escape, single_quote, double_quote;
-  
-  argv = g_new (char *, MAX_ARGS + 1);
-  buf = g_alloca (strlen (exec) + 1);
-  bufp = buf;
-  nargs = 0;
+
   escape = single_quote = double_quote = FALSE;
-  
-  for (p = exec; *p; p++) {
+
+  for (s = *p; *s; s++) {
     if (escape) {
-      *bufp++ = *p;
+      *bufp++ = *s;
       
       escape = FALSE;
     } else {
-      switch (*p) {
+      switch (*s) {
       case '\\':
         escape = TRUE;
 
         break;
       case '%':
         /* Strip '%' conversions */
-        if (p[1] && p[1] == '%')
-          *bufp++ = *p;
+        if (s[1] == '%')
+          *bufp++ = *s;
         
-        p++;
+        if (s[1])
+          s++;
 
         break;
       case '\'':
         if (double_quote)
-          *bufp++ = *p;
+          *bufp++ = *s;
         else
           single_quote = !single_quote;
         
         break;
       case '\"':
         if (single_quote)
-          *bufp++ = *p;
+          *bufp++ = *s;
         else
           double_quote = !double_quote;
         
         break;
       case ' ':
         if (single_quote || double_quote)
-          *bufp++ = *p;
+          *bufp++ = *s;
         else {
           *bufp = 0;
-          
-          if (nargs < MAX_ARGS)
-            argv[nargs++] = g_strdup (buf);
-          
-          bufp = buf;
+          *p = s + 1;
+
+          return TRUE;
         }
         
         break;
       default:
-        *bufp++ = *p;
+        *bufp++ = *s;
         break;
       }
     }
   }
+
+  *bufp = 0;
+  *p = s;
+
+  return bufp != buf;
+}
+
+/* Convert command line to argv array, stripping % conversions on the way */
+#define MAX_ARGS 255
+char **
+exec_to_argv (const char *exec)
+{
+  GPtrArray *argv;
+  const char *p;
+  char *buf;
   
-  if (bufp != buf) {
-    *bufp = 0;
-    
-    if (nargs < MAX_ARGS)
-      argv[nargs++] = g_strdup (buf);
-  }
+  argv = g_ptr_array_new ();
+  buf = g_alloca (strlen (exec) + 1);
   
-  argv[nargs] = NULL;
+  for (p = exec; argv->len < MAX_ARGS && next_arg (&p, buf);)
+    g_ptr_array_add (argv, g_strdup (buf));
   
-  return argv;
+  g_ptr_array_add (argv, NULL);
+  
+  return (char **) g_ptr_array_free (argv, FALSE);
 }
 
-/* Strips extension off filename */
-static char *
-strip_extension (const char *file)
+/* Returns the first argument of the command line @exec, which should be freed */
+char *
+exec_get_executable (const char *exec)
 {
-        char *stripped, *p;
-
-        stripped = g_strdup (file);
+  const char *p = exec;
+  char *buf;
 
-        p = strrchr (stripped, '.');
-        if (p &&
-            (!strcmp (p, ".png") ||
-             !strcmp (p, ".svg") ||
-             !strcmp (p, ".xpm")))
-	        *p = 0;
+  buf = g_alloca (strlen (exec) + 1);
 
-        return stripped;
+  return next_arg (&p, buf) ? g_strdup (buf) : NULL;
 }
 
-#define MISSING_IMAGE "gtk-missing-image"
-#define GENERIC_EXECUTABLE "application-x-executable"
-
+/*
+ * Returns a reference to the icon @name at @pixel_size square, loading it now
+ * if it isn't cached.  The pixbuf is shared and must not be modified.
+ */
 GdkPixbuf*
 get_icon (const gchar *name, gint pixel_size)
 {
-  static GtkIconTheme *theme = NULL;
-  GdkPixbuf *pixbuf = NULL;
-  GError *error = NULL;
-  gchar *stripped = NULL;
-  gint width, height;
-
-  if (G_UNLIKELY (theme == NULL))
-    theme = gtk_icon_theme_get_default ();
-
-  if (name == NULL) {
-    return get_icon (GENERIC_EXECUTABLE, pixel_size);
-  }
-
-  if (g_path_is_absolute (name)) {
-    pixbuf = gdk_pixbuf_new_from_file_at_scale (name, pixel_size, pixel_size,
-                                                TRUE, &error);
-    if (error) {
-      g_warning ("Error loading icon: %s", error->message);
-      g_error_free (error);
-      error = NULL;
-    }
-    return pixbuf;
-  }
-
-  stripped = strip_extension (name);
-  
-  pixbuf = gtk_icon_theme_load_icon (theme,
-                                     stripped,
-                                     pixel_size,
-                                     0, &error);
-  if (error) {
-    g_warning ("Error loading icon: %s", error->message);
-    g_error_free (error);
-    error = NULL;
-  }
-  g_free (stripped);
-
-  /* Fallback on generic executable, then missing image */
-  if (pixbuf == NULL) {
-    if (strcmp (name, MISSING_IMAGE) == 0) {
-      return NULL;
-    } else if (strcmp (name, GENERIC_EXECUTABLE) == 0) {
-      return get_icon (MISSING_IMAGE, pixel_size);
-    } else {
-      return get_icon (GENERIC_EXECUTABLE, pixel_size);
-    }
-  }
- 
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
-
-  if (width != pixel_size || height != pixel_size) {
-    GdkPixbuf *new;
-    
-    new = gdk_pixbuf_scale_simple (pixbuf,
-                                   pixel_size, pixel_size,
-                                   GDK_INTERP_BILINEAR);
-    
-    g_object_unref (pixbuf);
-    pixbuf = new;
-  }
-
-  return pixbuf;
+  return taku_icon_loader_load (name, pixel_size);
 }
 
 
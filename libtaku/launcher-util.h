@@ -29,6 +29,9 @@
 char **
 exec_to_argv (const char *exec);
 
+char *
+exec_get_executable (const char *exec);
+
 void
 launcher_start (GtkWidget *widget,
                 TakuMenuItem *item,
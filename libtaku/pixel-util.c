@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+
+#include "pixel-util.h"
+
+/* The vector paths write ARGB32 as bytes, so they only suit little endian */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#  if defined (__SSE2__)
+#    include <emmintrin.h>
+#    define HAVE_SSE2 1
+#  elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#    include <arm_neon.h>
+#    define HAVE_NEON 1
+#  endif
+#endif
+
+#define ROW(base, stride, y) ((gpointer) ((guint8 *) (base) + (gsize) (y) * (stride)))
+
+/* Cleared to check the vector paths against the scalar ones */
+static gboolean use_vectors = TRUE;
+
+/* Exact x / 255 rounded, for x up to 255 * 255 */
+#define DIV255(x) ((((x) + 128) + (((x) + 128) >> 8)) >> 8)
+
+static inline guint32
+pack_pixel (guint r, guint g, guint b, guint a)
+{
+  return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void
+premultiply_row_scalar (const guint8 *src, gboolean has_alpha,
+                        guint32 *dst, int width)
+{
+  int x;
+
+  if (!has_alpha) {
+    for (x = 0; x < width; x++, src += 3)
+      dst[x] = pack_pixel (src[0], src[1], src[2], 0xff);
+    return;
+  }
+
+  for (x = 0; x < width; x++, src += 4) {
+    guint a = src[3];
+
+    dst[x] = pack_pixel (DIV255 (src[0] * a), DIV255 (src[1] * a),
+                         DIV255 (src[2] * a), a);
+  }
+}
+
+#if HAVE_SSE2
+/* Four pixels at a time: widen to 16 bits, multiply by alpha and swap R and B
+   so that the bytes come out in ARGB32 order */
+static int
+premultiply_row_sse2 (const guint8 *src, guint32 *dst, int width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i rgb_mask = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+  const __m128i alpha_one = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+  const __m128i half = _mm_set1_epi16 (128);
+  int x;
+
+  for (x = 0; x + 4 <= width; x += 4) {
+    __m128i px, lo, hi, alo, ahi;
+
+    px = _mm_loadu_si128 ((const __m128i *) (src + x * 4));
+    lo = _mm_unpacklo_epi8 (px, zero);
+    hi = _mm_unpackhi_epi8 (px, zero);
+
+    alo = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 3, 3, 3)),
+                               _MM_SHUFFLE (3, 3, 3, 3));
+    ahi = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 3, 3, 3)),
+                               _MM_SHUFFLE (3, 3, 3, 3));
+    alo = _mm_or_si128 (_mm_and_si128 (alo, rgb_mask), alpha_one);
+    ahi = _mm_or_si128 (_mm_and_si128 (ahi, rgb_mask), alpha_one);
+
+    lo = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, _MM_SHUFFLE (3, 0, 1, 2)),
+                              _MM_SHUFFLE (3, 0, 1, 2));
+    hi = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, _MM_SHUFFLE (3, 0, 1, 2)),
+                              _MM_SHUFFLE (3, 0, 1, 2));
+
+    lo = _mm_add_epi16 (_mm_mullo_epi16 (lo, alo), half);
+    hi = _mm_add_epi16 (_mm_mullo_epi16 (hi, ahi), half);
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
+
+    _mm_storeu_si128 ((__m128i *) (dst + x), _mm_packus_epi16 (lo, hi));
+  }
+
+  return x;
+}
+#endif
+
+#if HAVE_NEON
+/* Eight pixels at a time, with the channels split out by the loads */
+static int
+premultiply_row_neon (const guint8 *src, guint32 *dst, int width)
+{
+  int x;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint8x8x4_t in, out;
+    uint16x8_t t;
+
+    in = vld4_u8 (src + x * 4);
+
+    t = vmull_u8 (in.val[2], in.val[3]);
+    out.val[0] = vraddhn_u16 (t, vrshrq_n_u16 (t, 8));
+    t = vmull_u8 (in.val[1], in.val[3]);
+    out.val[1] = vraddhn_u16 (t, vrshrq_n_u16 (t, 8));
+    t = vmull_u8 (in.val[0], in.val[3]);
+    out.val[2] = vraddhn_u16 (t, vrshrq_n_u16 (t, 8));
+    out.val[3] = in.val[3];
+
+    vst4_u8 ((guint8 *) (dst + x), out);
+  }
+
+  return x;
+}
+#endif
+
+/*
+ * Whether to use the SSE2 or NEON loops when they were built, which is the
+ * default.  Turning them off gives the scalar results, for testing.
+ */
+void
+pixel_set_vectors_enabled (gboolean enabled)
+{
+  use_vectors = enabled;
+}
+
+/* Returns TRUE if vector loops were built and are enabled */
+gboolean
+pixel_get_vectors_enabled (void)
+{
+#if HAVE_SSE2 || HAVE_NEON
+  return use_vectors;
+#else
+  return FALSE;
+#endif
+}
+
+/*
+ * Convert @width by @height pixels of 8 bit RGB or RGBA at @src into
+ * premultiplied ARGB32 at @dst.  Strides are in bytes.
+ */
+void
+pixel_premultiply (const guint8 *src,
+                   int           src_stride,
+                   gboolean      has_alpha,
+                   guint32      *dst,
+                   int           dst_stride,
+                   int           width,
+                   int           height)
+{
+  int y;
+
+  for (y = 0; y < height; y++) {
+    const guint8 *s = ROW (src, src_stride, y);
+    guint32 *d = ROW (dst, dst_stride, y);
+    int done = 0;
+
+#if HAVE_SSE2
+    if (has_alpha && use_vectors)
+      done = premultiply_row_sse2 (s, d, width);
+#elif HAVE_NEON
+    if (has_alpha && use_vectors)
+      done = premultiply_row_neon (s, d, width);
+#endif
+
+    premultiply_row_scalar (s + done * (has_alpha ? 4 : 3), has_alpha,
+                            d + done, width - done);
+  }
+}
+
+/*
+ * Convert premultiplied ARGB32 at @src back into 8 bit RGBA at @dst.  This is
+ * only used on the small scaled results, so there is no vector version.
+ */
+void
+pixel_unpremultiply (const guint32 *src,
+                     int            src_stride,
+                     guint8        *dst,
+                     int            dst_stride,
+                     int            width,
+                     int            height)
+{
+  int x, y;
+
+  for (y = 0; y < height; y++) {
+    const guint32 *s = ROW (src, src_stride, y);
+    guint8 *d = ROW (dst, dst_stride, y);
+
+    for (x = 0; x < width; x++, d += 4) {
+      guint32 p = s[x];
+      guint a = p >> 24;
+
+      if (a == 0) {
+        d[0] = d[1] = d[2] = d[3] = 0;
+      } else {
+        d[0] = (((p >> 16) & 0xff) * 255 + a / 2) / a;
+        d[1] = (((p >> 8) & 0xff) * 255 + a / 2) / a;
+        d[2] = ((p & 0xff) * 255 + a / 2) / a;
+        d[3] = a;
+      }
+    }
+  }
+}
+
+static void
+halve_row_scalar (const guint32 *s0, const guint32 *s1, guint32 *d, int width)
+{
+  int x, shift;
+
+  for (x = 0; x < width; x++) {
+    guint32 out = 0;
+
+    for (shift = 0; shift < 32; shift += 8) {
+      guint sum = ((s0[2 * x] >> shift) & 0xff) + ((s0[2 * x + 1] >> shift) & 0xff)
+                + ((s1[2 * x] >> shift) & 0xff) + ((s1[2 * x + 1] >> shift) & 0xff);
+
+      out |= ((sum + 2) >> 2) << shift;
+    }
+
+    d[x] = out;
+  }
+}
+
+#if HAVE_SSE2
+/* Four output pixels at a time, summing each 2x2 block in 16 bits */
+static int
+halve_row_sse2 (const guint32 *s0, const guint32 *s1, guint32 *d, int width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i two = _mm_set1_epi16 (2);
+  int x;
+
+  for (x = 0; x + 4 <= width; x += 4) {
+    __m128i a, b, lo, hi, p01, p23;
+
+    /* Output pixels 0 and 1 */
+    a = _mm_loadu_si128 ((const __m128i *) (s0 + 2 * x));
+    b = _mm_loadu_si128 ((const __m128i *) (s1 + 2 * x));
+    lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero));
+    hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero));
+    lo = _mm_add_epi16 (lo, _mm_srli_si128 (lo, 8));
+    hi = _mm_add_epi16 (hi, _mm_srli_si128 (hi, 8));
+    p01 = _mm_unpacklo_epi64 (lo, hi);
+
+    /* Output pixels 2 and 3 */
+    a = _mm_loadu_si128 ((const __m128i *) (s0 + 2 * x + 4));
+    b = _mm_loadu_si128 ((const __m128i *) (s1 + 2 * x + 4));
+    lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero), _mm_unpacklo_epi8 (b, zero));
+    hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero), _mm_unpackhi_epi8 (b, zero));
+    lo = _mm_add_epi16 (lo, _mm_srli_si128 (lo, 8));
+    hi = _mm_add_epi16 (hi, _mm_srli_si128 (hi, 8));
+    p23 = _mm_unpacklo_epi64 (lo, hi);
+
+    p01 = _mm_srli_epi16 (_mm_add_epi16 (p01, two), 2);
+    p23 = _mm_srli_epi16 (_mm_add_epi16 (p23, two), 2);
+
+    _mm_storeu_si128 ((__m128i *) (d + x), _mm_packus_epi16 (p01, p23));
+  }
+
+  return x;
+}
+#endif
+
+#if HAVE_NEON
+/* Eight output pixels at a time, adding horizontal pairs as they widen */
+static int
+halve_row_neon (const guint32 *s0, const guint32 *s1, guint32 *d, int width)
+{
+  int x, c;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint8x8x4_t a0, a1, b0, b1, out;
+
+    a0 = vld4_u8 ((const guint8 *) (s0 + 2 * x));
+    a1 = vld4_u8 ((const guint8 *) (s0 + 2 * x + 8));
+    b0 = vld4_u8 ((const guint8 *) (s1 + 2 * x));
+    b1 = vld4_u8 ((const guint8 *) (s1 + 2 * x + 8));
+
+    for (c = 0; c < 4; c++) {
+      uint16x8_t sum;
+
+      sum = vcombine_u16 (vadd_u16 (vpaddl_u8 (a0.val[c]), vpaddl_u8 (b0.val[c])),
+                          vadd_u16 (vpaddl_u8 (a1.val[c]), vpaddl_u8 (b1.val[c])));
+      out.val[c] = vrshrn_n_u16 (sum, 2);
+    }
+
+    vst4_u8 ((guint8 *) (d + x), out);
+  }
+
+  return x;
+}
+#endif
+
+/* Halve @src into @dst with a 2x2 box filter, dropping any odd last row or
+   column */
+static void
+halve (const guint32 *src, int src_stride,
+       guint32 *dst, int dst_stride, int width, int height)
+{
+  int y;
+
+  for (y = 0; y < height; y++) {
+    const guint32 *s0 = ROW (src, src_stride, 2 * y);
+    const guint32 *s1 = ROW (src, src_stride, 2 * y + 1);
+    guint32 *d = ROW (dst, dst_stride, y);
+    int done = 0;
+
+#if HAVE_SSE2
+    if (use_vectors)
+      done = halve_row_sse2 (s0, s1, d, width);
+#elif HAVE_NEON
+    if (use_vectors)
+      done = halve_row_neon (s0, s1, d, width);
+#endif
+
+    halve_row_scalar (s0 + 2 * done, s1 + 2 * done, d + done, width - done);
+  }
+}
+
+/*
+ * The source pixels covering each destination pixel, and how much of each, in
+ * 16.16 fixed point.  A destination pixel covers @src_len / @dst_len source
+ * pixels, so can touch up to that plus one.
+ */
+typedef struct {
+  int n_taps;
+  int *first;
+  guint32 *weights;
+} Taps;
+
+static void
+taps_init (Taps *taps, int src_len, int dst_len)
+{
+  int i, j, k;
+
+  taps->n_taps = (src_len + dst_len - 1) / dst_len + 1;
+  taps->first = g_new (int, dst_len);
+  taps->weights = g_new0 (guint32, dst_len * taps->n_taps);
+
+  /* Work in units of 1 / (src_len * dst_len), so everything is an integer:
+     destination pixel i covers [i * src_len, (i + 1) * src_len) and source
+     pixel j covers [j * dst_len, (j + 1) * dst_len) */
+  for (i = 0; i < dst_len; i++) {
+    gint64 start = (gint64) i * src_len, end = start + src_len;
+    guint32 total = 0;
+
+    taps->first[i] = start / dst_len;
+
+    for (j = taps->first[i], k = 0; k < taps->n_taps && j < src_len; j++, k++) {
+      gint64 lo = MAX (start, (gint64) j * dst_len);
+      gint64 hi = MIN (end, (gint64) (j + 1) * dst_len);
+
+      if (hi <= lo)
+        break;
+
+      taps->weights[i * taps->n_taps + k] = ((hi - lo) << 16) / src_len;
+      total += taps->weights[i * taps->n_taps + k];
+    }
+
+    /* Make the weights add up to exactly one */
+    taps->weights[i * taps->n_taps] += 65536 - total;
+  }
+}
+
+static void
+taps_clear (Taps *taps)
+{
+  g_free (taps->first);
+  g_free (taps->weights);
+}
+
+static inline guint32
+blend (const guint32 *pixels, gsize step, const guint32 *weights, int n)
+{
+  guint32 a = 0, r = 0, g = 0, b = 0;
+  int k;
+
+  for (k = 0; k < n && weights[k]; k++) {
+    guint32 p = pixels[k * step];
+
+    a += (p >> 24) * weights[k];
+    r += ((p >> 16) & 0xff) * weights[k];
+    g += ((p >> 8) & 0xff) * weights[k];
+    b += (p & 0xff) * weights[k];
+  }
+
+  return pack_pixel ((r + 32768) >> 16, (g + 32768) >> 16,
+                     (b + 32768) >> 16, (a + 32768) >> 16);
+}
+
+/* Area-average @src down to @dst, one axis at a time */
+static void
+box_filter (const guint32 *src, int src_width, int src_height, int src_stride,
+            guint32 *dst, int dst_width, int dst_height, int dst_stride)
+{
+  Taps htaps, vtaps;
+  guint32 *tmp;
+  int x, y;
+
+  taps_init (&htaps, src_width, dst_width);
+  taps_init (&vtaps, src_height, dst_height);
+
+  /* Across, into a buffer which is still the source height */
+  tmp = g_new (guint32, (gsize) dst_width * src_height);
+  for (y = 0; y < src_height; y++) {
+    const guint32 *s = ROW (src, src_stride, y);
+
+    for (x = 0; x < dst_width; x++)
+      tmp[y * dst_width + x] = blend (s + htaps.first[x], 1,
+                                      htaps.weights + x * htaps.n_taps,
+                                      MIN (htaps.n_taps, src_width - htaps.first[x]));
+  }
+
+  /* Then down */
+  for (y = 0; y < dst_height; y++) {
+    guint32 *d = ROW (dst, dst_stride, y);
+
+    for (x = 0; x < dst_width; x++)
+      d[x] = blend (tmp + vtaps.first[y] * dst_width + x, dst_width,
+                    vtaps.weights + y * vtaps.n_taps,
+                    MIN (vtaps.n_taps, src_height - vtaps.first[y]));
+  }
+
+  g_free (tmp);
+  taps_clear (&htaps);
+  taps_clear (&vtaps);
+}
+
+/*
+ * Shrink premultiplied ARGB32 pixels with a box filter.  Halving is done with
+ * the vector code while the image is at least twice the size wanted, and the
+ * rest of the way is an area average.  The destination must not be larger than
+ * the source in either direction.  Strides are in bytes.
+ */
+void
+pixel_downscale (const guint32 *src,
+                 int            src_width,
+                 int            src_height,
+                 int            src_stride,
+                 guint32       *dst,
+                 int            dst_width,
+                 int            dst_height,
+                 int            dst_stride)
+{
+  guint32 *buffers[2] = { NULL, NULL };
+  int i = 0;
+
+  g_return_if_fail (dst_width > 0 && dst_width <= src_width);
+  g_return_if_fail (dst_height > 0 && dst_height <= src_height);
+
+  while (src_width >= 2 * dst_width && src_height >= 2 * dst_height) {
+    int width = src_width / 2, height = src_height / 2;
+
+    if (buffers[i] == NULL)
+      buffers[i] = g_new (guint32, (gsize) width * height);
+
+    halve (src, src_stride, buffers[i], width * 4, width, height);
+
+    src = buffers[i];
+    src_width = width;
+    src_height = height;
+    src_stride = width * 4;
+    i ^= 1;
+  }
+
+  if (src_width == dst_width && src_height == dst_height) {
+    int y;
+
+    for (y = 0; y < dst_height; y++)
+      memcpy (ROW (dst, dst_stride, y), ROW (src, src_stride, y),
+              dst_width * 4);
+  } else {
+    box_filter (src, src_width, src_height, src_stride,
+                dst, dst_width, dst_height, dst_stride);
+  }
+
+  g_free (buffers[0]);
+  g_free (buffers[1]);
+}
+
+static gboolean
+can_shrink (GdkPixbuf *pixbuf, int width, int height)
+{
+  return gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB &&
+    gdk_pixbuf_get_bits_per_sample (pixbuf) == 8 &&
+    gdk_pixbuf_get_n_channels (pixbuf) == (gdk_pixbuf_get_has_alpha (pixbuf) ? 4 : 3) &&
+    width <= gdk_pixbuf_get_width (pixbuf) &&
+    height <= gdk_pixbuf_get_height (pixbuf);
+}
+
+/* Premultiply @pixbuf and shrink it to @width by @height into @dst */
+static void
+shrink (GdkPixbuf *pixbuf, guint32 *dst, int dst_stride, int width, int height)
+{
+  int src_width, src_height;
+  guint32 *tmp;
+
+  src_width = gdk_pixbuf_get_width (pixbuf);
+  src_height = gdk_pixbuf_get_height (pixbuf);
+
+  tmp = g_new (guint32, (gsize) src_width * src_height);
+  pixel_premultiply (gdk_pixbuf_read_pixels (pixbuf),
+                     gdk_pixbuf_get_rowstride (pixbuf),
+                     gdk_pixbuf_get_has_alpha (pixbuf),
+                     tmp, src_width * 4, src_width, src_height);
+  pixel_downscale (tmp, src_width, src_height, src_width * 4,
+                   dst, width, height, dst_stride);
+  g_free (tmp);
+}
+
+/*
+ * Returns a new pixbuf of @pixbuf scaled to @width by @height.  Shrinking is
+ * done with a box filter in premultiplied space, anything else is left to
+ * GdkPixbuf.
+ */
+GdkPixbuf *
+pixel_scale_pixbuf (GdkPixbuf *pixbuf, int width, int height)
+{
+  GdkPixbuf *scaled;
+  guint32 *tmp;
+
+  g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
+
+  if (!can_shrink (pixbuf, width, height))
+    return gdk_pixbuf_scale_simple (pixbuf, width, height, GDK_INTERP_BILINEAR);
+
+  scaled = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  if (scaled == NULL)
+    return NULL;
+
+  tmp = g_new (guint32, (gsize) width * height);
+  shrink (pixbuf, tmp, width * 4, width, height);
+  pixel_unpremultiply (tmp, width * 4,
+                       gdk_pixbuf_get_pixels (scaled),
+                       gdk_pixbuf_get_rowstride (scaled),
+                       width, height);
+  g_free (tmp);
+
+  return scaled;
+}
+
+/*
+ * Returns a new ARGB32 image surface of @pixbuf at @width by @height, ready to
+ * paint.
+ */
+cairo_surface_t *
+pixel_pixbuf_to_surface (GdkPixbuf *pixbuf, int width, int height)
+{
+  cairo_surface_t *surface;
+  guint32 *data;
+  int stride;
+
+  g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
+
+  if (!can_shrink (pixbuf, width, height)) {
+    GdkPixbuf *scaled;
+
+    scaled = gdk_pixbuf_scale_simple (pixbuf, width, height,
+                                      GDK_INTERP_BILINEAR);
+    if (scaled == NULL)
+      return NULL;
+    surface = pixel_pixbuf_to_surface (scaled, width, height);
+    g_object_unref (scaled);
+    return surface;
+  }
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+    return surface;
+
+  cairo_surface_flush (surface);
+  data = (guint32 *) cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  if (width == gdk_pixbuf_get_width (pixbuf) &&
+      height == gdk_pixbuf_get_height (pixbuf))
+    pixel_premultiply (gdk_pixbuf_read_pixels (pixbuf),
+                       gdk_pixbuf_get_rowstride (pixbuf),
+                       gdk_pixbuf_get_has_alpha (pixbuf),
+                       data, stride, width, height);
+  else
+    shrink (pixbuf, data, stride, width, height);
+
+  cairo_surface_mark_dirty (surface);
+
+  return surface;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_PIXEL_UTIL_H
+#define HAVE_PIXEL_UTIL_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Pixel conversion and shrinking for icons, with SSE2 and NEON versions of the
+ * inner loops where available.  Scaled pixels are premultiplied ARGB32 in
+ * native byte order, which is what cairo uses.
+ */
+
+void pixel_set_vectors_enabled (gboolean enabled);
+gboolean pixel_get_vectors_enabled (void);
+
+void pixel_premultiply (const guint8 *src,
+                        int           src_stride,
+                        gboolean      has_alpha,
+                        guint32      *dst,
+                        int           dst_stride,
+                        int           width,
+                        int           height);
+
+void pixel_unpremultiply (const guint32 *src,
+                          int            src_stride,
+                          guint8        *dst,
+                          int            dst_stride,
+                          int            width,
+                          int            height);
+
+void pixel_downscale (const guint32 *src,
+                      int            src_width,
+                      int            src_height,
+                      int            src_stride,
+                      guint32       *dst,
+                      int            dst_width,
+                      int            dst_height,
+                      int            dst_stride);
+
+GdkPixbuf *pixel_scale_pixbuf (GdkPixbuf *pixbuf,
+                               int        width,
+                               int        height);
+
+cairo_surface_t *pixel_pixbuf_to_surface (GdkPixbuf *pixbuf,
+                                          int        width,
+                                          int        height);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <glib.h>
+
+#include "taku-icon-atlas.h"
+#include "pixel-util.h"
+
+/* Width and height of the first atlas page of a size, and the most a page can
+   grow to.  Each new page is twice the size of the last, so a few icons don't
+   cost a whole large page. */
+#define MIN_PAGE_SIZE 256
+#define MAX_PAGE_SIZE 1024
+
+typedef struct _Atlas Atlas;
+
+typedef struct {
+  Atlas *atlas;
+  cairo_surface_t *surface;
+  /* Cells across and down the page */
+  guint cells_per_row;
+  /* Cells which have been used and released, and the first never used one */
+  GArray *free_cells;
+  guint next_cell;
+  guint n_used;
+} Page;
+
+/* All of the icons of one size */
+struct _Atlas {
+  int size;
+  GPtrArray *pages;
+  /* GdkPixbuf to TakuIconAtlasSlot */
+  GHashTable *slots;
+};
+
+struct _TakuIconAtlasSlot {
+  gint ref_count;
+  GdkPixbuf *pixbuf;
+  Page *page;
+  int x, y;
+};
+
+static gboolean enabled = FALSE;
+
+/* Icon size to Atlas */
+static GHashTable *atlases = NULL;
+
+/*
+ * Turn atlas mode on or off.  This must be done before any icons are
+ * acquired.
+ */
+void
+taku_icon_atlas_set_enabled (gboolean enable)
+{
+  enabled = enable;
+}
+
+gboolean
+taku_icon_atlas_get_enabled (void)
+{
+  return enabled;
+}
+
+static Atlas *
+get_atlas (int size)
+{
+  Atlas *atlas;
+
+  if (atlases == NULL)
+    atlases = g_hash_table_new (NULL, NULL);
+
+  atlas = g_hash_table_lookup (atlases, GINT_TO_POINTER (size));
+  if (atlas == NULL) {
+    atlas = g_slice_new0 (Atlas);
+    atlas->size = size;
+    atlas->pages = g_ptr_array_new ();
+    atlas->slots = g_hash_table_new (NULL, NULL);
+    g_hash_table_insert (atlases, GINT_TO_POINTER (size), atlas);
+  }
+
+  return atlas;
+}
+
+static Page *
+page_new (Atlas *atlas)
+{
+  Page *page;
+  guint i;
+  int side;
+
+  side = MIN_PAGE_SIZE;
+  for (i = 0; i < atlas->pages->len && side < MAX_PAGE_SIZE; i++)
+    side *= 2;
+
+  page = g_slice_new0 (Page);
+  page->atlas = atlas;
+  page->cells_per_row = MAX (side / atlas->size, 1);
+  side = page->cells_per_row * atlas->size;
+  page->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, side, side);
+  page->free_cells = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  g_ptr_array_add (atlas->pages, page);
+
+  return page;
+}
+
+static void
+page_free (Page *page)
+{
+  g_ptr_array_remove_fast (page->atlas->pages, page);
+
+  cairo_surface_destroy (page->surface);
+  g_array_free (page->free_cells, TRUE);
+  g_slice_free (Page, page);
+}
+
+/* Find a free cell, making a new page if they are all full */
+static Page *
+alloc_cell (Atlas *atlas, guint *cell)
+{
+  Page *page;
+  guint i;
+
+  for (i = 0; i < atlas->pages->len; i++) {
+    page = g_ptr_array_index (atlas->pages, i);
+
+    if (page->free_cells->len) {
+      *cell = g_array_index (page->free_cells, guint, page->free_cells->len - 1);
+      g_array_set_size (page->free_cells, page->free_cells->len - 1);
+      goto found;
+    }
+
+    if (page->next_cell < page->cells_per_row * page->cells_per_row) {
+      *cell = page->next_cell++;
+      goto found;
+    }
+  }
+
+  page = page_new (atlas);
+  *cell = page->next_cell++;
+
+ found:
+  page->n_used++;
+  return page;
+}
+
+/* Copy @pixbuf into the cell at @x, @y of @page */
+static void
+fill_cell (Page *page, int x, int y, GdkPixbuf *pixbuf)
+{
+  int size = page->atlas->size;
+
+  if (gdk_pixbuf_get_width (pixbuf) == size &&
+      gdk_pixbuf_get_height (pixbuf) == size &&
+      gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB &&
+      gdk_pixbuf_get_bits_per_sample (pixbuf) == 8 &&
+      gdk_pixbuf_get_n_channels (pixbuf) == (gdk_pixbuf_get_has_alpha (pixbuf) ? 4 : 3)) {
+    guint8 *data;
+    int stride;
+
+    cairo_surface_flush (page->surface);
+    data = cairo_image_surface_get_data (page->surface);
+    stride = cairo_image_surface_get_stride (page->surface);
+
+    pixel_premultiply (gdk_pixbuf_read_pixels (pixbuf),
+                       gdk_pixbuf_get_rowstride (pixbuf),
+                       gdk_pixbuf_get_has_alpha (pixbuf),
+                       (guint32 *) (data + y * stride + x * 4), stride,
+                       size, size);
+
+    cairo_surface_mark_dirty_rectangle (page->surface, x, y, size, size);
+  } else {
+    /* Odd sizes or formats are converted on their own and then copied */
+    cairo_surface_t *surface;
+    cairo_t *cr;
+
+    surface = pixel_pixbuf_to_surface (pixbuf, size, size);
+
+    cr = cairo_create (page->surface);
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface (cr, surface, x, y);
+    cairo_rectangle (cr, x, y, size, size);
+    cairo_fill (cr);
+    cairo_destroy (cr);
+
+    cairo_surface_destroy (surface);
+  }
+}
+
+/*
+ * Returns a slot holding @pixbuf at @size pixels square, sharing one if the
+ * pixbuf is already in the atlas.  Release it with taku_icon_atlas_release().
+ */
+TakuIconAtlasSlot *
+taku_icon_atlas_acquire (GdkPixbuf *pixbuf, int size)
+{
+  TakuIconAtlasSlot *slot;
+  Atlas *atlas;
+  guint cell;
+
+  g_return_val_if_fail (GDK_IS_PIXBUF (pixbuf), NULL);
+  g_return_val_if_fail (size > 0, NULL);
+
+  atlas = get_atlas (size);
+
+  slot = g_hash_table_lookup (atlas->slots, pixbuf);
+  if (slot) {
+    slot->ref_count++;
+    return slot;
+  }
+
+  slot = g_slice_new (TakuIconAtlasSlot);
+  slot->ref_count = 1;
+  slot->pixbuf = g_object_ref (pixbuf);
+  slot->page = alloc_cell (atlas, &cell);
+  slot->x = (cell % slot->page->cells_per_row) * size;
+  slot->y = (cell / slot->page->cells_per_row) * size;
+
+  fill_cell (slot->page, slot->x, slot->y, pixbuf);
+
+  g_hash_table_insert (atlas->slots, pixbuf, slot);
+
+  return slot;
+}
+
+/* Drop a reference to @slot, freeing its cell once nothing is using it */
+void
+taku_icon_atlas_release (TakuIconAtlasSlot *slot)
+{
+  Page *page;
+  Atlas *atlas;
+  guint cell;
+
+  g_return_if_fail (slot);
+
+  if (--slot->ref_count > 0)
+    return;
+
+  page = slot->page;
+  atlas = page->atlas;
+
+  g_hash_table_remove (atlas->slots, slot->pixbuf);
+  g_object_unref (slot->pixbuf);
+
+  cell = (slot->y / atlas->size) * page->cells_per_row + slot->x / atlas->size;
+  g_array_append_val (page->free_cells, cell);
+
+  if (--page->n_used == 0)
+    page_free (page);
+
+  g_slice_free (TakuIconAtlasSlot, slot);
+}
+
+/* Paint the icon in @slot with its top left corner at @x, @y */
+void
+taku_icon_atlas_slot_paint (TakuIconAtlasSlot *slot,
+                            cairo_t           *cr,
+                            double             x,
+                            double             y)
+{
+  int size;
+
+  g_return_if_fail (slot);
+
+  size = slot->page->atlas->size;
+
+  cairo_save (cr);
+  cairo_set_source_surface (cr, slot->page->surface, x - slot->x, y - slot->y);
+  cairo_rectangle (cr, x, y, size, size);
+  cairo_fill (cr);
+  cairo_restore (cr);
+}
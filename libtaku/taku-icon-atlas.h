@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_ICON_ATLAS_H
+#define HAVE_TAKU_ICON_ATLAS_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <cairo.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Packs icons of the same size into a few large image surfaces, so that tiles
+ * paint a rectangle of a shared surface instead of each keeping their own
+ * image.  Main thread only.
+ */
+
+typedef struct _TakuIconAtlasSlot TakuIconAtlasSlot;
+
+void taku_icon_atlas_set_enabled (gboolean enabled);
+gboolean taku_icon_atlas_get_enabled (void);
+
+TakuIconAtlasSlot *taku_icon_atlas_acquire (GdkPixbuf *pixbuf, int size);
+void taku_icon_atlas_release (TakuIconAtlasSlot *slot);
+
+void taku_icon_atlas_slot_paint (TakuIconAtlasSlot *slot,
+                                 cairo_t           *cr,
+                                 double             x,
+                                 double             y);
+
+G_END_DECLS
+
+#endif
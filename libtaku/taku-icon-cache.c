@@ -0,0 +1,871 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "taku-icon-cache.h"
+
+#define CACHE_MAGIC "TAKUICO"
+#define CACHE_VERSION 2
+#define CACHE_BYTE_ORDER 0x01020304
+
+/* Seconds to wait after the first new icon before writing the cache */
+#define CACHE_SAVE_DELAY 5
+
+/* Icons which weren't used this time are dropped when the file gets bigger */
+#define CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+/* Default budget of the shared pixbufs */
+#define SHARED_BUDGET (8 * 1024 * 1024)
+
+/* Rough overhead of an entry in the shared cache, charged to the budget */
+#define SHARED_ENTRY_SIZE 64
+
+#define ALIGN8(n) (((n) + 7) & ~(gsize) 7)
+
+/*
+ * The file is used straight from the mapping:
+ *
+ *   CacheHeader | CacheEntry[] | strings | pixels
+ *
+ * Entries are sorted by name and then size so that a lookup is a binary search.
+ * String offsets are relative to the string table, and 0 is NULL.  Pixel
+ * offsets are from the start of the file, and every icon starts on an 8 byte
+ * boundary with rowstride * height bytes of 8 bit RGB(A) data.
+ */
+typedef struct {
+  char magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 theme;
+  guint32 n_entries;
+  guint32 entries_offset;
+  guint32 strings_offset;
+  guint32 strings_size;
+  guint32 padding;
+} CacheHeader;
+
+typedef struct {
+  guint32 name;
+  guint32 source;
+  gint64 mtime;
+  guint32 size;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 has_alpha;
+  guint32 padding;
+  guint64 pixels;
+} CacheEntry;
+
+/* An icon made this time, waiting to be written */
+typedef struct {
+  char *name;
+  int size;
+  char *source;
+  gint64 mtime;
+  GdkPixbuf *pixbuf;
+} PendingIcon;
+
+/* An icon to write, either from the mapping or pending */
+typedef struct {
+  const char *name;
+  const char *source;
+  gint64 mtime;
+  guint32 size;
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 has_alpha;
+  const guchar *pixels;
+  gsize length;
+  gboolean used;
+} IconRecord;
+
+static GMutex cache_lock;
+static char *theme_name;
+/* If opening the file has been tried for this theme */
+static gboolean opened;
+static GMappedFile *file;
+static const CacheHeader *header;
+static const CacheEntry *entries;
+static const char *strings;
+/* Which entries of the mapping were asked for, one byte each */
+static guint8 *used;
+/* "size:name" -> PendingIcon */
+static GHashTable *pending;
+/* The icons being written by the saving thread, which belong to it */
+static GHashTable *saving;
+static guint save_id;
+
+/* An icon in the shared cache.  A NULL pixbuf means the icon doesn't exist. */
+typedef struct {
+  char *key;
+  GdkPixbuf *pixbuf;
+  gsize bytes;
+  /* Link in the LRU list, most recently used at the head */
+  GList link;
+} SharedIcon;
+
+static GMutex shared_lock;
+/* "size:name" -> SharedIcon */
+static GHashTable *shared;
+static GQueue lru = G_QUEUE_INIT;
+static TakuIconCacheStats shared_stats = { 0, 0, 0, 0, 0, 0, SHARED_BUDGET };
+
+static char *
+get_cache_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "matchbox-desktop", "icons.cache", NULL);
+}
+
+static const char *
+cache_string (guint32 offset)
+{
+  if (offset == 0 || offset >= header->strings_size)
+    return NULL;
+
+  return strings + offset;
+}
+
+static char *
+pending_key (const char *name, int size)
+{
+  return g_strdup_printf ("%d:%s", size, name);
+}
+
+static void
+pending_icon_free (gpointer data)
+{
+  PendingIcon *icon = data;
+
+  g_free (icon->name);
+  g_free (icon->source);
+  g_object_unref (icon->pixbuf);
+  g_slice_free (PendingIcon, icon);
+}
+
+/* Called with the lock held */
+static void
+close_cache (void)
+{
+  if (file)
+    g_mapped_file_unref (file);
+  file = NULL;
+  header = NULL;
+  entries = NULL;
+  strings = NULL;
+  g_free (used);
+  used = NULL;
+}
+
+/* Called with the lock held */
+static gboolean
+entry_valid (gsize length, const CacheEntry *entry)
+{
+  return entry->width > 0 && entry->height > 0 &&
+    entry->width <= G_MAXUINT16 && entry->height <= G_MAXUINT16 &&
+    entry->rowstride >= entry->width * (entry->has_alpha ? 4 : 3) &&
+    entry->pixels % 8 == 0 &&
+    entry->pixels <= length &&
+    (guint64) entry->rowstride * entry->height <= length - entry->pixels;
+}
+
+/* Called with the lock held.  Maps the file if it is for the current theme. */
+static void
+open_cache (void)
+{
+  const char *data;
+  gsize length;
+  char *filename;
+  guint i;
+
+  if (opened || theme_name == NULL)
+    return;
+  opened = TRUE;
+
+  filename = get_cache_filename ();
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+  if (file == NULL)
+    return;
+
+  data = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const CacheHeader *) data;
+
+  if (length < sizeof (CacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      header->entries_offset % 8 != 0 ||
+      header->entries_offset > length ||
+      header->n_entries > (length - header->entries_offset)
+                          / sizeof (CacheEntry) ||
+      header->strings_offset > length ||
+      header->strings_size == 0 ||
+      header->strings_size > length - header->strings_offset ||
+      data[header->strings_offset + header->strings_size - 1] != '\0') {
+    close_cache ();
+    return;
+  }
+
+  entries = (const CacheEntry *) (data + header->entries_offset);
+  strings = data + header->strings_offset;
+
+  if (g_strcmp0 (cache_string (header->theme), theme_name) != 0) {
+    close_cache ();
+    return;
+  }
+
+  for (i = 0; i < header->n_entries; i++) {
+    if (!entry_valid (length, &entries[i])) {
+      close_cache ();
+      return;
+    }
+  }
+
+  used = g_new0 (guint8, header->n_entries);
+}
+
+static int
+compare_icon (const char *name_a, guint32 size_a,
+              const char *name_b, guint32 size_b)
+{
+  int ret;
+
+  ret = strcmp (name_a ? name_a : "", name_b ? name_b : "");
+  if (ret)
+    return ret;
+
+  return size_a < size_b ? -1 : size_a > size_b;
+}
+
+/* Called with the lock held */
+static int
+find_entry (const char *name, int size)
+{
+  guint lo = 0, hi;
+
+  if (header == NULL)
+    return -1;
+
+  hi = header->n_entries;
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    int cmp;
+
+    cmp = compare_icon (cache_string (entries[mid].name), entries[mid].size,
+                        name, size);
+    if (cmp == 0)
+      return mid;
+    else if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return -1;
+}
+
+static void
+unref_mapping (guchar *pixels, gpointer data)
+{
+  g_mapped_file_unref (data);
+}
+
+static void
+shared_icon_free (gpointer data)
+{
+  SharedIcon *icon = data;
+
+  g_free (icon->key);
+  if (icon->pixbuf)
+    g_object_unref (icon->pixbuf);
+  g_slice_free (SharedIcon, icon);
+}
+
+/* Called with the shared lock held */
+static void
+remove_shared (SharedIcon *icon)
+{
+  g_queue_unlink (&lru, &icon->link);
+  shared_stats.n_icons--;
+  shared_stats.bytes -= icon->bytes;
+  g_hash_table_remove (shared, icon->key);
+}
+
+/* Called with the shared lock held */
+static void
+trim_shared (void)
+{
+  while (shared_stats.bytes > shared_stats.budget && lru.tail) {
+    remove_shared (lru.tail->data);
+    shared_stats.evictions++;
+  }
+}
+
+/*
+ * Set the icon theme the cache is for, whenever the theme changes.  The shared
+ * icons are always thrown away, as icons may have been installed or removed
+ * even if the theme is the same, and icons which were missing may now exist.
+ * The cache file is only thrown away if it was made with another theme, as its
+ * icons are checked against their files anyway.
+ */
+void
+taku_icon_cache_set_theme (const char *theme)
+{
+  gboolean changed;
+
+  g_mutex_lock (&cache_lock);
+
+  changed = g_strcmp0 (theme, theme_name) != 0;
+  if (changed) {
+    g_free (theme_name);
+    theme_name = g_strdup (theme);
+
+    close_cache ();
+    opened = FALSE;
+    if (pending)
+      g_hash_table_remove_all (pending);
+    /* The saving thread frees these, and won't switch to its file */
+    saving = NULL;
+  }
+
+  g_mutex_unlock (&cache_lock);
+
+  g_mutex_lock (&shared_lock);
+  while (lru.head)
+    remove_shared (lru.head->data);
+  g_mutex_unlock (&shared_lock);
+}
+
+/*
+ * Look for the @size pixel icon @name in the shared cache.  Returns TRUE if it
+ * is known, setting *@pixbuf to a new reference to it, or to NULL if the icon
+ * is known not to exist.
+ */
+gboolean
+taku_icon_cache_get_shared (const char *name, int size, GdkPixbuf **pixbuf)
+{
+  SharedIcon *icon = NULL;
+  char *key;
+
+  g_return_val_if_fail (name, FALSE);
+  g_return_val_if_fail (pixbuf, FALSE);
+
+  *pixbuf = NULL;
+  key = pending_key (name, size);
+
+  g_mutex_lock (&shared_lock);
+
+  if (shared)
+    icon = g_hash_table_lookup (shared, key);
+
+  if (icon) {
+    g_queue_unlink (&lru, &icon->link);
+    g_queue_push_head_link (&lru, &icon->link);
+
+    shared_stats.hits++;
+    if (icon->pixbuf)
+      *pixbuf = g_object_ref (icon->pixbuf);
+    else
+      shared_stats.negative_hits++;
+  } else {
+    shared_stats.misses++;
+  }
+
+  g_mutex_unlock (&shared_lock);
+
+  g_free (key);
+
+  return icon != NULL;
+}
+
+/*
+ * Share @pixbuf as the @size pixel icon @name, or if @pixbuf is NULL remember
+ * that there is no such icon.
+ */
+void
+taku_icon_cache_add_shared (const char *name, int size, GdkPixbuf *pixbuf)
+{
+  SharedIcon *icon, *old;
+
+  g_return_if_fail (name);
+
+  icon = g_slice_new0 (SharedIcon);
+  icon->key = pending_key (name, size);
+  icon->pixbuf = pixbuf ? g_object_ref (pixbuf) : NULL;
+  icon->bytes = SHARED_ENTRY_SIZE + strlen (icon->key);
+  if (pixbuf)
+    icon->bytes += gdk_pixbuf_get_byte_length (pixbuf);
+  icon->link.data = icon;
+
+  g_mutex_lock (&shared_lock);
+
+  if (shared == NULL)
+    shared = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                    NULL, shared_icon_free);
+
+  old = g_hash_table_lookup (shared, icon->key);
+  if (old)
+    remove_shared (old);
+
+  g_hash_table_insert (shared, icon->key, icon);
+  g_queue_push_head_link (&lru, &icon->link);
+  shared_stats.n_icons++;
+  shared_stats.bytes += icon->bytes;
+
+  trim_shared ();
+
+  g_mutex_unlock (&shared_lock);
+}
+
+/* Set how many bytes of pixbufs the shared cache may hold on to */
+void
+taku_icon_cache_set_budget (gsize bytes)
+{
+  g_mutex_lock (&shared_lock);
+  shared_stats.budget = bytes;
+  if (shared)
+    trim_shared ();
+  g_mutex_unlock (&shared_lock);
+}
+
+void
+taku_icon_cache_get_stats (TakuIconCacheStats *stats)
+{
+  g_return_if_fail (stats);
+
+  g_mutex_lock (&shared_lock);
+  *stats = shared_stats;
+  g_mutex_unlock (&shared_lock);
+}
+
+/*
+ * Returns a new reference to the @size pixel icon @name, if it is cached and
+ * was made from @source as it was at @mtime, otherwise NULL.  The pixels are
+ * shared with the cache and must not be modified.
+ */
+GdkPixbuf *
+taku_icon_cache_lookup (const char *name,
+                        int         size,
+                        const char *source,
+                        gint64      mtime)
+{
+  GdkPixbuf *pixbuf = NULL;
+  const CacheEntry *entry;
+  int i;
+
+  g_return_val_if_fail (name, NULL);
+
+  g_mutex_lock (&cache_lock);
+
+  if (pending || saving) {
+    PendingIcon *icon = NULL;
+    char *key;
+
+    key = pending_key (name, size);
+    if (pending)
+      icon = g_hash_table_lookup (pending, key);
+    if (icon == NULL && saving)
+      icon = g_hash_table_lookup (saving, key);
+    g_free (key);
+
+    if (icon) {
+      if (icon->mtime == mtime && g_strcmp0 (icon->source, source) == 0)
+        pixbuf = g_object_ref (icon->pixbuf);
+      g_mutex_unlock (&cache_lock);
+      return pixbuf;
+    }
+  }
+
+  open_cache ();
+
+  i = find_entry (name, size);
+  if (i >= 0) {
+    entry = &entries[i];
+    used[i] = TRUE;
+
+    if (entry->mtime == mtime &&
+        g_strcmp0 (cache_string (entry->source), source) == 0) {
+      g_mapped_file_ref (file);
+      pixbuf = gdk_pixbuf_new_from_data
+        ((const guchar *) g_mapped_file_get_contents (file) + entry->pixels,
+         GDK_COLORSPACE_RGB, entry->has_alpha, 8,
+         entry->width, entry->height, entry->rowstride,
+         unref_mapping, file);
+    }
+  }
+
+  g_mutex_unlock (&cache_lock);
+
+  return pixbuf;
+}
+
+static gint
+compare_records (gconstpointer a, gconstpointer b)
+{
+  const IconRecord *ra = a, *rb = b;
+
+  return compare_icon (ra->name, ra->size, rb->name, rb->size);
+}
+
+static guint32
+add_string (GString *out, GHashTable *offsets, const char *s)
+{
+  gpointer offset;
+
+  if (s == NULL)
+    return 0;
+
+  offset = g_hash_table_lookup (offsets, s);
+  if (offset == NULL) {
+    offset = GUINT_TO_POINTER (out->len);
+    g_string_append_len (out, s, strlen (s) + 1);
+    g_hash_table_insert (offsets, (gpointer) s, offset);
+  }
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static void
+pad (GString *out, gsize length)
+{
+  while (out->len < length)
+    g_string_append_c (out, '\0');
+}
+
+/*
+ * Called with the lock held.  Collects everything that should be written: the
+ * PendingIcons in @icons and the entries of the mapping they don't replace.
+ */
+static GArray *
+collect_records (GHashTable *icons)
+{
+  GArray *records;
+  GHashTableIter iter;
+  PendingIcon *icon;
+  IconRecord record;
+  gsize total = 0;
+  guint i;
+
+  records = g_array_new (FALSE, FALSE, sizeof (IconRecord));
+
+  if (header) {
+    const guchar *data = (const guchar *) g_mapped_file_get_contents (file);
+
+    for (i = 0; i < header->n_entries; i++) {
+      const CacheEntry *entry = &entries[i];
+      char *key;
+      gboolean replaced;
+
+      record.name = cache_string (entry->name);
+      if (record.name == NULL)
+        continue;
+
+      key = pending_key (record.name, entry->size);
+      replaced = g_hash_table_contains (icons, key);
+      g_free (key);
+      if (replaced)
+        continue;
+
+      record.source = cache_string (entry->source);
+      record.mtime = entry->mtime;
+      record.size = entry->size;
+      record.width = entry->width;
+      record.height = entry->height;
+      record.rowstride = entry->rowstride;
+      record.has_alpha = entry->has_alpha;
+      record.pixels = data + entry->pixels;
+      record.length = (gsize) entry->rowstride * entry->height;
+      record.used = used[i];
+      g_array_append_val (records, record);
+      total += record.length;
+    }
+  }
+
+  g_hash_table_iter_init (&iter, icons);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &icon)) {
+    record.name = icon->name;
+    record.source = icon->source;
+    record.mtime = icon->mtime;
+    record.size = icon->size;
+    record.width = gdk_pixbuf_get_width (icon->pixbuf);
+    record.height = gdk_pixbuf_get_height (icon->pixbuf);
+    record.rowstride = gdk_pixbuf_get_rowstride (icon->pixbuf);
+    record.has_alpha = gdk_pixbuf_get_has_alpha (icon->pixbuf);
+    record.pixels = gdk_pixbuf_read_pixels (icon->pixbuf);
+    record.length = gdk_pixbuf_get_byte_length (icon->pixbuf);
+    record.used = TRUE;
+    g_array_append_val (records, record);
+    total += record.length;
+  }
+
+  /* Forget icons nothing asked for if the cache is getting big */
+  if (total > CACHE_MAX_SIZE) {
+    for (i = records->len; i > 0; i--) {
+      if (!g_array_index (records, IconRecord, i - 1).used)
+        g_array_remove_index_fast (records, i - 1);
+    }
+  }
+
+  g_array_sort (records, compare_records);
+
+  return records;
+}
+
+/*
+ * A snapshot of the cache to write, taken in the main loop.  The records point
+ * into the mapping and the icons, which the job holds on to, so the file can be
+ * written in a thread without the lock.
+ */
+typedef struct {
+  GArray *records;
+  GHashTable *icons;
+  GMappedFile *file;
+  char *theme;
+} SaveJob;
+
+/* Write the records of @job, in any thread */
+static gboolean
+write_cache (SaveJob *job)
+{
+  CacheHeader new_header;
+  CacheEntry entry;
+  GArray *records = job->records;
+  GHashTable *offsets;
+  GString *out, *table;
+  GError *error = NULL;
+  char *filename, *dirname;
+  gsize offset;
+  gboolean ret;
+  guint i;
+
+  /* Offset 0 of the string table means NULL */
+  table = g_string_new (NULL);
+  g_string_append_c (table, '\0');
+  offsets = g_hash_table_new (g_str_hash, g_str_equal);
+
+  memset (&new_header, 0, sizeof (new_header));
+  memcpy (new_header.magic, CACHE_MAGIC, sizeof (new_header.magic));
+  new_header.version = CACHE_VERSION;
+  new_header.byte_order = CACHE_BYTE_ORDER;
+  new_header.theme = add_string (table, offsets, job->theme);
+  new_header.n_entries = records->len;
+  new_header.entries_offset = ALIGN8 (sizeof (CacheHeader));
+  new_header.strings_offset = new_header.entries_offset
+                              + records->len * sizeof (CacheEntry);
+
+  for (i = 0; i < records->len; i++) {
+    IconRecord *record = &g_array_index (records, IconRecord, i);
+
+    add_string (table, offsets, record->name);
+    add_string (table, offsets, record->source);
+  }
+  new_header.strings_size = table->len;
+
+  out = g_string_sized_new (new_header.strings_offset + table->len);
+  g_string_append_len (out, (const char *) &new_header, sizeof (new_header));
+  pad (out, new_header.entries_offset);
+
+  /* Pixels go after the strings */
+  offset = ALIGN8 (new_header.strings_offset + table->len);
+  for (i = 0; i < records->len; i++) {
+    IconRecord *record = &g_array_index (records, IconRecord, i);
+
+    memset (&entry, 0, sizeof (entry));
+    entry.name = add_string (table, offsets, record->name);
+    entry.source = add_string (table, offsets, record->source);
+    entry.mtime = record->mtime;
+    entry.size = record->size;
+    entry.width = record->width;
+    entry.height = record->height;
+    entry.rowstride = record->rowstride;
+    entry.has_alpha = record->has_alpha;
+    entry.pixels = offset;
+    g_string_append_len (out, (const char *) &entry, sizeof (entry));
+
+    offset = ALIGN8 (offset + (gsize) record->rowstride * record->height);
+  }
+
+  g_string_append_len (out, table->str, table->len);
+
+  for (i = 0; i < records->len; i++) {
+    IconRecord *record = &g_array_index (records, IconRecord, i);
+
+    pad (out, ALIGN8 (out->len));
+    g_string_append_len (out, (const char *) record->pixels, record->length);
+    /* The last row of a pixbuf can be shorter than the rowstride */
+    pad (out, out->len + (gsize) record->rowstride * record->height
+              - record->length);
+  }
+
+  filename = get_cache_filename ();
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0755);
+
+  ret = g_file_set_contents (filename, out->str, out->len, &error);
+  if (!ret) {
+    g_warning ("Cannot write icon cache: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (dirname);
+  g_free (filename);
+  g_string_free (out, TRUE);
+  g_string_free (table, TRUE);
+  g_hash_table_destroy (offsets);
+
+  return ret;
+}
+
+static gpointer
+save_thread (gpointer data)
+{
+  SaveJob *job = data;
+  GHashTableIter iter;
+  gpointer key, icon;
+  gboolean saved;
+
+  saved = write_cache (job);
+
+  g_mutex_lock (&cache_lock);
+
+  /* Unless the theme changed meanwhile, switch over to the new file so the
+     icons can go, or keep them for next time if it couldn't be written */
+  if (saving == job->icons) {
+    saving = NULL;
+
+    if (saved) {
+      close_cache ();
+      opened = FALSE;
+    } else {
+      g_hash_table_iter_init (&iter, job->icons);
+      while (g_hash_table_iter_next (&iter, &key, &icon)) {
+        if (g_hash_table_contains (pending, key))
+          continue;
+        g_hash_table_iter_steal (&iter);
+        g_hash_table_insert (pending, key, icon);
+      }
+    }
+  }
+
+  g_mutex_unlock (&cache_lock);
+
+  g_array_free (job->records, TRUE);
+  g_hash_table_destroy (job->icons);
+  if (job->file)
+    g_mapped_file_unref (job->file);
+  g_free (job->theme);
+  g_slice_free (SaveJob, job);
+
+  return NULL;
+}
+
+/*
+ * Write the cache in a thread.  The file can be several megabytes, and writing
+ * it with the lock held would stall the decoders as well as the main loop.
+ */
+static gboolean
+save_timeout (gpointer data)
+{
+  SaveJob *job;
+
+  g_mutex_lock (&cache_lock);
+
+  save_id = 0;
+
+  /* Still writing the last lot, so try again later */
+  if (saving) {
+    save_id = g_timeout_add_seconds (CACHE_SAVE_DELAY, save_timeout, NULL);
+    g_mutex_unlock (&cache_lock);
+    return FALSE;
+  }
+
+  /* New icons go into a new table while these are written */
+  saving = pending;
+  pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                   g_free, pending_icon_free);
+
+  job = g_slice_new (SaveJob);
+  job->records = collect_records (saving);
+  job->icons = saving;
+  job->file = file ? g_mapped_file_ref (file) : NULL;
+  job->theme = g_strdup (theme_name);
+
+  g_mutex_unlock (&cache_lock);
+
+  g_thread_unref (g_thread_new ("taku-icon-cache-save", save_thread, job));
+
+  return FALSE;
+}
+
+/*
+ * Add @pixbuf as the @size pixel icon @name, made from @source as it was at
+ * @mtime.  The cache is written out a little after the first icon is added.
+ */
+void
+taku_icon_cache_insert (const char *name,
+                        int         size,
+                        const char *source,
+                        gint64      mtime,
+                        GdkPixbuf  *pixbuf)
+{
+  PendingIcon *icon;
+
+  g_return_if_fail (name);
+  g_return_if_fail (GDK_IS_PIXBUF (pixbuf));
+
+  if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    return;
+
+  icon = g_slice_new (PendingIcon);
+  icon->name = g_strdup (name);
+  icon->size = size;
+  icon->source = g_strdup (source);
+  icon->mtime = mtime;
+  icon->pixbuf = g_object_ref (pixbuf);
+
+  g_mutex_lock (&cache_lock);
+
+  if (theme_name == NULL) {
+    g_mutex_unlock (&cache_lock);
+    pending_icon_free (icon);
+    return;
+  }
+
+  /* Keep the mapped entries to copy when saving */
+  open_cache ();
+
+  if (pending == NULL)
+    pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                     g_free, pending_icon_free);
+  g_hash_table_replace (pending, pending_key (name, size), icon);
+
+  if (save_id == 0)
+    save_id = g_timeout_add_seconds (CACHE_SAVE_DELAY, save_timeout, NULL);
+
+  g_mutex_unlock (&cache_lock);
+}
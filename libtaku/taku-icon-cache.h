@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_ICON_CACHE_H
+#define HAVE_TAKU_ICON_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A persistent cache of icons, decoded and scaled to the size they are drawn
+ * at.  The cache file is mapped and the pixbufs it returns point straight into
+ * the mapping, so a warm start neither decodes nor scales.  Icons are found by
+ * name and size, and only returned if the file they were made from still has
+ * the same path and modification time.
+ *
+ * In front of that is a process-wide cache of the pixbufs handed out, so every
+ * tile showing an icon shares one pixbuf.  It also remembers icons which don't
+ * exist, and drops the least recently used icons to stay within a byte budget.
+ *
+ * Everything is dropped when the icon theme changes.  All of these functions
+ * can be called from any thread.
+ */
+
+typedef struct {
+  /* Lookups of the shared cache, and how many were for missing icons */
+  guint hits;
+  guint misses;
+  guint negative_hits;
+  /* Icons dropped to stay within the budget */
+  guint evictions;
+  /* What is held now */
+  guint n_icons;
+  gsize bytes;
+  gsize budget;
+} TakuIconCacheStats;
+
+void taku_icon_cache_set_theme (const char *theme);
+
+gboolean taku_icon_cache_get_shared (const char  *name,
+                                     int          size,
+                                     GdkPixbuf  **pixbuf);
+void taku_icon_cache_add_shared (const char *name,
+                                 int         size,
+                                 GdkPixbuf  *pixbuf);
+
+void taku_icon_cache_set_budget (gsize bytes);
+void taku_icon_cache_get_stats (TakuIconCacheStats *stats);
+
+GdkPixbuf *taku_icon_cache_lookup (const char *name,
+                                   int         size,
+                                   const char *source,
+                                   gint64      mtime);
+
+void taku_icon_cache_insert (const char *name,
+                             int         size,
+                             const char *source,
+                             gint64      mtime,
+                             GdkPixbuf  *pixbuf);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,644 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "taku-icon-loader.h"
+#include "pixel-util.h"
+#include "taku-icon-cache.h"
+#include "taku-menu-cache.h"
+#include "taku-queue-source.h"
+
+#define MISSING_IMAGE "gtk-missing-image"
+#define GENERIC_EXECUTABLE "application-x-executable"
+
+/* Upper limit on the decoding threads */
+#define MAX_WORKERS 4
+
+/* Larger icons are shrunk to this many times the wanted size as they are
+   decoded, which saves memory, and the box filter does the rest */
+#define MAX_DECODE_SCALE 4
+
+struct _TakuIconRequest {
+  TakuIconLoaderFunc func;
+  gpointer data;
+  TakuIconPriority priority;
+  gboolean cancelled;
+  /* The job this is waiting on */
+  struct _LoadJob *job;
+};
+
+/*
+ * An icon being loaded.  The worker only touches the pixbuf and the decoded
+ * flag; everything else belongs to the main thread.
+ */
+typedef struct _LoadJob {
+  char *key;
+  /* The requested name, and what it is cached as on disk */
+  char *name;
+  char *stripped;
+  int size;
+  /* The file to decode, which for theme icons is looked up beforehand since
+     GtkIconInfo may only be used in the main thread */
+  char *filename;
+  gboolean from_theme;
+  guint theme_serial;
+
+  /* Set when every request has been cancelled, so the work can be skipped */
+  gint cancelled;
+  GSList *requests;
+
+  /* The most urgent priority of the requests, read by the pool's sort
+     function, and the order the job was made in to keep it stable */
+  gint priority;
+  guint serial;
+
+  GdkPixbuf *pixbuf;
+  gboolean decoded;
+} LoadJob;
+
+static GtkIconTheme *theme;
+/* Bumped whenever the theme changes, so that old results are ignored */
+static guint theme_serial;
+
+static GThreadPool *pool;
+/* "size:name" -> LoadJob being decoded */
+static GHashTable *in_flight;
+/* Finished LoadJobs, waiting for the main loop */
+static TakuQueue *results;
+static guint job_serial;
+static guint resort_id;
+
+/* Strips extension off filename */
+static char *
+strip_extension (const char *file)
+{
+        char *stripped, *p;
+
+        stripped = g_strdup (file);
+
+        p = strrchr (stripped, '.');
+        if (p &&
+            (!strcmp (p, ".png") ||
+             !strcmp (p, ".svg") ||
+             !strcmp (p, ".xpm")))
+	        *p = 0;
+
+        return stripped;
+}
+
+/* Returns the icon to try when @name can't be found, or NULL */
+static const char *
+get_fallback (const char *name)
+{
+  /* Fallback on generic executable, then missing image */
+  if (g_path_is_absolute (name) || strcmp (name, MISSING_IMAGE) == 0)
+    return NULL;
+  else if (strcmp (name, GENERIC_EXECUTABLE) == 0)
+    return MISSING_IMAGE;
+  else
+    return GENERIC_EXECUTABLE;
+}
+
+/* The cached icons are only good for the theme they were loaded from */
+static void
+theme_changed (GtkIconTheme *icon_theme, gpointer user_data)
+{
+  char *name = NULL;
+
+  g_object_get (gtk_settings_get_default (),
+                "gtk-icon-theme-name", &name,
+                NULL);
+  taku_icon_cache_set_theme (name);
+  g_free (name);
+
+  theme_serial++;
+}
+
+static void
+ensure_theme (void)
+{
+  if (G_LIKELY (theme))
+    return;
+
+  theme = gtk_icon_theme_get_default ();
+  g_signal_connect (theme, "changed", G_CALLBACK (theme_changed), NULL);
+  theme_changed (theme, NULL);
+}
+
+/*
+ * Returns a number which changes whenever the icon theme does, so that users
+ * can tell if icons they loaded earlier are out of date.
+ */
+guint
+taku_icon_loader_get_theme_serial (void)
+{
+  ensure_theme ();
+
+  return theme_serial;
+}
+
+/* Scale @pixbuf to @size square, taking the reference passed in */
+static GdkPixbuf *
+scale_icon (GdkPixbuf *pixbuf, int size)
+{
+  gint width, height;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  if (width != size || height != size) {
+    GdkPixbuf *new;
+    
+    new = pixel_scale_pixbuf (pixbuf, size, size);
+    
+    g_object_unref (pixbuf);
+    pixbuf = new;
+  }
+
+  return pixbuf;
+}
+
+/* Scale @pixbuf to fit in @size square keeping its shape, taking the
+   reference passed in */
+static GdkPixbuf *
+fit_icon (GdkPixbuf *pixbuf, int size)
+{
+  gint width, height;
+  GdkPixbuf *new;
+
+  width = gdk_pixbuf_get_width (pixbuf);
+  height = gdk_pixbuf_get_height (pixbuf);
+
+  if (width <= size && height <= size)
+    return pixbuf;
+
+  if (width > height) {
+    height = MAX (height * size / width, 1);
+    width = size;
+  } else {
+    width = MAX (width * size / height, 1);
+    height = size;
+  }
+
+  new = pixel_scale_pixbuf (pixbuf, width, height);
+  g_object_unref (pixbuf);
+
+  return new;
+}
+
+/*
+ * Decode @filename for an icon of @size.  It is left at its own size where
+ * possible, so that it is shrunk once by the box filter rather than by the
+ * loader.  Small icons are enlarged by the loader, which draws vector icons
+ * sharply.
+ */
+static GdkPixbuf *
+decode_file (const char *filename, int size, GError **error)
+{
+  gint width, height, limit;
+
+  limit = size * MAX_DECODE_SCALE;
+
+  if (gdk_pixbuf_get_file_info (filename, &width, &height) &&
+      MAX (width, height) >= size) {
+    if (MAX (width, height) <= limit)
+      return gdk_pixbuf_new_from_file (filename, error);
+    size = limit;
+  }
+
+  return gdk_pixbuf_new_from_file_at_scale (filename, size, size,
+                                            TRUE, error);
+}
+
+static char *
+make_key (const char *name, int size)
+{
+  return g_strdup_printf ("%d:%s", size, name);
+}
+
+static LoadJob *
+job_new (const char *name, int size)
+{
+  LoadJob *job;
+
+  job = g_slice_new0 (LoadJob);
+  job->key = make_key (name, size);
+  job->name = g_strdup (name);
+  job->size = size;
+  job->theme_serial = theme_serial;
+  job->priority = TAKU_ICON_PRIORITY_LATER;
+  job->serial = job_serial++;
+
+  return job;
+}
+
+static void
+job_free (LoadJob *job)
+{
+  g_free (job->key);
+  g_free (job->name);
+  g_free (job->stripped);
+  g_free (job->filename);
+  if (job->pixbuf)
+    g_object_unref (job->pixbuf);
+  g_slist_free (job->requests);
+  g_slice_free (LoadJob, job);
+}
+
+/*
+ * Find what to decode for @job, in the main thread.  Finding the file is cheap,
+ * it is decoding and scaling it which is worth doing elsewhere.  Returns FALSE
+ * if the theme doesn't have the icon.
+ */
+static gboolean
+prepare_job (LoadJob *job)
+{
+  GtkIconInfo *info;
+  GError *error = NULL;
+
+  if (g_path_is_absolute (job->name)) {
+    job->stripped = g_strdup (job->name);
+    job->filename = g_strdup (job->name);
+    return TRUE;
+  }
+
+  job->stripped = strip_extension (job->name);
+  info = gtk_icon_theme_lookup_icon (theme, job->stripped, job->size, 0);
+  if (info == NULL) {
+    g_warning ("Error loading icon: Icon '%s' not present in theme",
+               job->stripped);
+    return FALSE;
+  }
+
+  job->from_theme = TRUE;
+  job->filename = g_strdup (gtk_icon_info_get_filename (info));
+
+  /* Builtin icons have no file, but are already in memory */
+  if (job->filename == NULL) {
+    job->pixbuf = gtk_icon_info_load_icon (info, &error);
+    if (error) {
+      g_warning ("Error loading icon: %s", error->message);
+      g_error_free (error);
+    }
+    if (job->pixbuf)
+      job->pixbuf = scale_icon (job->pixbuf, job->size);
+  }
+
+  g_object_unref (info);
+
+  return TRUE;
+}
+
+/* Decode the icon for @job, in any thread */
+static void
+decode_job (LoadJob *job)
+{
+  GdkPixbuf *pixbuf = NULL;
+  GError *error = NULL;
+  const char *filename = job->filename;
+  GStatBuf st;
+  gboolean cacheable;
+  gint64 mtime = 0;
+
+  if (filename == NULL) {
+    job->decoded = TRUE;
+    return;
+  }
+
+  /* Stamped like the menu cache, as whole seconds miss quick rewrites */
+  cacheable = g_stat (filename, &st) == 0;
+  if (cacheable) {
+    mtime = taku_menu_cache_get_mtime (&st);
+    pixbuf = taku_icon_cache_lookup (job->stripped, job->size,
+                                     filename, mtime);
+  }
+
+  if (pixbuf == NULL) {
+    pixbuf = decode_file (filename, job->size, &error);
+    if (error) {
+      g_warning ("Error loading icon: %s", error->message);
+      g_error_free (error);
+    }
+
+    /* Theme icons are square, other files keep their shape */
+    if (pixbuf) {
+      if (job->from_theme)
+        pixbuf = scale_icon (pixbuf, job->size);
+      else
+        pixbuf = fit_icon (pixbuf, job->size);
+      if (cacheable && pixbuf)
+        taku_icon_cache_insert (job->stripped, job->size,
+                                filename, mtime, pixbuf);
+    }
+  }
+
+  job->pixbuf = pixbuf;
+  job->decoded = TRUE;
+}
+
+/*
+ * Returns a reference to the icon @name at @size pixels square, loading it in
+ * this thread if it isn't cached.  Icons are shared, so the pixbuf must not be
+ * modified.  Icons which can't be found are remembered, so the theme is only
+ * searched (and warns) once for them.
+ */
+GdkPixbuf *
+taku_icon_loader_load (const char *name, int size)
+{
+  GdkPixbuf *pixbuf = NULL;
+
+  ensure_theme ();
+
+  if (name == NULL)
+    name = GENERIC_EXECUTABLE;
+
+  while (name) {
+    if (!taku_icon_cache_get_shared (name, size, &pixbuf)) {
+      LoadJob *job;
+
+      job = job_new (name, size);
+      if (prepare_job (job))
+        decode_job (job);
+      pixbuf = job->pixbuf ? g_object_ref (job->pixbuf) : NULL;
+      taku_icon_cache_add_shared (name, size, pixbuf);
+      job_free (job);
+    }
+
+    if (pixbuf)
+      return pixbuf;
+
+    name = get_fallback (name);
+  }
+
+  return NULL;
+}
+
+static void
+deliver (TakuIconRequest *request, GdkPixbuf *pixbuf)
+{
+  request->func (pixbuf, request->data);
+  g_slice_free (TakuIconRequest, request);
+}
+
+static gboolean resolve (TakuIconRequest *request, const char *name, int size);
+
+/* Hand a finished job to the requests waiting on it, in the main loop */
+static void
+finish_job (gpointer data, gpointer user_data)
+{
+  LoadJob *job = data;
+  GSList *l;
+
+  g_hash_table_remove (in_flight, job->key);
+
+  /* Skipped or made for another theme, so it doesn't tell us anything */
+  if (job->theme_serial != theme_serial)
+    job->decoded = FALSE;
+
+  if (job->decoded)
+    taku_icon_cache_add_shared (job->name, job->size, job->pixbuf);
+
+  for (l = job->requests; l; l = l->next) {
+    TakuIconRequest *request = l->data;
+
+    request->job = NULL;
+
+    if (request->cancelled) {
+      g_slice_free (TakuIconRequest, request);
+    } else if (!job->decoded) {
+      /* Someone asked again after everyone had cancelled */
+      resolve (request, job->name, job->size);
+    } else if (job->pixbuf) {
+      deliver (request, job->pixbuf);
+    } else if (get_fallback (job->name)) {
+      resolve (request, get_fallback (job->name), job->size);
+    } else {
+      deliver (request, NULL);
+    }
+  }
+
+  job_free (job);
+}
+
+/* Called by the pool to keep the waiting jobs in order, in any thread */
+static gint
+compare_jobs (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const LoadJob *ja = a, *jb = b;
+  gint pa, pb;
+
+  pa = g_atomic_int_get (&ja->priority);
+  pb = g_atomic_int_get (&jb->priority);
+  if (pa != pb)
+    return pa < pb ? -1 : 1;
+
+  return ja->serial < jb->serial ? -1 : ja->serial > jb->serial;
+}
+
+/* Setting the sort function again sorts the jobs which are waiting */
+static gboolean
+resort_jobs (gpointer data)
+{
+  resort_id = 0;
+  g_thread_pool_set_sort_function (pool, compare_jobs, NULL);
+
+  return FALSE;
+}
+
+/* Give @job the priority of its most urgent request */
+static void
+update_job_priority (LoadJob *job)
+{
+  gint priority = TAKU_ICON_PRIORITY_LATER;
+  GSList *l;
+
+  for (l = job->requests; l; l = l->next) {
+    TakuIconRequest *request = l->data;
+
+    if (!request->cancelled)
+      priority = MIN (priority, (gint) request->priority);
+  }
+
+  if (priority == g_atomic_int_get (&job->priority))
+    return;
+
+  g_atomic_int_set (&job->priority, priority);
+
+  /* Many requests tend to change at once, so sort once they have */
+  if (resort_id == 0)
+    resort_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, resort_jobs,
+                                 NULL, NULL);
+}
+
+static void
+decode_thread (gpointer data, gpointer user_data)
+{
+  LoadJob *job = data;
+
+  if (!g_atomic_int_get (&job->cancelled))
+    decode_job (job);
+
+  taku_queue_push (results, job);
+}
+
+/*
+ * Find the icon @name for @request, delivering it straight away if it is
+ * cached.  Otherwise the request waits on a job to load it, and TRUE is
+ * returned.
+ */
+static gboolean
+resolve (TakuIconRequest *request, const char *name, int size)
+{
+  GdkPixbuf *pixbuf;
+  LoadJob *job;
+  char *key;
+
+  while (name) {
+    if (taku_icon_cache_get_shared (name, size, &pixbuf)) {
+      if (pixbuf) {
+        deliver (request, pixbuf);
+        g_object_unref (pixbuf);
+        return FALSE;
+      }
+
+      name = get_fallback (name);
+      continue;
+    }
+
+    /* Another request is already loading it */
+    key = make_key (name, size);
+    job = g_hash_table_lookup (in_flight, key);
+    g_free (key);
+
+    if (job) {
+      g_atomic_int_set (&job->cancelled, FALSE);
+      job->requests = g_slist_prepend (job->requests, request);
+      request->job = job;
+      update_job_priority (job);
+      return TRUE;
+    }
+
+    job = job_new (name, size);
+
+    if (!prepare_job (job)) {
+      taku_icon_cache_add_shared (name, size, NULL);
+      job_free (job);
+      name = get_fallback (name);
+      continue;
+    }
+
+    job->priority = request->priority;
+    job->requests = g_slist_prepend (job->requests, request);
+    request->job = job;
+
+    g_hash_table_insert (in_flight, job->key, job);
+    g_thread_pool_push (pool, job, NULL);
+
+    return TRUE;
+  }
+
+  deliver (request, NULL);
+  return FALSE;
+}
+
+/*
+ * Load the icon @name at @size pixels square, calling @func with it from the
+ * main loop.  Icons are decoded in order of @priority.  If the icon is already
+ * cached @func is called before this returns, and NULL is returned.  Otherwise
+ * the returned request can be passed to taku_icon_loader_set_priority() and
+ * taku_icon_loader_cancel() until @func has been called.
+ */
+TakuIconRequest *
+taku_icon_loader_request (const char         *name,
+                          int                 size,
+                          TakuIconPriority    priority,
+                          TakuIconLoaderFunc  func,
+                          gpointer            data)
+{
+  TakuIconRequest *request;
+
+  g_return_val_if_fail (func, NULL);
+
+  ensure_theme ();
+
+  if (G_UNLIKELY (pool == NULL)) {
+    pool = g_thread_pool_new (decode_thread, NULL,
+                              CLAMP (g_get_num_processors (), 1, MAX_WORKERS),
+                              FALSE, NULL);
+    g_thread_pool_set_sort_function (pool, compare_jobs, NULL);
+    in_flight = g_hash_table_new (g_str_hash, g_str_equal);
+    results = taku_queue_new (TAKU_QUEUE_PRIORITY_HIGH, finish_job, NULL, NULL);
+  }
+
+  request = g_slice_new0 (TakuIconRequest);
+  request->func = func;
+  request->data = data;
+  request->priority = priority;
+
+  if (name == NULL)
+    name = GENERIC_EXECUTABLE;
+
+  return resolve (request, name, size) ? request : NULL;
+}
+
+/* Change how soon @request is wanted, when the user looks somewhere else */
+void
+taku_icon_loader_set_priority (TakuIconRequest  *request,
+                               TakuIconPriority  priority)
+{
+  g_return_if_fail (request);
+
+  if (request->priority == priority)
+    return;
+
+  request->priority = priority;
+  if (request->job)
+    update_job_priority (request->job);
+}
+
+/* Stop @request, so that its function is never called */
+void
+taku_icon_loader_cancel (TakuIconRequest *request)
+{
+  LoadJob *job;
+  GSList *l;
+
+  g_return_if_fail (request);
+  g_return_if_fail (!request->cancelled);
+
+  request->cancelled = TRUE;
+
+  job = request->job;
+  if (job == NULL)
+    return;
+
+  update_job_priority (job);
+
+  for (l = job->requests; l; l = l->next) {
+    if (!((TakuIconRequest *) l->data)->cancelled)
+      return;
+  }
+
+  g_atomic_int_set (&job->cancelled, TRUE);
+}
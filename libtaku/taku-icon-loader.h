@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_ICON_LOADER_H
+#define HAVE_TAKU_ICON_LOADER_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Loads icons from the icon theme, through the icon caches.  Asynchronous
+ * requests are decoded and scaled in a pool of worker threads, and the
+ * callback is invoked in the main loop.  Both of these must be called from
+ * the main thread.
+ */
+
+typedef struct _TakuIconRequest TakuIconRequest;
+
+/* How soon a requested icon is wanted, most urgent first */
+typedef enum {
+  /* On screen in the current category */
+  TAKU_ICON_PRIORITY_VISIBLE,
+  /* Elsewhere in the current category */
+  TAKU_ICON_PRIORITY_CURRENT,
+  /* In the categories either side of the current one */
+  TAKU_ICON_PRIORITY_ADJACENT,
+  TAKU_ICON_PRIORITY_LATER
+} TakuIconPriority;
+
+/* @pixbuf is only valid for the duration of the call, ref it to keep it */
+typedef void (*TakuIconLoaderFunc) (GdkPixbuf *pixbuf, gpointer data);
+
+GdkPixbuf *taku_icon_loader_load (const char *name, int size);
+
+TakuIconRequest *taku_icon_loader_request (const char         *name,
+                                           int                 size,
+                                           TakuIconPriority    priority,
+                                           TakuIconLoaderFunc  func,
+                                           gpointer            data);
+void taku_icon_loader_set_priority (TakuIconRequest  *request,
+                                    TakuIconPriority  priority);
+void taku_icon_loader_cancel (TakuIconRequest *request);
+
+guint taku_icon_loader_get_theme_serial (void);
+
+G_END_DECLS
+
+#endif
@@ -18,19 +18,44 @@
 
 #include <gtk/gtk.h>
 #include "taku-icon-tile.h"
+#include "taku-icon-atlas.h"
+#include "taku-icon-loader.h"
 
 G_DEFINE_TYPE (TakuIconTile, taku_icon_tile, TAKU_TYPE_TILE);
 
 #define GET_PRIVATE(o) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((o), TAKU_TYPE_ICON_TILE, TakuIconTilePrivate))
 
+/* Between the icon and the text, and between the lines of text */
+#define SPACING 6
+
+/*
+ * The tile is a single widget which draws its icon and text itself, instead
+ * of a tree of boxes, an image and labels.  The text is kept in PangoLayouts
+ * which are only remade when the text or the font changes.
+ */
 struct _TakuIconTilePrivate
 {
-  GtkWidget *icon;
-  GtkWidget *primary;
-  GtkWidget *secondary;
+  GdkPixbuf *pixbuf;
+  /* In atlas mode the icon is painted from here */
+  TakuIconAtlasSlot *atlas_slot;
+  guint icon_size;
+  /* The icon set by name which is still loading */
+  TakuIconRequest *icon_request;
+
+  gchar *primary;
+  gchar *secondary;
+  PangoLayout *primary_layout;
+  PangoLayout *secondary_layout;
+  /* The unellipsized size of the text, measured when it changes */
+  gboolean text_size_valid;
+  int text_width, text_height, primary_height;
+
   gchar *collation_key;
+  gboolean collation_key_valid;
+
   GtkOrientation orientation;
+  gboolean show_secondary;
 };
 
 enum {
@@ -40,73 +65,232 @@ enum {
   PROP_SECONDARY,
 };
 
-static void
-tile_arrange (TakuIconTile *tile)
+static PangoAttrList *
+get_bold_attributes (void)
 {
-  GtkOrientation orientation = GTK_ORIENTATION_HORIZONTAL;
-  gboolean show_secondary = TRUE;
-  
-  gtk_widget_style_get (GTK_WIDGET (tile),
-                        "show-secondary-text", &show_secondary,
-                        "orientation", &orientation,
-                        NULL);
-  
-  if (orientation != tile->priv->orientation) {
-    GtkWidget *box, *vbox;
-    if (tile->priv->orientation != -1) {
-      gtk_widget_destroy (gtk_bin_get_child (GTK_BIN (tile)));
-    }
+  static PangoAttrList *list = NULL;
+
+  if (list == NULL) {
+    PangoAttribute *attr;
+
+    list = pango_attr_list_new ();
     
-    tile->priv->orientation = orientation;
-    gtk_widget_show (tile->priv->icon);
-    gtk_widget_show (tile->priv->primary);
+    attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+    attr->start_index = 0;
+    attr->end_index = G_MAXUINT;
+    pango_attr_list_insert (list, attr);
     
-    switch (orientation) {
-    case GTK_ORIENTATION_VERTICAL :
-      gtk_label_set_xalign (GTK_LABEL (tile->priv->primary), 0.5);
-      gtk_label_set_xalign (GTK_LABEL (tile->priv->secondary), 0.5);
-      box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 6);
-      break;
-    default:
-    case GTK_ORIENTATION_HORIZONTAL :
-      gtk_label_set_xalign (GTK_LABEL (tile->priv->primary), 0.0);
-      gtk_label_set_xalign (GTK_LABEL (tile->priv->secondary), 0.0);
-      box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
-      break;
+    attr = pango_attr_scale_new (1.2);
+    attr->start_index = 0;
+    attr->end_index = G_MAXUINT;
+    pango_attr_list_insert (list, attr);
+  } 
+
+  return list;
+}
+
+static PangoLayout *
+make_layout (TakuIconTile *tile, const char *text)
+{
+  PangoLayout *layout;
+
+  layout = gtk_widget_create_pango_layout (GTK_WIDGET (tile), text);
+  /* Align the text to the widget's direction, not to its own */
+  pango_layout_set_auto_dir (layout, FALSE);
+  pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+  pango_layout_set_single_paragraph_mode (layout, TRUE);
+
+  return layout;
+}
+
+static void
+ensure_layouts (TakuIconTile *tile)
+{
+  TakuIconTilePrivate *priv = tile->priv;
+
+  if (priv->primary_layout == NULL) {
+    priv->primary_layout = make_layout (tile, priv->primary);
+    pango_layout_set_attributes (priv->primary_layout, get_bold_attributes ());
+  }
+
+  if (priv->secondary_layout == NULL)
+    priv->secondary_layout = make_layout (tile, priv->secondary);
+}
+
+/* The size of the icon, or of the space kept for it if there isn't one */
+static void
+get_icon_size (TakuIconTile *tile, int *width, int *height)
+{
+  TakuIconTilePrivate *priv = tile->priv;
+
+  if (priv->pixbuf && priv->atlas_slot == NULL) {
+    *width = gdk_pixbuf_get_width (priv->pixbuf);
+    *height = gdk_pixbuf_get_height (priv->pixbuf);
+  } else {
+    *width = *height = priv->icon_size;
+  }
+}
+
+static void
+invalidate_text_size (TakuIconTile *tile)
+{
+  tile->priv->text_size_valid = FALSE;
+  gtk_widget_queue_resize (GTK_WIDGET (tile));
+}
+
+/* The natural width of the widest line, and the height of all of them */
+static void
+get_text_size (TakuIconTile *tile, int *width, int *height)
+{
+  TakuIconTilePrivate *priv = tile->priv;
+  int w, h;
+
+  ensure_layouts (tile);
+
+  if (!priv->text_size_valid) {
+    /* Measure without ellipsizing, drawing sets the width again */
+    pango_layout_set_width (priv->primary_layout, -1);
+    pango_layout_get_pixel_size (priv->primary_layout,
+                                 &priv->text_width, &priv->primary_height);
+    priv->text_height = priv->primary_height;
+
+    if (priv->show_secondary) {
+      pango_layout_set_width (priv->secondary_layout, -1);
+      pango_layout_get_pixel_size (priv->secondary_layout, &w, &h);
+      priv->text_width = MAX (priv->text_width, w);
+      priv->text_height += SPACING + h;
     }
-    
-    gtk_widget_show (box);
-    
-    gtk_box_pack_start (GTK_BOX (box), tile->priv->icon, FALSE, FALSE, 0);
-    
-    vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 6);
-    gtk_widget_show (vbox);
 
-    gtk_box_pack_start (GTK_BOX (vbox), tile->priv->primary, TRUE, TRUE, 0);
-    gtk_box_pack_start (GTK_BOX (vbox), tile->priv->secondary, TRUE, TRUE, 0);
-    
-    gtk_box_pack_start (GTK_BOX (box), vbox, TRUE, TRUE, 0);
-    
-    gtk_container_add (GTK_CONTAINER (tile), box);
+    priv->text_size_valid = TRUE;
   }
-  
-  if (show_secondary) {
-    gtk_widget_show (tile->priv->secondary);
+
+  *width = priv->text_width;
+  *height = priv->text_height;
+}
+
+static void
+taku_icon_tile_get_preferred_width (GtkWidget *widget, int *minimum, int *natural)
+{
+  TakuIconTile *tile = TAKU_ICON_TILE (widget);
+  int icon_width, icon_height, text_width, text_height;
+
+  get_icon_size (tile, &icon_width, &icon_height);
+  get_text_size (tile, &text_width, &text_height);
+
+  /* The text is ellipsized, so can shrink to nothing */
+  if (tile->priv->orientation == GTK_ORIENTATION_VERTICAL) {
+    *minimum = icon_width;
+    *natural = MAX (icon_width, text_width);
   } else {
-    gtk_widget_hide (tile->priv->secondary);
+    *minimum = icon_width + SPACING;
+    *natural = icon_width + SPACING + text_width;
+  }
+}
+
+static void
+taku_icon_tile_get_preferred_height (GtkWidget *widget, int *minimum, int *natural)
+{
+  TakuIconTile *tile = TAKU_ICON_TILE (widget);
+  int icon_width, icon_height, text_width, text_height;
+
+  get_icon_size (tile, &icon_width, &icon_height);
+  get_text_size (tile, &text_width, &text_height);
+
+  if (tile->priv->orientation == GTK_ORIENTATION_VERTICAL)
+    *minimum = *natural = icon_height + SPACING + text_height;
+  else
+    *minimum = *natural = MAX (icon_height, text_height);
+}
+
+static void
+draw_icon (TakuIconTile *tile, cairo_t *cr, int x, int y)
+{
+  TakuIconTilePrivate *priv = tile->priv;
+
+  if (priv->atlas_slot) {
+    taku_icon_atlas_slot_paint (priv->atlas_slot, cr, x, y);
+  } else if (priv->pixbuf) {
+    gdk_cairo_set_source_pixbuf (cr, priv->pixbuf, x, y);
+    cairo_paint (cr);
   }
 }
 
+static void
+draw_text (TakuIconTile *tile, cairo_t *cr, GtkStyleContext *context,
+           PangoLayout *layout, int x, int y, int width)
+{
+  pango_layout_set_width (layout, MAX (width, 0) * PANGO_SCALE);
+  gtk_render_layout (context, cr, x, y, layout);
+}
+
+static gboolean
+taku_icon_tile_draw (GtkWidget *widget, cairo_t *cr)
+{
+  TakuIconTile *tile = TAKU_ICON_TILE (widget);
+  TakuIconTilePrivate *priv = tile->priv;
+  GtkStyleContext *context;
+  int width, height, icon_width, icon_height, text_width, text_height;
+  int text_x, text_y, text_space;
+  PangoAlignment alignment;
+  gboolean rtl;
+
+  width = gtk_widget_get_allocated_width (widget);
+  height = gtk_widget_get_allocated_height (widget);
+  context = gtk_widget_get_style_context (widget);
+  rtl = gtk_widget_get_direction (widget) == GTK_TEXT_DIR_RTL;
+
+  get_icon_size (tile, &icon_width, &icon_height);
+  get_text_size (tile, &text_width, &text_height);
+
+  cairo_save (cr);
+
+  if (priv->orientation == GTK_ORIENTATION_VERTICAL) {
+    /* Icon at the top, with the text centred in the space below it */
+    draw_icon (tile, cr, (width - icon_width) / 2, 0);
+
+    alignment = PANGO_ALIGN_CENTER;
+    text_x = 0;
+    text_y = icon_height + SPACING
+      + (height - icon_height - SPACING - text_height) / 2;
+    text_space = width;
+  } else {
+    /* Icon at the start, with the text centred in the space beside it */
+    text_space = width - icon_width - SPACING;
+    text_y = (height - text_height) / 2;
+
+    if (rtl) {
+      draw_icon (tile, cr, width - icon_width, (height - icon_height) / 2);
+      alignment = PANGO_ALIGN_RIGHT;
+      text_x = 0;
+    } else {
+      draw_icon (tile, cr, 0, (height - icon_height) / 2);
+      alignment = PANGO_ALIGN_LEFT;
+      text_x = icon_width + SPACING;
+    }
+  }
+
+  pango_layout_set_alignment (priv->primary_layout, alignment);
+  draw_text (tile, cr, context, priv->primary_layout,
+             text_x, text_y, text_space);
+
+  if (priv->show_secondary) {
+    pango_layout_set_alignment (priv->secondary_layout, alignment);
+    draw_text (tile, cr, context, priv->secondary_layout,
+               text_x, text_y + priv->primary_height + SPACING, text_space);
+  }
+
+  cairo_restore (cr);
+
+  return FALSE;
+}
+
 static void
 taku_icon_tile_get_property (GObject *object, guint property_id,
                               GValue *value, GParamSpec *pspec)
 {
   switch (property_id) {
   case PROP_PIXBUF:
-    {
-      TakuIconTilePrivate *priv = GET_PRIVATE (object);
-      g_value_set_object (value, gtk_image_get_pixbuf (GTK_IMAGE (priv->icon)));
-    }
+    g_value_set_object (value, GET_PRIVATE (object)->pixbuf);
     break;
   case PROP_PRIMARY:
     g_value_set_string (value, taku_icon_tile_get_primary (TAKU_ICON_TILE (object)));
@@ -144,7 +328,11 @@ taku_icon_tile_set_property (GObject *object, guint property_id,
 static void
 taku_icon_tile_finalize (GObject *object)
 {
-  g_free (TAKU_ICON_TILE (object)->priv->collation_key);
+  TakuIconTilePrivate *priv = TAKU_ICON_TILE (object)->priv;
+
+  g_free (priv->primary);
+  g_free (priv->secondary);
+  g_free (priv->collation_key);
   
   G_OBJECT_CLASS (taku_icon_tile_parent_class)->finalize (object);
 }
@@ -152,15 +340,61 @@ taku_icon_tile_finalize (GObject *object)
 static void
 taku_icon_tile_style_set (GtkWidget *widget, GtkStyle *previous)
 {
+  TakuIconTile *tile = TAKU_ICON_TILE (widget);
+  TakuIconTilePrivate *priv = tile->priv;
+
   GTK_WIDGET_CLASS (taku_icon_tile_parent_class)->style_set (widget, previous);
 
-  tile_arrange (TAKU_ICON_TILE (widget));
+  gtk_widget_style_get (widget,
+                        "show-secondary-text", &priv->show_secondary,
+                        "orientation", &priv->orientation,
+                        "taku-icon-size", &priv->icon_size,
+                        NULL);
+
+  /* The font may have changed */
+  if (priv->primary_layout)
+    pango_layout_context_changed (priv->primary_layout);
+  if (priv->secondary_layout)
+    pango_layout_context_changed (priv->secondary_layout);
+
+  invalidate_text_size (tile);
+}
+
+static void
+taku_icon_tile_direction_changed (GtkWidget *widget, GtkTextDirection previous)
+{
+  TakuIconTilePrivate *priv = TAKU_ICON_TILE (widget)->priv;
+
+  GTK_WIDGET_CLASS (taku_icon_tile_parent_class)->direction_changed (widget, previous);
+
+  /* The layouts take their base direction from the widget */
+  if (priv->primary_layout)
+    pango_layout_context_changed (priv->primary_layout);
+  if (priv->secondary_layout)
+    pango_layout_context_changed (priv->secondary_layout);
+
+  gtk_widget_queue_draw (widget);
 }
 
 static const char *
 taku_icon_tile_get_sort_key (TakuTile *tile)
 {
-  return TAKU_ICON_TILE (tile)->priv->collation_key;
+  TakuIconTilePrivate *priv = TAKU_ICON_TILE (tile)->priv;
+
+  /* Only make the key when sorting, it may well be set from a cache first */
+  if (!priv->collation_key_valid) {
+    const char *text = priv->primary;
+
+    if (text && text[0] != '\0') {
+      gchar *text_casefold = g_utf8_casefold (text, -1);
+      priv->collation_key = g_utf8_collate_key (text_casefold, -1);
+      g_free (text_casefold);
+    }
+
+    priv->collation_key_valid = TRUE;
+  }
+
+  return priv->collation_key;
 }
 
 static const char *
@@ -174,19 +408,29 @@ taku_icon_tile_dispose (GObject *object)
 {
   TakuIconTilePrivate *priv = GET_PRIVATE (object);
 
-  if (priv->icon) {
-    g_object_unref (priv->icon);
-    priv->icon = NULL;
+  if (priv->icon_request) {
+    taku_icon_loader_cancel (priv->icon_request);
+    priv->icon_request = NULL;
   }
 
-  if (priv->primary) {
-    g_object_unref (priv->primary);
-    priv->primary = NULL;
+  if (priv->atlas_slot) {
+    taku_icon_atlas_release (priv->atlas_slot);
+    priv->atlas_slot = NULL;
   }
 
-  if (priv->secondary) {
-    g_object_unref (priv->secondary);
-    priv->secondary = NULL;
+  if (priv->pixbuf) {
+    g_object_unref (priv->pixbuf);
+    priv->pixbuf = NULL;
+  }
+
+  if (priv->primary_layout) {
+    g_object_unref (priv->primary_layout);
+    priv->primary_layout = NULL;
+  }
+
+  if (priv->secondary_layout) {
+    g_object_unref (priv->secondary_layout);
+    priv->secondary_layout = NULL;
   }
 
   G_OBJECT_CLASS (taku_icon_tile_parent_class)->dispose (object);
@@ -207,6 +451,10 @@ taku_icon_tile_class_init (TakuIconTileClass *klass)
   object_class->finalize = taku_icon_tile_finalize;
 
   widget_class->style_set = taku_icon_tile_style_set;
+  widget_class->direction_changed = taku_icon_tile_direction_changed;
+  widget_class->get_preferred_width = taku_icon_tile_get_preferred_width;
+  widget_class->get_preferred_height = taku_icon_tile_get_preferred_height;
+  widget_class->draw = taku_icon_tile_draw;
 
   tile_class->get_sort_key = taku_icon_tile_get_sort_key;
   tile_class->get_search_key = taku_icon_tile_get_search_key;
@@ -254,51 +502,14 @@ taku_icon_tile_class_init (TakuIconTileClass *klass)
 
 }
 
-static void
-make_bold (GtkLabel *label)
-{
-  static PangoAttrList *list = NULL;
-
-  if (list == NULL) {
-    PangoAttribute *attr;
-
-    list = pango_attr_list_new ();
-    
-    attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
-    attr->start_index = 0;
-    attr->end_index = G_MAXUINT;
-    pango_attr_list_insert (list, attr);
-    
-    attr = pango_attr_scale_new (1.2);
-    attr->start_index = 0;
-    attr->end_index = G_MAXUINT;
-    pango_attr_list_insert (list, attr);
-  } 
-
-  gtk_label_set_attributes (label, list);
-}
-
 static void
 taku_icon_tile_init (TakuIconTile *self)
 {
   self->priv = GET_PRIVATE (self);
 
-  self->priv->icon = gtk_image_new ();
-  gtk_widget_show (self->priv->icon);
-  g_object_ref (self->priv->icon);
-
-  self->priv->primary = gtk_label_new (NULL);
-  gtk_label_set_ellipsize (GTK_LABEL (self->priv->primary), PANGO_ELLIPSIZE_END);
-  make_bold (GTK_LABEL (self->priv->primary));
-  gtk_widget_show (self->priv->primary);
-  g_object_ref (self->priv->primary);
-
-  self->priv->secondary = gtk_label_new (NULL);
-  gtk_label_set_ellipsize (GTK_LABEL (self->priv->secondary), PANGO_ELLIPSIZE_END);
-  gtk_widget_show (self->priv->secondary);
-  g_object_ref (self->priv->secondary);
-
-  self->priv->orientation = -1;
+  self->priv->orientation = GTK_ORIENTATION_HORIZONTAL;
+  self->priv->show_secondary = TRUE;
+  self->priv->icon_size = 64;
 }
 
 GtkWidget *
@@ -310,62 +521,141 @@ taku_icon_tile_new (void)
 void
 taku_icon_tile_set_pixbuf (TakuIconTile *tile, GdkPixbuf *pixbuf)
 {
+  TakuIconTilePrivate *priv;
+
   g_return_if_fail (TAKU_IS_ICON_TILE (tile));
 
-  gtk_image_set_from_pixbuf (GTK_IMAGE (tile->priv->icon), pixbuf);
+  priv = tile->priv;
+
+  /* An icon still loading by name would replace this one */
+  if (priv->icon_request) {
+    taku_icon_loader_cancel (priv->icon_request);
+    priv->icon_request = NULL;
+  }
+
+  if (pixbuf == priv->pixbuf)
+    return;
+
+  if (priv->atlas_slot) {
+    taku_icon_atlas_release (priv->atlas_slot);
+    priv->atlas_slot = NULL;
+  }
+
+  if (priv->pixbuf)
+    g_object_unref (priv->pixbuf);
+  priv->pixbuf = pixbuf ? g_object_ref (pixbuf) : NULL;
+
+  if (pixbuf && taku_icon_atlas_get_enabled ())
+    priv->atlas_slot = taku_icon_atlas_acquire (pixbuf, priv->icon_size);
+
+  gtk_widget_queue_resize (GTK_WIDGET (tile));
 
   g_object_notify (G_OBJECT (tile), "pixbuf");
 }
 
+static void
+icon_loaded (GdkPixbuf *pixbuf, gpointer data)
+{
+  TakuIconTile *tile = data;
+
+  tile->priv->icon_request = NULL;
+  taku_icon_tile_set_pixbuf (tile, pixbuf);
+}
+
+/*
+ * Show the icon @name.  Icons which aren't cached are loaded in the background,
+ * and the tile has no icon until then.
+ */
 void
 taku_icon_tile_set_icon_name (TakuIconTile *tile, const char *name)
 {
-  uint size;
+  TakuIconTilePrivate *priv;
+  TakuIconRequest *request;
+
   g_return_if_fail (TAKU_IS_ICON_TILE (tile));
 
-  gtk_widget_style_get (GTK_WIDGET (tile),
-                        "taku-icon-size", &size,
-                        NULL);
+  priv = tile->priv;
+
+  if (priv->icon_request) {
+    taku_icon_loader_cancel (priv->icon_request);
+    priv->icon_request = NULL;
+  }
 
-  gtk_image_set_from_icon_name (GTK_IMAGE (tile->priv->icon),
-                                name, size);
+  /* Cached icons are set before this returns */
+  request = taku_icon_loader_request (name, priv->icon_size,
+                                     TAKU_ICON_PRIORITY_VISIBLE,
+                                     icon_loaded, tile);
+  if (request) {
+    taku_icon_tile_set_pixbuf (tile, NULL);
+    priv->icon_request = request;
+  }
 }
 
 void
 taku_icon_tile_set_primary (TakuIconTile *tile, const char *text)
 {
+  TakuIconTilePrivate *priv;
+
   g_return_if_fail (TAKU_IS_ICON_TILE (tile));
 
-  gtk_label_set_text (GTK_LABEL (tile->priv->primary), text);
+  priv = tile->priv;
 
-  if (tile->priv->collation_key)
-    g_free (tile->priv->collation_key);
-  
-  if (text) {
-    gchar *text_casefold = g_utf8_casefold (text, -1);
-    tile->priv->collation_key = g_utf8_collate_key (text_casefold, -1);
-    g_free (text_casefold);
-  } else {
-    tile->priv->collation_key = NULL;
-  }
+  g_free (priv->primary);
+  priv->primary = g_strdup (text);
+  if (priv->primary_layout)
+    pango_layout_set_text (priv->primary_layout, text ?: "", -1);
+
+  g_free (priv->collation_key);
+  priv->collation_key = NULL;
+  priv->collation_key_valid = FALSE;
 
   atk_object_set_name (gtk_widget_get_accessible (GTK_WIDGET (tile)), text ?: "");
 
+  invalidate_text_size (tile);
+
   g_object_notify (G_OBJECT (tile), "primary");
 }
 
+/*
+ * Set the key used to sort this tile, which must be equivalent to the collation
+ * key of the casefolded primary text.  Saves making it again if the caller has
+ * one to hand.
+ */
+void
+taku_icon_tile_set_collation_key (TakuIconTile *tile, const char *key)
+{
+  g_return_if_fail (TAKU_IS_ICON_TILE (tile));
+
+  g_free (tile->priv->collation_key);
+  tile->priv->collation_key = g_strdup (key);
+  tile->priv->collation_key_valid = key != NULL;
+}
+
 const char *
 taku_icon_tile_get_primary (TakuIconTile *tile)
 {
-  return gtk_label_get_text (GTK_LABEL (tile->priv->primary));
+  return tile->priv->primary ?: "";
 }
 
 void
 taku_icon_tile_set_secondary (TakuIconTile *tile, const char *text)
 {
+  TakuIconTilePrivate *priv;
+
   g_return_if_fail (TAKU_IS_ICON_TILE (tile));
 
-  gtk_label_set_text (GTK_LABEL (tile->priv->secondary), text);
+  priv = tile->priv;
+
+  g_free (priv->secondary);
+  priv->secondary = g_strdup (text);
+  if (priv->secondary_layout)
+    pango_layout_set_text (priv->secondary_layout, text ?: "", -1);
+
+  /* The labels used to be read out, so the description is the secondary text */
+  atk_object_set_description (gtk_widget_get_accessible (GTK_WIDGET (tile)),
+                              text ?: "");
+
+  invalidate_text_size (tile);
 
   g_object_notify (G_OBJECT (tile), "secondary");
 }
@@ -373,5 +663,5 @@ taku_icon_tile_set_secondary (TakuIconTile *tile, const char *text)
 const char *
 taku_icon_tile_get_secondary (TakuIconTile *tile)
 {
-  return gtk_label_get_text (GTK_LABEL (tile->priv->secondary));
+  return tile->priv->secondary ?: "";
 }
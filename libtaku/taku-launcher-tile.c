@@ -19,13 +19,9 @@
 #include <gtk/gtk.h>
 #include <string.h>
 #include "taku-launcher-tile.h"
-#include "taku-queue-source.h"
+#include "taku-icon-loader.h"
 #include "launcher-util.h"
 
-#ifndef G_QUEUE_INIT
-#  define G_QUEUE_INIT { NULL, NULL, 0 }
-#endif
-
 G_DEFINE_TYPE (TakuLauncherTile, taku_launcher_tile, TAKU_TYPE_ICON_TILE);
 
 #define GET_PRIVATE(o) \
@@ -34,46 +30,54 @@ G_DEFINE_TYPE (TakuLauncherTile, taku_launcher_tile, TAKU_TYPE_ICON_TILE);
 struct _TakuLauncherTilePrivate
 {
   GList *groups;
+  /* The groups again, as a bitset of category indexes */
+  guint64 group_bits;
   TakuMenuItem *item;
-  gboolean loading_icon; /* If the icon is queued to be loaded */
+  /* The icon being loaded, if any, and how soon it is wanted */
+  TakuIconRequest *icon_request;
+  TakuIconPriority icon_priority;
+  /* The size and icon theme the icon was last requested for */
+  guint icon_size;
+  guint icon_theme_serial;
 };
 
-/* Queue of tiles with pending icons to load */
-static GQueue queue = G_QUEUE_INIT;
+/* Called in the main loop once the icon has been loaded */
+static void
+icon_loaded (GdkPixbuf *pixbuf, gpointer data)
+{
+  TakuLauncherTile *tile = data;
 
-/* The idle function which loads icons */
-static gboolean
-load_icon (gpointer data)
-{
-  TakuLauncherTile *tile;
-  GdkPixbuf *pixbuf;
-  int i;
-  guint size;
-  
-  /* Per iteration, load a few icons at once */
-  for (i = 0; i < 5; i++) {
-    
-    tile = g_queue_pop_head (&queue);
-    if (tile == NULL) {
-      return TRUE;
-    }
+  tile->priv->icon_request = NULL;
+  taku_icon_tile_set_pixbuf (TAKU_ICON_TILE (tile), pixbuf);
+}
 
-    gtk_widget_style_get (GTK_WIDGET (tile),
-                          "taku-icon-size", &size,
-                          NULL);
-    pixbuf = taku_menu_item_get_icon (tile->priv->item, size);
-    
-    if (pixbuf) {
-      taku_icon_tile_set_pixbuf (TAKU_ICON_TILE (tile), pixbuf);
-      g_object_unref (pixbuf);
-    } else {
-      taku_icon_tile_set_pixbuf (TAKU_ICON_TILE (tile), NULL);
-    }
-    
-    tile->priv->loading_icon = FALSE;
-  }
+/* Show the placeholder, which is shared by every tile until its icon loads */
+static void
+set_placeholder (TakuLauncherTile *tile, guint size)
+{
+  GdkPixbuf *placeholder;
+
+  placeholder = get_icon ("view-refresh", size);
+  taku_icon_tile_set_pixbuf (TAKU_ICON_TILE (tile), placeholder);
+  if (placeholder)
+    g_object_unref (placeholder);
+}
 
-  return TRUE;
+static void
+request_icon (TakuLauncherTile *tile)
+{
+  TakuLauncherTilePrivate *priv = tile->priv;
+
+  if (priv->icon_request)
+    taku_icon_loader_cancel (priv->icon_request);
+
+  /* Cached icons are set before this returns */
+  priv->icon_request =
+    taku_icon_loader_request (taku_menu_item_get_icon_name (priv->item),
+                              priv->icon_size, priv->icon_priority,
+                              icon_loaded, tile);
+  if (priv->icon_request)
+    set_placeholder (tile, priv->icon_size);
 }
 
 static void
@@ -82,13 +86,25 @@ taku_launcher_tile_style_set (GtkWidget *widget,
 {
   TakuLauncherTile *tile = (TakuLauncherTile*)widget;
 
+  TakuLauncherTilePrivate *priv = tile->priv;
+  guint size, serial;
+
   GTK_WIDGET_CLASS (taku_launcher_tile_parent_class)->style_set (widget, previous_style);
 
-  /* Don't reload the icon if it is already in the queue */
-  if (!tile->priv->loading_icon) {
-    g_queue_push_tail (&queue, tile);
-    tile->priv->loading_icon = TRUE;
-  }
+  if (priv->item == NULL)
+    return;
+
+  /* Most style changes don't touch the icon, so only reload it if the size
+     or the icon theme are different from last time */
+  gtk_widget_style_get (widget, "taku-icon-size", &size, NULL);
+  serial = taku_icon_loader_get_theme_serial ();
+  if (size == priv->icon_size && serial == priv->icon_theme_serial)
+    return;
+
+  priv->icon_size = size;
+  priv->icon_theme_serial = serial;
+
+  request_icon (tile);
 }
 
 /* TODO: properties for the launcher and strings */
@@ -96,11 +112,14 @@ taku_launcher_tile_style_set (GtkWidget *widget,
 static void
 taku_launcher_tile_finalize (GObject *object)
 {
-  /* TODO
-  if (tile->priv->data) {
-    launcher_destroy (tile->priv->data);
-  }
-  */
+  TakuLauncherTile *tile = TAKU_LAUNCHER_TILE (object);
+
+  if (tile->priv->icon_request)
+    taku_icon_loader_cancel (tile->priv->icon_request);
+  if (tile->priv->item)
+    taku_menu_item_unref (tile->priv->item);
+  g_list_free_full (tile->priv->groups,
+                    (GDestroyNotify) taku_launcher_category_unref);
 
   G_OBJECT_CLASS (taku_launcher_tile_parent_class)->finalize (object);
 }
@@ -128,10 +147,30 @@ taku_launcher_tile_activate (TakuLauncherTile *tile)
   taku_menu_item_launch (launcher->priv->item, GTK_WIDGET (tile));
 }
 
+/*
+ * Set how soon the icon of @tile is wanted, depending on where the tile is
+ * relative to what the user is looking at.
+ */
+void
+taku_launcher_tile_set_icon_priority (TakuLauncherTile *tile,
+                                      TakuIconPriority  priority)
+{
+  g_return_if_fail (TAKU_IS_LAUNCHER_TILE (tile));
+
+  tile->priv->icon_priority = priority;
+
+  if (tile->priv->icon_request)
+    taku_icon_loader_set_priority (tile->priv->icon_request, priority);
+}
+
 static gboolean
 taku_launcher_tile_matches_filter (TakuTile *tile, gpointer filter)
 {
-  return g_list_find (TAKU_LAUNCHER_TILE (tile)->priv->groups, filter) != NULL;
+  if (filter == NULL)
+    return FALSE;
+
+  return (TAKU_LAUNCHER_TILE (tile)->priv->group_bits
+          & TAKU_CATEGORY_BIT ((TakuLauncherCategory *) filter)) != 0;
 }
 
 static void
@@ -148,14 +187,13 @@ taku_launcher_tile_class_init (TakuLauncherTileClass *klass)
   widget_class->style_set = taku_launcher_tile_style_set;
 
   object_class->finalize = taku_launcher_tile_finalize;
-
-  taku_idle_queue_add (&queue, load_icon, NULL);
 }
 
 static void
 taku_launcher_tile_init (TakuLauncherTile *self)
 {
   self->priv = GET_PRIVATE (self);
+  self->priv->icon_priority = TAKU_ICON_PRIORITY_LATER;
 }
 
 GtkWidget *
@@ -168,34 +206,62 @@ taku_launcher_tile_new ()
 GtkWidget* 
 taku_launcher_tile_new_from_item (TakuMenuItem *item)
 {
-  TakuLauncherTile *tile;
+  GtkWidget *tile;
+
+  tile = taku_launcher_tile_new ();
+  taku_launcher_tile_set_item (TAKU_LAUNCHER_TILE (tile), item);
+
+  return tile;
+}
+
+/*
+ * Show @item in @tile, replacing whatever it showed before.  Tiles are reused
+ * like this as the launcher grid scrolls.
+ */
+void
+taku_launcher_tile_set_item (TakuLauncherTile *tile, TakuMenuItem *item)
+{
+  TakuLauncherTilePrivate *priv;
   GList *l;
   uint size;
 
-  tile = TAKU_LAUNCHER_TILE (taku_launcher_tile_new ());
-  tile->priv->item = item;
+  g_return_if_fail (TAKU_IS_LAUNCHER_TILE (tile));
+  g_return_if_fail (item);
+
+  priv = tile->priv;
+
+  if (item == priv->item)
+    return;
+
+  if (priv->item)
+    taku_menu_item_unref (priv->item);
+  priv->item = taku_menu_item_ref (item);
 
- 
-  gtk_widget_style_get (GTK_WIDGET (tile),
-                        "taku-icon-size", &size,
-                        NULL);
- 
   taku_icon_tile_set_primary (TAKU_ICON_TILE (tile), 
                               taku_menu_item_get_name (item));
+  taku_icon_tile_set_collation_key (TAKU_ICON_TILE (tile),
+                                    taku_menu_item_get_collation_key (item));
   taku_icon_tile_set_secondary (TAKU_ICON_TILE (tile),
                                 taku_menu_item_get_description (item));
-  taku_icon_tile_set_pixbuf (TAKU_ICON_TILE (tile),
-                             get_icon ("view-refresh", size));
-
-  /* Don't need to update the icon here, because we'll get a style-set signal
-     when the widget is realised which will update the icon. */
 
+  g_list_free_full (priv->groups,
+                    (GDestroyNotify) taku_launcher_category_unref);
+  priv->groups = NULL;
+  priv->group_bits = 0;
   for (l = taku_menu_item_get_categories (item); l; l = l->next) {
     taku_launcher_tile_add_group (tile, l->data);
   }
 
-
-  return GTK_WIDGET (tile);
+  if (priv->icon_size) {
+    request_icon (tile);
+  } else {
+    /* Not styled yet, the icon is requested by the style-set when the
+       widget is realised */
+    gtk_widget_style_get (GTK_WIDGET (tile),
+                          "taku-icon-size", &size,
+                          NULL);
+    set_placeholder (tile, size);
+  }
 }
 
 TakuMenuItem* 
@@ -211,15 +277,25 @@ taku_launcher_tile_add_group (TakuLauncherTile *tile, TakuLauncherCategory *cate
 {
   g_return_if_fail (TAKU_IS_LAUNCHER_TILE (tile));
 
-  tile->priv->groups = g_list_prepend (tile->priv->groups, category);
+  tile->priv->groups = g_list_prepend (tile->priv->groups,
+                                       taku_launcher_category_ref (category));
+  tile->priv->group_bits |= TAKU_CATEGORY_BIT (category);
 }
 
 void
 taku_launcher_tile_remove_group (TakuLauncherTile *tile, TakuLauncherCategory *category)
 {
+  GList *l;
+
   g_return_if_fail (TAKU_IS_LAUNCHER_TILE (tile));
 
-  tile->priv->groups = g_list_remove (tile->priv->groups, category);
+  l = g_list_find (tile->priv->groups, category);
+  if (l == NULL)
+    return;
+
+  tile->priv->groups = g_list_delete_link (tile->priv->groups, l);
+  tile->priv->group_bits &= ~TAKU_CATEGORY_BIT (category);
+  taku_launcher_category_unref (category);
 }
 
 GList *
@@ -233,14 +309,32 @@ taku_launcher_tile_get_groups (TakuLauncherTile *tile)
 TakuLauncherCategory *
 taku_launcher_category_new (void)
 {
-  return g_slice_new0 (TakuLauncherCategory);
+  TakuLauncherCategory *category;
+
+  category = g_slice_new0 (TakuLauncherCategory);
+  category->ref_count = 1;
+
+  return category;
+}
+
+TakuLauncherCategory *
+taku_launcher_category_ref (TakuLauncherCategory *category)
+{
+  g_return_val_if_fail (category, NULL);
+
+  g_atomic_int_inc (&category->ref_count);
+
+  return category;
 }
 
 void
-taku_launcher_category_free (TakuLauncherCategory *category)
+taku_launcher_category_unref (TakuLauncherCategory *category)
 {
   g_return_if_fail (category);
 
+  if (!g_atomic_int_dec_and_test (&category->ref_count))
+    return;
+
   g_strfreev (category->matches);
   g_free (category->name);
 
@@ -20,17 +20,30 @@
 #define _TAKU_LAUNCHER_TILE
 
 #include "taku-icon-tile.h"
+#include "taku-icon-loader.h"
 #include "taku-menu.h"
 
 G_BEGIN_DECLS
 
+/*
+ * Items and tiles keep a reference to each category they are in, so a category
+ * outlives the TakuMenu that made it for as long as anything shows it.
+ */
 typedef struct {
+  volatile gint ref_count;
   char *name;
   char **matches;
+  /* Position in the menu, which is the bit for this category in bitsets */
+  guint index;
 } TakuLauncherCategory;
 
+/* Category membership is a bitset, so there can only be this many */
+#define TAKU_MAX_CATEGORIES 64
+#define TAKU_CATEGORY_BIT(category) (G_GUINT64_CONSTANT (1) << (category)->index)
+
 TakuLauncherCategory * taku_launcher_category_new (void);
-void taku_launcher_category_free (TakuLauncherCategory *launcher);
+TakuLauncherCategory * taku_launcher_category_ref (TakuLauncherCategory *category);
+void taku_launcher_category_unref (TakuLauncherCategory *category);
 
 
 #define TAKU_TYPE_LAUNCHER_TILE taku_launcher_tile_get_type()
@@ -71,9 +84,13 @@ GType taku_launcher_tile_get_type (void);
 GtkWidget* taku_launcher_tile_new (void);
 GtkWidget* taku_launcher_tile_new_from_item (TakuMenuItem *item);
 TakuMenuItem* taku_launcher_tile_get_item (TakuLauncherTile *tile);
+void taku_launcher_tile_set_item (TakuLauncherTile *tile, TakuMenuItem *item);
 
 void taku_launcher_tile_activate (TakuLauncherTile *tile);
 
+void taku_launcher_tile_set_icon_priority (TakuLauncherTile *tile,
+                                           TakuIconPriority  priority);
+
 void taku_launcher_tile_add_group (TakuLauncherTile *tile, TakuLauncherCategory *category);
 
 void taku_launcher_tile_remove_group (TakuLauncherTile *tile, TakuLauncherCategory *category);
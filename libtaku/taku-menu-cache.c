@@ -0,0 +1,776 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "taku-menu-cache.h"
+#include "taku-string-arena.h"
+#include "taku-launcher-tile.h"
+#include "launcher-util.h"
+
+#define CACHE_MAGIC "TAKUMNU"
+#define CACHE_VERSION 4
+#define CACHE_BYTE_ORDER 0x01020304
+
+#define ENTRY_USE_SN          (1 << 0)
+#define ENTRY_SINGLE_INSTANCE (1 << 1)
+#define ENTRY_HIDDEN          (1 << 2)
+#define ENTRY_SHADOWED        (1 << 3)
+
+/*
+ * The cache is used straight from the mapping, so every section starts on an
+ * 8 byte boundary:
+ *
+ *   CacheHeader | CacheDir[] | CacheEntry[] | guint16 groups[] | strings
+ *
+ * Directories and entries are sorted by path so that a lookup is a binary
+ * search.  String
+ * offsets are relative to the string table, and 0 is NULL.  Groups are indices
+ * into the vfolder category list, which is only trusted if the stamp of the
+ * categories hasn't changed.
+ */
+typedef struct {
+  char magic[8];
+  guint32 version;
+  guint32 byte_order;
+  guint32 locale;
+  guint32 categories_stamp;
+  guint32 n_dirs;
+  guint32 dirs_offset;
+  guint32 n_entries;
+  guint32 entries_offset;
+  guint32 groups_offset;
+  guint32 strings_offset;
+  guint32 strings_size;
+  guint32 padding;
+} CacheHeader;
+
+typedef struct {
+  guint32 path;
+  guint32 padding;
+  gint64 mtime;
+} CacheDir;
+
+typedef struct {
+  guint32 path;
+  guint32 name;
+  guint32 description;
+  guint32 icon_name;
+  guint32 exec;
+  guint32 cats;
+  guint32 collation_key;
+  guint32 flags;
+  gint64 mtime;
+  gint64 size;
+  guint32 groups;
+  guint32 n_groups;
+} CacheEntry;
+
+struct _TakuMenuCache
+{
+  GMappedFile *file;
+  const CacheHeader *header;
+  const CacheDir *dirs;
+  const CacheEntry *entries;
+  const guint16 *groups;
+  guint32 n_groups;
+  const char *strings;
+
+  /* The categories in vfolder order, or NULL if the stored groups are stale */
+  GPtrArray *categories;
+};
+
+static char *
+get_cache_filename (void)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "matchbox-desktop", "menu.cache", NULL);
+}
+
+/*
+ * Names and collation keys are only valid for the locale they were made in, and
+ * which entries are hidden depends on the desktop we are running in.
+ */
+static char *
+get_locale_key (void)
+{
+  char *languages, *key;
+
+  languages = g_strjoinv (":", (char **) g_get_language_names ());
+  key = g_strconcat (languages, ";", g_getenv ("XDG_CURRENT_DESKTOP"), NULL);
+  g_free (languages);
+
+  return key;
+}
+
+static guint32
+get_categories_stamp (GList *categories)
+{
+  guint32 stamp = 5381;
+  GList *l;
+  char **m;
+
+  for (l = categories; l; l = l->next) {
+    TakuLauncherCategory *category = l->data;
+
+    stamp = stamp * 33 + g_str_hash (category->name);
+    for (m = category->matches; *m; m++)
+      stamp = stamp * 33 + g_str_hash (*m);
+  }
+
+  return stamp;
+}
+
+static gboolean
+section_valid (gsize length, guint32 offset, guint32 n, gsize size)
+{
+  return offset % 8 == 0 && offset <= length && n <= (length - offset) / size;
+}
+
+static const char *
+cache_string (TakuMenuCache *cache, guint32 offset)
+{
+  if (offset == 0 || offset >= cache->header->strings_size)
+    return NULL;
+
+  return cache->strings + offset;
+}
+
+/*
+ * Returns the modification time of @st in nanoseconds.  Whole seconds are too
+ * coarse, as a file can be saved twice in one second and keep its stamp.
+ */
+gint64
+taku_menu_cache_get_mtime (const struct stat *st)
+{
+  gint64 mtime;
+
+  mtime = (gint64) st->st_mtime * G_GINT64_CONSTANT (1000000000);
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  mtime += st->st_mtim.tv_nsec;
+#endif
+
+  return mtime;
+}
+
+TakuMenuCacheStamp *
+taku_menu_cache_stamp_new (const char *path, gint64 mtime, gint64 size)
+{
+  TakuMenuCacheStamp *stamp;
+
+  stamp = g_slice_new (TakuMenuCacheStamp);
+  stamp->path = g_strdup (path);
+  stamp->mtime = mtime;
+  stamp->size = size;
+
+  return stamp;
+}
+
+void
+taku_menu_cache_stamp_free (TakuMenuCacheStamp *stamp)
+{
+  g_return_if_fail (stamp);
+
+  g_free (stamp->path);
+  g_slice_free (TakuMenuCacheStamp, stamp);
+}
+
+/*
+ * Map the cache for the current user, returning NULL if there isn't one or it
+ * cannot be used in this locale.  @categories is the current vfolder category
+ * list, used to decide if the stored category assignments are still valid.
+ */
+TakuMenuCache *
+taku_menu_cache_open (GList *categories)
+{
+  TakuMenuCache *cache;
+  GMappedFile *file;
+  const CacheHeader *header;
+  const char *data;
+  gsize length;
+  char *filename, *locale;
+  gboolean valid;
+  GList *l;
+
+  filename = get_cache_filename ();
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+  if (file == NULL)
+    return NULL;
+
+  data = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const CacheHeader *) data;
+
+  /* Check that everything the header refers to lies within the file */
+  if (length < sizeof (CacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->byte_order != CACHE_BYTE_ORDER ||
+      !section_valid (length, header->dirs_offset,
+                      header->n_dirs, sizeof (CacheDir)) ||
+      !section_valid (length, header->entries_offset,
+                      header->n_entries, sizeof (CacheEntry)) ||
+      !section_valid (length, header->groups_offset, 0, sizeof (guint16)) ||
+      header->strings_offset < header->groups_offset ||
+      header->strings_offset > length ||
+      header->strings_size == 0 ||
+      header->strings_size > length - header->strings_offset ||
+      data[header->strings_offset + header->strings_size - 1] != '\0') {
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  cache = g_slice_new0 (TakuMenuCache);
+  cache->file = file;
+  cache->header = header;
+  cache->dirs = (const CacheDir *) (data + header->dirs_offset);
+  cache->entries = (const CacheEntry *) (data + header->entries_offset);
+  cache->groups = (const guint16 *) (data + header->groups_offset);
+  cache->n_groups = (header->strings_offset - header->groups_offset)
+                    / sizeof (guint16);
+  cache->strings = data + header->strings_offset;
+
+  locale = get_locale_key ();
+  valid = g_strcmp0 (locale, cache_string (cache, header->locale)) == 0;
+  g_free (locale);
+  if (!valid) {
+    taku_menu_cache_close (cache);
+    return NULL;
+  }
+
+  if (header->categories_stamp == get_categories_stamp (categories)) {
+    cache->categories = g_ptr_array_new ();
+    for (l = categories; l; l = l->next)
+      g_ptr_array_add (cache->categories, l->data);
+  }
+
+  return cache;
+}
+
+void
+taku_menu_cache_close (TakuMenuCache *cache)
+{
+  g_return_if_fail (cache);
+
+  if (cache->categories)
+    g_ptr_array_free (cache->categories, TRUE);
+  g_mapped_file_unref (cache->file);
+
+  g_slice_free (TakuMenuCache, cache);
+}
+
+guint
+taku_menu_cache_get_n_entries (TakuMenuCache *cache)
+{
+  g_return_val_if_fail (cache, 0);
+
+  return cache->header->n_entries;
+}
+
+/* Returns the index of the first entry whose path isn't before @path */
+static guint
+lower_bound (TakuMenuCache *cache, const char *path)
+{
+  guint lo = 0, hi = cache->header->n_entries;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    const char *s;
+
+    s = cache_string (cache, cache->entries[mid].path);
+    if (strcmp (s ? s : "", path) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* Returns the index of the first directory not before @path */
+static guint
+dir_lower_bound (TakuMenuCache *cache, const char *path)
+{
+  guint lo = 0, hi = cache->header->n_dirs;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    const char *s;
+
+    s = cache_string (cache, cache->dirs[mid].path);
+    if (strcmp (s ? s : "", path) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+static const CacheEntry *
+find_entry (TakuMenuCache *cache, const char *path)
+{
+  guint i;
+  const char *s;
+
+  i = lower_bound (cache, path);
+  if (i == cache->header->n_entries)
+    return NULL;
+
+  s = cache_string (cache, cache->entries[i].path);
+  if (g_strcmp0 (s, path) != 0)
+    return NULL;
+
+  return &cache->entries[i];
+}
+
+/*
+ * Make the item for @entry, which is for @path.  Returns the result of the
+ * lookup, setting *@item on a hit.
+ */
+static TakuMenuCacheResult
+load_entry (TakuMenuCache     *cache,
+            const CacheEntry  *entry,
+            const char        *path,
+            TakuMenuItem     **item)
+{
+  TakuMenuItem *new;
+  const char *exec;
+  guint i;
+
+  *item = NULL;
+
+  if (entry->flags & ENTRY_SHADOWED)
+    return TAKU_MENU_CACHE_SHADOWED;
+
+  if (entry->flags & ENTRY_HIDDEN)
+    return TAKU_MENU_CACHE_HIDDEN;
+
+  exec = cache_string (cache, entry->exec);
+  if (exec == NULL)
+    return TAKU_MENU_CACHE_MISS;
+
+  new = taku_menu_item_new ();
+  taku_string_arena_add_path (path, &new->dir, &new->basename);
+  new->name = taku_string_arena_intern (cache_string (cache, entry->name));
+  new->description = taku_string_arena_intern (cache_string
+                                               (cache, entry->description));
+  new->icon_name = taku_string_arena_intern (cache_string
+                                             (cache, entry->icon_name));
+  new->collation_key = taku_string_arena_intern (cache_string
+                                                 (cache, entry->collation_key));
+  new->use_sn = (entry->flags & ENTRY_USE_SN) != 0;
+  new->single_instance = (entry->flags & ENTRY_SINGLE_INSTANCE) != 0;
+  new->exec = taku_string_arena_intern (exec);
+  new->mtime = entry->mtime;
+  new->size = entry->size;
+  new->cats = taku_string_arena_intern (cache_string (cache, entry->cats));
+
+  if (cache->categories &&
+      entry->groups <= cache->n_groups &&
+      entry->n_groups <= cache->n_groups - entry->groups) {
+    for (i = 0; i < entry->n_groups; i++) {
+      guint16 index = cache->groups[entry->groups + i];
+      TakuLauncherCategory *category;
+
+      if (index >= cache->categories->len)
+        continue;
+
+      category = g_ptr_array_index (cache->categories, index);
+      new->categories = g_list_prepend (new->categories,
+                                        taku_launcher_category_ref (category));
+      new->category_bits |= TAKU_CATEGORY_BIT (category);
+    }
+    new->categories = g_list_reverse (new->categories);
+  }
+
+  *item = new;
+  return TAKU_MENU_CACHE_HIT;
+}
+
+/*
+ * Look up the desktop file @path, which must still have the given @mtime and
+ * @size for the cached copy to be used.  On a hit *@item is set to a new
+ * TakuMenuItem, with its categories filled in if the stored groups are valid.
+ */
+TakuMenuCacheResult
+taku_menu_cache_lookup (TakuMenuCache  *cache,
+                        const char     *path,
+                        gint64          mtime,
+                        gint64          size,
+                        TakuMenuItem  **item)
+{
+  const CacheEntry *entry;
+
+  g_return_val_if_fail (cache, TAKU_MENU_CACHE_MISS);
+  g_return_val_if_fail (path, TAKU_MENU_CACHE_MISS);
+  g_return_val_if_fail (item, TAKU_MENU_CACHE_MISS);
+
+  *item = NULL;
+
+  /* Shadowed files were never read, so there is nothing to use */
+  entry = find_entry (cache, path);
+  if (entry == NULL || (entry->flags & ENTRY_SHADOWED) ||
+      entry->mtime != mtime || entry->size != size)
+    return TAKU_MENU_CACHE_MISS;
+
+  return load_entry (cache, entry, path, item);
+}
+
+/*
+ * Returns TRUE if the directory @path was scanned for the cache and still has
+ * the same @mtime, so has the same entries as then.
+ */
+gboolean
+taku_menu_cache_dir_unchanged (TakuMenuCache *cache,
+                               const char    *path,
+                               gint64         mtime)
+{
+  guint i;
+
+  g_return_val_if_fail (cache, FALSE);
+  g_return_val_if_fail (path, FALSE);
+
+  i = dir_lower_bound (cache, path);
+  if (i == cache->header->n_dirs ||
+      g_strcmp0 (cache_string (cache, cache->dirs[i].path), path) != 0)
+    return FALSE;
+
+  return cache->dirs[i].mtime == mtime;
+}
+
+/* Returns TRUE if @path is directly inside the directory @prefix, which ends
+   in a separator */
+static gboolean
+is_child (const char *path, const char *prefix, gsize prefix_length)
+{
+  return path &&
+    strncmp (path, prefix, prefix_length) == 0 &&
+    path[prefix_length] != '\0' &&
+    strchr (path + prefix_length, G_DIR_SEPARATOR) == NULL;
+}
+
+/*
+ * Call @func for every desktop file stored for the directory @path, but not
+ * its subdirectories, as if it had been looked up with its stored stamp.
+ */
+void
+taku_menu_cache_foreach_file (TakuMenuCache         *cache,
+                              const char            *path,
+                              TakuMenuCacheFileFunc  func,
+                              gpointer               data)
+{
+  char *prefix;
+  gsize prefix_length;
+  guint i;
+
+  g_return_if_fail (cache);
+  g_return_if_fail (path);
+  g_return_if_fail (func);
+
+  prefix = g_strconcat (path, G_DIR_SEPARATOR_S, NULL);
+  prefix_length = strlen (prefix);
+
+  /* Entries are sorted, so the directory is one run from the prefix on */
+  for (i = lower_bound (cache, prefix); i < cache->header->n_entries; i++) {
+    const CacheEntry *entry = &cache->entries[i];
+    const char *file = cache_string (cache, entry->path);
+    TakuMenuCacheResult result;
+    TakuMenuItem *item;
+
+    if (file == NULL || strncmp (file, prefix, prefix_length) != 0)
+      break;
+
+    if (!is_child (file, prefix, prefix_length))
+      continue;
+
+    result = load_entry (cache, entry, file, &item);
+    func (file, entry->mtime, entry->size, result, item, data);
+  }
+
+  g_free (prefix);
+}
+
+/* Call @func for every stored subdirectory directly inside @path */
+void
+taku_menu_cache_foreach_subdir (TakuMenuCache *cache,
+                                const char    *path,
+                                GFunc          func,
+                                gpointer       data)
+{
+  char *prefix;
+  gsize prefix_length;
+  guint i;
+
+  g_return_if_fail (cache);
+  g_return_if_fail (path);
+  g_return_if_fail (func);
+
+  prefix = g_strconcat (path, G_DIR_SEPARATOR_S, NULL);
+  prefix_length = strlen (prefix);
+
+  /* Like the entries, the subdirectories are one run from the prefix on */
+  for (i = dir_lower_bound (cache, prefix); i < cache->header->n_dirs; i++) {
+    const char *dir = cache_string (cache, cache->dirs[i].path);
+
+    if (dir == NULL || strncmp (dir, prefix, prefix_length) != 0)
+      break;
+
+    if (is_child (dir, prefix, prefix_length))
+      func ((gpointer) dir, data);
+  }
+
+  g_free (prefix);
+}
+
+/*
+ * Writing the cache.
+ */
+
+typedef struct {
+  GString *strings;
+  GHashTable *offsets;
+} StringTable;
+
+static guint32
+string_table_add (StringTable *table, const char *s)
+{
+  gpointer offset;
+
+  if (s == NULL)
+    return 0;
+
+  if (g_hash_table_lookup_extended (table->offsets, s, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (table->strings->len);
+  g_string_append_len (table->strings, s, strlen (s) + 1);
+  g_hash_table_insert (table->offsets, g_strdup (s), offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+typedef struct {
+  char *path;
+  TakuMenuItem *item;
+  TakuMenuCacheStamp *hidden;
+} SaveRecord;
+
+static gint
+compare_records (gconstpointer a, gconstpointer b)
+{
+  return strcmp (((const SaveRecord *) a)->path,
+                 ((const SaveRecord *) b)->path);
+}
+
+static gint
+compare_stamps (gconstpointer a, gconstpointer b)
+{
+  const TakuMenuCacheStamp *sa = *(TakuMenuCacheStamp * const *) a;
+  const TakuMenuCacheStamp *sb = *(TakuMenuCacheStamp * const *) b;
+
+  return strcmp (sa->path, sb->path);
+}
+
+static void
+pad_to_8 (GString *s)
+{
+  while (s->len % 8)
+    g_string_append_c (s, '\0');
+}
+
+/*
+ * Write the cache for the given visible @items, the @hidden desktop files and
+ * the scanned @dirs (arrays of TakuMenuCacheStamp, @dirs being sorted in
+ * place).  @shadowed is an array of the paths of desktop files which weren't
+ * read as their IDs are provided by others, so that they are found again when
+ * those go.  The file is replaced atomically so a concurrent reader never sees
+ * a partial cache.
+ */
+gboolean
+taku_menu_cache_save (GList     *items,
+                      GPtrArray *hidden,
+                      GPtrArray *shadowed,
+                      GPtrArray *dirs,
+                      GList     *categories)
+{
+  StringTable table;
+  GArray *records, *entries, *groups;
+  GHashTable *category_index;
+  CacheHeader header;
+  GString *out;
+  GError *error = NULL;
+  char *filename, *dirname, *locale;
+  gboolean ret;
+  GList *l;
+  guint i, n;
+
+  table.strings = g_string_new ("");
+  g_string_append_c (table.strings, '\0');
+  table.offsets = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+
+  category_index = g_hash_table_new (NULL, NULL);
+  for (l = categories, n = 1; l; l = l->next, n++)
+    g_hash_table_insert (category_index, l->data, GUINT_TO_POINTER (n));
+
+  records = g_array_new (FALSE, FALSE, sizeof (SaveRecord));
+  for (l = items; l; l = l->next) {
+    SaveRecord record = { taku_menu_item_dup_path (l->data), l->data, NULL };
+    g_array_append_val (records, record);
+  }
+  for (i = 0; hidden && i < hidden->len; i++) {
+    TakuMenuCacheStamp *stamp = g_ptr_array_index (hidden, i);
+    SaveRecord record = { g_strdup (stamp->path), NULL, stamp };
+    g_array_append_val (records, record);
+  }
+  for (i = 0; shadowed && i < shadowed->len; i++) {
+    SaveRecord record = { g_strdup (g_ptr_array_index (shadowed, i)),
+                          NULL, NULL };
+    g_array_append_val (records, record);
+  }
+  g_array_sort (records, compare_records);
+
+  entries = g_array_sized_new (FALSE, TRUE, sizeof (CacheEntry), records->len);
+  groups = g_array_new (FALSE, FALSE, sizeof (guint16));
+
+  for (i = 0; i < records->len; i++) {
+    SaveRecord *record = &g_array_index (records, SaveRecord, i);
+    TakuMenuItem *item = record->item;
+    CacheEntry entry;
+
+    memset (&entry, 0, sizeof (entry));
+    entry.path = string_table_add (&table, record->path);
+
+    if (item == NULL && record->hidden == NULL) {
+      /* Never stat()ed, so there is no stamp */
+      entry.flags = ENTRY_SHADOWED;
+      g_array_append_val (entries, entry);
+      continue;
+    }
+
+    if (item == NULL) {
+      entry.flags = ENTRY_HIDDEN;
+      entry.mtime = record->hidden->mtime;
+      entry.size = record->hidden->size;
+      g_array_append_val (entries, entry);
+      continue;
+    }
+
+    entry.name = string_table_add (&table, item->name);
+    entry.description = string_table_add (&table, item->description);
+    entry.icon_name = string_table_add (&table, item->icon_name);
+    entry.exec = string_table_add (&table, item->exec);
+    entry.cats = string_table_add (&table, item->cats);
+    entry.collation_key = string_table_add (&table, item->collation_key);
+    entry.flags = (item->use_sn ? ENTRY_USE_SN : 0)
+                  | (item->single_instance ? ENTRY_SINGLE_INSTANCE : 0);
+    entry.mtime = item->mtime;
+    entry.size = item->size;
+    entry.groups = groups->len;
+
+    for (l = item->categories; l; l = l->next) {
+      guint16 index;
+
+      n = GPOINTER_TO_UINT (g_hash_table_lookup (category_index, l->data));
+      if (n == 0)
+        continue;
+
+      index = n - 1;
+      g_array_append_val (groups, index);
+      entry.n_groups++;
+    }
+
+    g_array_append_val (entries, entry);
+  }
+
+  locale = get_locale_key ();
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+  header.version = CACHE_VERSION;
+  header.byte_order = CACHE_BYTE_ORDER;
+  header.locale = string_table_add (&table, locale);
+  header.categories_stamp = get_categories_stamp (categories);
+  header.n_dirs = dirs ? dirs->len : 0;
+  header.n_entries = entries->len;
+
+  out = g_string_sized_new (sizeof (CacheHeader)
+                            + header.n_dirs * sizeof (CacheDir)
+                            + entries->len * sizeof (CacheEntry)
+                            + groups->len * sizeof (guint16)
+                            + table.strings->len + 8);
+  g_string_append_len (out, (char *) &header, sizeof (header));
+
+  header.dirs_offset = out->len;
+  if (dirs)
+    g_ptr_array_sort (dirs, compare_stamps);
+  for (i = 0; i < header.n_dirs; i++) {
+    TakuMenuCacheStamp *stamp = g_ptr_array_index (dirs, i);
+    CacheDir dir;
+
+    memset (&dir, 0, sizeof (dir));
+    dir.path = string_table_add (&table, stamp->path);
+    dir.mtime = stamp->mtime;
+    g_string_append_len (out, (char *) &dir, sizeof (dir));
+  }
+
+  header.entries_offset = out->len;
+  g_string_append_len (out, entries->data, entries->len * sizeof (CacheEntry));
+
+  header.groups_offset = out->len;
+  g_string_append_len (out, groups->data, groups->len * sizeof (guint16));
+  pad_to_8 (out);
+
+  header.strings_offset = out->len;
+  header.strings_size = table.strings->len;
+  g_string_append_len (out, table.strings->str, table.strings->len);
+
+  /* Now that the offsets are known, rewrite the header */
+  memcpy (out->str, &header, sizeof (header));
+
+  filename = get_cache_filename ();
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0755);
+
+  ret = g_file_set_contents (filename, out->str, out->len, &error);
+  if (!ret) {
+    g_warning ("Cannot write menu cache: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (dirname);
+  g_free (filename);
+  g_free (locale);
+  g_string_free (out, TRUE);
+  g_array_free (groups, TRUE);
+  g_array_free (entries, TRUE);
+  for (i = 0; i < records->len; i++)
+    g_free (g_array_index (records, SaveRecord, i).path);
+  g_array_free (records, TRUE);
+  g_hash_table_destroy (category_index);
+  g_hash_table_destroy (table.offsets);
+  g_string_free (table.strings, TRUE);
+
+  return ret;
+}
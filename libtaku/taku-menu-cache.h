@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_MENU_CACHE_H
+#define HAVE_TAKU_MENU_CACHE_H
+
+#include <glib.h>
+#include <sys/stat.h>
+
+#include "taku-menu-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TakuMenuCache TakuMenuCache;
+
+/* The modification stamp of a directory or of a desktop file, with the mtime
+   in nanoseconds */
+typedef struct {
+  gchar *path;
+  gint64 mtime;
+  gint64 size;
+} TakuMenuCacheStamp;
+
+typedef enum {
+  TAKU_MENU_CACHE_MISS,
+  TAKU_MENU_CACHE_HIT,
+  /* The file is unchanged but doesn't produce an item (NoDisplay, broken) */
+  TAKU_MENU_CACHE_HIDDEN,
+  /* Another file provided its desktop file ID, so it was never read */
+  TAKU_MENU_CACHE_SHADOWED
+} TakuMenuCacheResult;
+
+gint64 taku_menu_cache_get_mtime (const struct stat *st);
+
+TakuMenuCacheStamp *taku_menu_cache_stamp_new (const char *path,
+                                               gint64      mtime,
+                                               gint64      size);
+void taku_menu_cache_stamp_free (TakuMenuCacheStamp *stamp);
+
+TakuMenuCache *taku_menu_cache_open (GList *categories);
+void taku_menu_cache_close (TakuMenuCache *cache);
+
+guint taku_menu_cache_get_n_entries (TakuMenuCache *cache);
+
+TakuMenuCacheResult taku_menu_cache_lookup (TakuMenuCache  *cache,
+                                            const char     *path,
+                                            gint64          mtime,
+                                            gint64          size,
+                                            TakuMenuItem  **item);
+
+gboolean taku_menu_cache_dir_unchanged (TakuMenuCache *cache,
+                                        const char    *path,
+                                        gint64         mtime);
+
+typedef void (*TakuMenuCacheFileFunc) (const char          *path,
+                                       gint64               mtime,
+                                       gint64               size,
+                                       TakuMenuCacheResult  result,
+                                       TakuMenuItem        *item,
+                                       gpointer             data);
+
+void taku_menu_cache_foreach_file (TakuMenuCache         *cache,
+                                   const char            *path,
+                                   TakuMenuCacheFileFunc  func,
+                                   gpointer               data);
+void taku_menu_cache_foreach_subdir (TakuMenuCache *cache,
+                                     const char    *path,
+                                     GFunc          func,
+                                     gpointer       data);
+
+gboolean taku_menu_cache_save (GList     *items,
+                               GPtrArray *hidden,
+                               GPtrArray *shadowed,
+                               GPtrArray *dirs,
+                               GList     *categories);
+
+G_END_DECLS
+
+#endif
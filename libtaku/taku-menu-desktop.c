@@ -19,12 +19,24 @@
 #include <config.h>
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <ctype.h>
 
 #include "taku-menu.h"
+#include "taku-menu-private.h"
+#include "taku-menu-cache.h"
+#include "taku-menu-store.h"
+#include "taku-string-arena.h"
+#include "taku-queue-source.h"
+#include "desktop-entry.h"
 #include "taku-launcher-tile.h"
 #include "launcher-util.h"
 
@@ -44,31 +56,61 @@ G_DEFINE_TYPE (TakuMenu, taku_menu, G_TYPE_OBJECT)
 struct _TakuMenuPrivate
 {
   GList *categories;
-  GList *items;
+  TakuMenuStore *store;
 
-  GHashTable *path_items_hash;
+  /* GQuark of a Categories token -> guint64 bitset of the categories it puts
+     an item in */
+  GHashTable *token_index;
+  /* Bitset of the meta-all categories */
+  guint64 all_categories;
 
   TakuLauncherCategory *fallback_category;
+
+  /* The loading pipeline */
+  GThread *scan_thread;
+  TakuQueue *results;
+  /* FileChanges waiting to be handled */
+  TakuQueue *changes;
+  GCancellable *cancellable;
+  gint n_found;
+  guint n_done;
+  gboolean loaded;
+  /* Counted by the loading threads, for taku_menu_get_scan_stats() */
+  TakuMenuScanStats scan_stats;
+  gint n_parsed;
+
+  /* The on-disk cache, only mapped during the initial load */
+  TakuMenuCache *cache;
+  guint cache_hits;
+  gboolean cache_dirty;
+  guint cache_save_id;
+  /* path -> TakuMenuCacheStamp of desktop files which don't produce items */
+  GHashTable *hidden;
+  /* TakuMenuCacheStamps of the scanned directories */
+  GPtrArray *dirs;
+  /* Paths of the directories being watched, which outlive a cancelled sweep */
+  GHashTable *monitored;
+
+  /* Desktop file ID -> GSList of the Providers of it, best first.  Only the
+     first is loaded, the others are shadowed by it */
+  GHashTable *desktop_ids;
 };
 
-struct _TakuMenuItem
-{
-  gchar *path;
-  gchar *name;
-  gchar *description;
-  gchar *icon_name;
-  gchar **cats;
-  GList *categories;
+/* A desktop file providing a desktop file ID */
+typedef struct {
+  char *path;
+  guint rank;
+} Provider;
 
-  gchar **argv;
-  gboolean use_sn;
-  gboolean single_instance;
-};
+/* Delay before writing the cache after an inotify change, in seconds */
+#define CACHE_SAVE_DELAY 10
 
 enum
 {
   ITEM_ADDED,
   ITEM_REMOVED,
+  LOADED,
+  PROGRESS,
 
   LAST_SIGNAL
 };
@@ -80,7 +122,8 @@ static guint _menu_signals[LAST_SIGNAL] = {0};
  */
 
 /*
- * Returns a list of TakuLauncherCategorys
+ * Returns a list of TakuLauncherCategorys, owned by @menu.  Take a reference on
+ * any category that has to outlive the menu.
  */
 GList*
 taku_menu_get_categories (TakuMenu *menu)
@@ -91,20 +134,118 @@ taku_menu_get_categories (TakuMenu *menu)
 }
 
 /*
- * Returns a list of TakuMenuItems
+ * Returns a list of TakuMenuItems.  The list belongs to the menu and is only
+ * valid until an item is next added or removed, so copy it (and ref the items)
+ * to keep it across a return to the main loop.
  */
 GList*
 taku_menu_get_items (TakuMenu *menu)
 {
   g_return_val_if_fail (TAKU_IS_MENU (menu), NULL);
 
-  return menu->priv->items;
+  return taku_menu_store_get_list (menu->priv->store);
+}
+
+/*
+ * Returns TRUE while a sweep is running, including a cancelled one which is
+ * still winding down.  Another can only be started once this is FALSE.
+ */
+gboolean
+taku_menu_is_loading (TakuMenu *menu)
+{
+  g_return_val_if_fail (TAKU_IS_MENU (menu), FALSE);
+
+  return menu->priv->scan_thread != NULL;
+}
+
+/* The number of directory stamps the last sweep recorded */
+guint
+taku_menu_get_n_dirs (TakuMenu *menu)
+{
+  g_return_val_if_fail (TAKU_IS_MENU (menu), 0);
+
+  return menu->priv->dirs->len;
+}
+
+/*
+ * Returns TRUE once the initial sweep of the desktop files has finished
+ */
+gboolean
+taku_menu_is_loaded (TakuMenu *menu)
+{
+  g_return_val_if_fail (TAKU_IS_MENU (menu), FALSE);
+
+  return menu->priv->loaded;
+}
+
+/*
+ * Get the cost of the last sweep of the application directories, which is
+ * only complete once the menu has loaded.
+ */
+void
+taku_menu_get_scan_stats (TakuMenu *menu, TakuMenuScanStats *stats)
+{
+  g_return_if_fail (TAKU_IS_MENU (menu));
+  g_return_if_fail (stats);
+
+  *stats = menu->priv->scan_stats;
+  stats->n_parsed = g_atomic_int_get (&menu->priv->n_parsed);
 }
 
 /*
  * < MenuItem functions />
  */
 
+/* Items are small and come and go in bursts, so they live in slices */
+TakuMenuItem *
+taku_menu_item_new (void)
+{
+  TakuMenuItem *item;
+
+  item = g_slice_new0 (TakuMenuItem);
+  item->ref_count = 1;
+
+  return item;
+}
+
+/*
+ * Items are owned by the menu until they are removed, so anything keeping an
+ * item for longer, such as a tile, should hold a reference.
+ */
+TakuMenuItem *
+taku_menu_item_ref (TakuMenuItem *item)
+{
+  g_return_val_if_fail (item, NULL);
+
+  g_atomic_int_inc (&item->ref_count);
+
+  return item;
+}
+
+void
+taku_menu_item_unref (TakuMenuItem *item)
+{
+  g_return_if_fail (item);
+
+  if (!g_atomic_int_dec_and_test (&item->ref_count))
+    return;
+
+  taku_string_arena_release (item->basename);
+  taku_string_arena_release (item->name);
+  taku_string_arena_release (item->description);
+  taku_string_arena_release (item->icon_name);
+  taku_string_arena_release (item->cats);
+  taku_string_arena_release (item->collation_key);
+  taku_string_arena_release (item->exec);
+  taku_string_arena_release (item->executable);
+
+  g_strfreev (item->argv);
+  g_list_free_full (item->categories,
+                    (GDestroyNotify) taku_launcher_category_unref);
+
+  g_slice_free (TakuMenuItem, item);
+}
+
 const gchar*
 taku_menu_item_get_name (TakuMenuItem *item)
 {
@@ -121,6 +262,14 @@ taku_menu_item_get_description (TakuMenuItem *item)
   return item->description;
 }
 
+const gchar*
+taku_menu_item_get_icon_name (TakuMenuItem *item)
+{
+  g_return_val_if_fail (item, NULL);
+
+  return item->icon_name;
+}
+
 GdkPixbuf*
 taku_menu_item_get_icon (TakuMenuItem *item, int size)
 {
@@ -137,12 +286,44 @@ taku_menu_item_get_categories (TakuMenuItem *item)
   return item->categories;
 }
 
+/*
+ * Returns the categories of @item as a bitset, so that membership can be
+ * tested with TAKU_CATEGORY_BIT() instead of searching the list.
+ */
+guint64
+taku_menu_item_get_category_bits (TakuMenuItem *item)
+{
+  g_return_val_if_fail (item, 0);
+
+  return item->category_bits;
+}
+
+
+const gchar*
+taku_menu_item_get_collation_key (TakuMenuItem *item)
+{
+  g_return_val_if_fail (item, NULL);
+
+  return item->collation_key;
+}
+
+/* Returns the path of the desktop file of @item, which should be freed */
+char *
+taku_menu_item_dup_path (TakuMenuItem *item)
+{
+  g_return_val_if_fail (item, NULL);
+
+  return taku_string_arena_build_path (item->dir, item->basename);
+}
 
 gboolean
 taku_menu_item_launch (TakuMenuItem *item, GtkWidget *widget)
 {
   g_return_val_if_fail (item, FALSE);
 
+  if (item->argv == NULL)
+    item->argv = exec_to_argv (item->exec);
+
   launcher_start (widget,
                   item,
                   item->argv,
@@ -157,7 +338,18 @@ taku_menu_desktop_get_executable (TakuMenuItem *item)
 {
   g_return_val_if_fail (item, NULL);
 
-  return item->argv[0];
+  if (item->argv)
+    return item->argv[0];
+
+  /* Only the first argument is needed, so don't split the whole line */
+  if (item->executable == NULL) {
+    char *executable = exec_get_executable (item->exec);
+
+    item->executable = taku_string_arena_intern (executable);
+    g_free (executable);
+  }
+
+  return item->executable;
 }
 
 /*
@@ -175,6 +367,7 @@ load_vfolder_dir (TakuMenu *menu, const char *vfolderdir)
   FILE *fp;
   char name[NAME_MAX], *filename;
   TakuLauncherCategory *category;
+  guint n_categories = 0;
 
   g_return_if_fail (TAKU_IS_MENU (menu));
   priv = menu->priv;
@@ -226,9 +419,17 @@ load_vfolder_dir (TakuMenu *menu, const char *vfolderdir)
       goto done;
     }
 
+    if (n_categories == TAKU_MAX_CATEGORIES) {
+      g_warning ("Too many categories, ignoring %s", filename);
+      g_strfreev (matches);
+      g_free (local_name);
+      goto done;
+    }
+
     category = taku_launcher_category_new ();
     category->matches = matches;
     category->name  = local_name;
+    category->index = n_categories++;
 
     priv->categories = g_list_append (priv->categories, category);
 
@@ -246,27 +447,37 @@ load_vfolder_dir (TakuMenu *menu, const char *vfolderdir)
   fclose (fp);
 }
 
+/*
+ * Build the index from Categories tokens to the categories which match them.  A
+ * category is checked in order up to the first meta-all, which puts every item
+ * in it, so later tokens don't matter.
+ */
 static void
-match_category (TakuLauncherCategory  *category,
-                TakuMenuItem          *item,
-                gboolean              *placed)
+index_categories (TakuMenu *menu)
 {
-  char **groups;
+  TakuMenuPrivate *priv = menu->priv;
+  GList *l;
   char **match;
 
-  for (match = category->matches; *match; match++) {
-    /* Add all tiles to the all group */
-    if (strcmp (*match, "meta-all") == 0) {
-      item->categories = g_list_append (item->categories, category);
-      return;
-    }
+  for (l = priv->categories; l; l = l->next) {
+    TakuLauncherCategory *category = l->data;
+
+    for (match = category->matches; *match; match++) {
+      GQuark token;
+      guint64 *bits;
 
-    for (groups = item->cats; *groups; groups++) {
-      if (strcmp (*match, *groups) == 0) {
-        item->categories = g_list_append (item->categories, category);
-        *placed = TRUE;
-        return;
+      if (strcmp (*match, "meta-all") == 0) {
+        priv->all_categories |= TAKU_CATEGORY_BIT (category);
+        break;
       }
+
+      token = g_quark_from_string (*match);
+      bits = g_hash_table_lookup (priv->token_index, GUINT_TO_POINTER (token));
+      if (bits == NULL) {
+        bits = g_new0 (guint64, 1);
+        g_hash_table_insert (priv->token_index, GUINT_TO_POINTER (token), bits);
+      }
+      *bits |= TAKU_CATEGORY_BIT (category);
     }
   }
 }
@@ -274,142 +485,346 @@ match_category (TakuLauncherCategory  *category,
 static void
 set_groups (TakuMenu *menu, TakuMenuItem *item)
 {
-  gboolean placed = FALSE;
+  TakuMenuPrivate *priv = menu->priv;
+  guint64 bits = 0, *token_bits;
+  char **tokens, **token;
   GList *l;
 
-  for (l = menu->priv->categories; l ; l = l->next) {
-    match_category (l->data, item, &placed);
+  tokens = g_strsplit (item->cats ? item->cats : "", ";", -1);
+
+  /* A token no category matches was never interned */
+  for (token = tokens; *token; token++) {
+    GQuark quark = g_quark_try_string (*token);
+
+    if (quark == 0)
+      continue;
+
+    token_bits = g_hash_table_lookup (priv->token_index,
+                                      GUINT_TO_POINTER (quark));
+    if (token_bits)
+      bits |= *token_bits;
   }
 
-  if (!placed && menu->priv->fallback_category)
-    item->categories = g_list_append (item->categories,
-                                      menu->priv->fallback_category);
+  g_strfreev (tokens);
+
+  /* Being in the meta-all categories doesn't count as being placed */
+  if (bits == 0 && priv->fallback_category)
+    bits = TAKU_CATEGORY_BIT (priv->fallback_category);
+  bits |= priv->all_categories;
+
+  item->category_bits = bits;
+
+  for (l = priv->categories; l; l = l->next) {
+    if (bits & TAKU_CATEGORY_BIT ((TakuLauncherCategory *) l->data))
+      item->categories = g_list_prepend (item->categories,
+                                         taku_launcher_category_ref (l->data));
+  }
+  item->categories = g_list_reverse (item->categories);
+}
+
+/* Move @s into the string arena */
+static const char *
+intern_take (char *s)
+{
+  const char *stored;
+
+  stored = taku_string_arena_intern (s);
+  g_free (s);
+
+  return stored;
+}
+
+static char *
+make_collation_key (const char *name)
+{
+  char *casefold, *key;
+
+  if (name == NULL)
+    return NULL;
+
+  casefold = g_utf8_casefold (name, -1);
+  key = g_utf8_collate_key (casefold, -1);
+  g_free (casefold);
+
+  return key;
 }
 
 /*
- * Get the boolean for the key @key from @key_file, and if it cannot be parsed
- * or does not exist return @def.
+ * Parse the desktop file @filename, returning NULL if it cannot be read or
+ * shouldn't be displayed.
  */
+static TakuMenuItem*
+parse_desktop_file (const char *filename)
+{
+  TakuMenuItem *item = NULL;
+  DesktopEntry entry;
+  gchar *exec;
+
+  /* This rejects anything which shouldn't be displayed */
+  if (!desktop_entry_load (&entry, filename))
+    return NULL;
+
+  /* This is important, so read it first to simplyfy cleanup */
+  exec = desktop_entry_get_string (&entry, DESKTOP_ENTRY_EXEC);
+  if (exec == NULL) {
+    desktop_entry_clear (&entry);
+    return NULL;
+  }
+
+  /* Okay, were good to go */
+  item = taku_menu_item_new ();
+
+  taku_string_arena_add_path (filename, &item->dir, &item->basename);
+  item->name = intern_take (desktop_entry_get_string (&entry,
+                                                      DESKTOP_ENTRY_NAME));
+  item->description = intern_take (desktop_entry_get_string
+                                   (&entry, DESKTOP_ENTRY_COMMENT));
+  item->icon_name = intern_take (desktop_entry_get_string (&entry,
+                                                           DESKTOP_ENTRY_ICON));
+  item->collation_key = intern_take (make_collation_key (item->name));
+  item->use_sn = desktop_entry_get_boolean (&entry,
+                                            DESKTOP_ENTRY_STARTUP_NOTIFY,
+                                            FALSE);
+  item->single_instance =
+    desktop_entry_get_boolean (&entry, DESKTOP_ENTRY_MB_SINGLE_INSTANCE, FALSE)
+    || desktop_entry_get_boolean (&entry, DESKTOP_ENTRY_SINGLE_INSTANCE, FALSE);
+  item->exec = intern_take (exec);
+  item->cats = intern_take (desktop_entry_get_string
+                            (&entry, DESKTOP_ENTRY_CATEGORIES));
+
+  desktop_entry_clear (&entry);
+
+  return item;
+}
+
 static gboolean
-get_desktop_boolean (GKeyFile *key_file, const char *key, gboolean def)
+save_cache (gpointer data)
 {
-  GError *error = NULL;
-  gboolean b;
+  TakuMenu *menu = data;
+  TakuMenuPrivate *priv = menu->priv;
+  GPtrArray *hidden, *shadowed;
+  GHashTableIter iter;
+  gpointer stamp, list;
+  GSList *l;
+
+  priv->cache_save_id = 0;
+  priv->cache_dirty = FALSE;
+
+  hidden = g_ptr_array_sized_new (g_hash_table_size (priv->hidden));
+  g_hash_table_iter_init (&iter, priv->hidden);
+  while (g_hash_table_iter_next (&iter, NULL, &stamp))
+    g_ptr_array_add (hidden, stamp);
+
+  /* Every provider but the first of an ID is shadowed */
+  shadowed = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, priv->desktop_ids);
+  while (g_hash_table_iter_next (&iter, NULL, &list))
+    for (l = ((GSList *) list)->next; l; l = l->next)
+      g_ptr_array_add (shadowed, ((Provider *) l->data)->path);
+
+  taku_menu_cache_save (taku_menu_store_get_list (priv->store), hidden,
+                        shadowed, priv->dirs, priv->categories);
+  g_ptr_array_free (shadowed, TRUE);
+  g_ptr_array_free (hidden, TRUE);
+
+  return FALSE;
+}
+
+/* Write the cache in a while, so that a burst of changes is written once */
+static void
+queue_save_cache (TakuMenu *menu)
+{
+  TakuMenuPrivate *priv = menu->priv;
+
+  priv->cache_dirty = TRUE;
+
+  if (priv->cache_save_id == 0)
+    priv->cache_save_id = g_timeout_add_seconds (CACHE_SAVE_DELAY,
+                                                 save_cache, menu);
+}
+
+/*
+ * Add @item to the table, returning FALSE if there is already an item for the
+ * same desktop file.
+ */
+static gboolean
+add_item (TakuMenu *menu, TakuMenuItem *item)
+{
+  TakuMenuPrivate *priv = menu->priv;
+
+  /* Check for duplicate desktop files based on path name */
+  if (taku_menu_store_add (priv->store, item) == TAKU_MENU_STORE_INVALID)
+    return FALSE;
 
-  g_assert (key_file);
-  g_assert (key);
+  /* Cached items already know their groups, unless the vfolders changed */
+  if (item->categories == NULL)
+    set_groups (menu, item);
+
+  return TRUE;
+}
+
+static void
+provider_free (gpointer data)
+{
+  Provider *provider = data;
+
+  g_free (provider->path);
+  g_slice_free (Provider, provider);
+}
+
+static void
+provider_list_free (gpointer data)
+{
+  g_slist_free_full (data, provider_free);
+}
+
+static gint
+compare_providers (gconstpointer a, gconstpointer b)
+{
+  const Provider *pa = a, *pb = b;
+
+  return pa->rank < pb->rank ? -1 : pa->rank > pb->rank;
+}
 
-  b = g_key_file_get_boolean (key_file, DESKTOP, key, &error);
-  if (error) {
-    g_error_free (error);
-    b = def;
+/*
+ * Record that @path provides its desktop file ID.  Returns TRUE if it is the
+ * best provider, in which case @shadowed is set to the path of the provider it
+ * replaces, if any, which should be freed.
+ */
+static gboolean
+add_provider (TakuMenu *menu, const char *path, char **shadowed)
+{
+  TakuMenuPrivate *priv = menu->priv;
+  Provider *provider;
+  GSList *list, *l;
+  char *id;
+  guint rank;
+
+  if (shadowed)
+    *shadowed = NULL;
+
+  id = taku_menu_get_desktop_id (path, &rank);
+  list = g_hash_table_lookup (priv->desktop_ids, id);
+
+  for (l = list; l; l = l->next) {
+    if (strcmp (((Provider *) l->data)->path, path) == 0) {
+      g_free (id);
+      return l == list;
+    }
   }
 
-  return b;
+  provider = g_slice_new (Provider);
+  provider->path = g_strdup (path);
+  provider->rank = rank;
+
+  /* Sorting is stable, so the first of equals stays in use */
+  list = g_slist_insert_sorted (list, provider, compare_providers);
+  g_hash_table_steal (priv->desktop_ids, id);
+  g_hash_table_insert (priv->desktop_ids, id, list);
+
+  if (list->data != provider)
+    return FALSE;
+
+  if (shadowed && list->next)
+    *shadowed = g_strdup (((Provider *) list->next->data)->path);
+
+  return TRUE;
 }
 
-static char *
-get_desktop_string (GKeyFile *key_file, const char *key)
+/*
+ * Forget that @path provides its desktop file ID.  Returns TRUE if it was the
+ * provider in use, in which case @next is set to the path of the one to use
+ * instead, if any is known, which should be freed.
+ */
+static gboolean
+remove_provider (TakuMenu *menu, const char *path, char **next)
 {
-  char *s;
+  TakuMenuPrivate *priv = menu->priv;
+  GSList *list, *l;
+  gboolean in_use;
+  char *id;
 
-  g_assert (key_file);
-  g_assert (key);
+  *next = NULL;
 
-  /* Get the key */
-  s = g_key_file_get_locale_string (key_file, DESKTOP, key, NULL, NULL);
-  /* Strip any whitespace */
-  s = s ? g_strstrip (s) : NULL;
-  if (s && s[0] != '\0') {
-    return s;
+  id = taku_menu_get_desktop_id (path, NULL);
+  list = g_hash_table_lookup (priv->desktop_ids, id);
+
+  for (l = list; l; l = l->next) {
+    if (strcmp (((Provider *) l->data)->path, path) == 0)
+      break;
+  }
+
+  if (l == NULL) {
+    g_free (id);
+    return FALSE;
+  }
+
+  in_use = (l == list);
+  provider_free (l->data);
+  list = g_slist_delete_link (list, l);
+
+  g_hash_table_steal (priv->desktop_ids, id);
+  if (list) {
+    g_hash_table_insert (priv->desktop_ids, id, list);
+    if (in_use)
+      *next = g_strdup (((Provider *) list->data)->path);
   } else {
-    if (s) g_free (s);
-    return NULL;
+    g_free (id);
   }
+
+  return in_use;
 }
 
 /*
- * Load the desktop file @filename, and add it to the table.
+ * Load the desktop file @filename, and add it to the table.  @st is the
+ * result of stat()ing @filename.
  */
 static TakuMenuItem*
-load_desktop_file (TakuMenu *menu, const char *filename)
+load_desktop_file (TakuMenu *menu, const char *filename, struct stat *st)
 {
   TakuMenuPrivate *priv;
-  TakuMenuItem *item = NULL;
-  GKeyFile *key_file;
-  GError *err = NULL;
-  gchar *exec, *cats;
+  TakuMenuItem *item;
+  gint64 mtime;
 
   g_assert (filename);
+  g_assert (st);
   g_return_val_if_fail (TAKU_IS_MENU (menu), NULL);
   priv = menu->priv;
 
-  /* Check for duplicate desktop files based on path name */
-  if (g_hash_table_lookup (priv->path_items_hash, filename))
-    return NULL;
-
-  key_file = g_key_file_new ();
-
-  /* Do the checks to make sure the .desktop file is valid */
-  if (!g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, &err)) {
-    g_key_file_free (key_file);
-    g_error_free (err);
+  if (taku_menu_store_lookup_path (priv->store, filename))
     return NULL;
-  }
 
-  if (get_desktop_boolean (key_file, "NoDisplay", FALSE)) {
-    g_key_file_free (key_file);
-    return NULL;
-  }
+  mtime = taku_menu_cache_get_mtime (st);
 
-  /* This is important, so read it first to simplyfy cleanup */
-  exec = get_desktop_string (key_file, "Exec");
-  if (exec == NULL) {
-    g_free (exec);
-    g_key_file_free (key_file);
+  item = parse_desktop_file (filename);
+  if (item == NULL) {
+    g_hash_table_replace (priv->hidden, g_strdup (filename),
+                          taku_menu_cache_stamp_new (filename,
+                                                     mtime, st->st_size));
     return NULL;
   }
 
-  /* Okay, were good to go */
-  item = g_slice_new0 (TakuMenuItem);
+  item->mtime = mtime;
+  item->size = st->st_size;
 
-  item->path = g_strdup (filename);
-  item->name = get_desktop_string (key_file, "Name");
-  item->description = get_desktop_string (key_file, "Comment");
-  item->icon_name = get_desktop_string (key_file, "Icon");
-  item->use_sn = get_desktop_boolean (key_file, "StartupNotify", FALSE);
-  item->single_instance = get_desktop_boolean (key_file,
-                                               "X-MB-SingleInstance", FALSE)
-                          || get_desktop_boolean (key_file,
-                                                  "SingleInstance", FALSE);
-  item->argv = exec_to_argv (exec);
-  g_free (exec);
-
-  cats = get_desktop_string (key_file, "Categories");
-  if (cats == NULL)
-    cats = g_strdup ("");
-  item->cats = g_strsplit (cats, ";", -1);
-  g_free (cats);
-
-
-  set_groups (menu, item);
-  priv->items = g_list_append (priv->items, item);
-  g_hash_table_insert (priv->path_items_hash, item->path, item);
+  add_item (menu, item);
 
   return item;
 }
 
 #if WITH_INOTIFY
 /*
- * Monitor @directory with inotify, if available.
+ * Monitor @directory with inotify, if available and not already watched.
  */
 static void
-monitor (const char *directory)
+monitor (TakuMenu *menu, const char *directory)
 {
+  GHashTable *monitored = menu->priv->monitored;
   inotify_sub *sub;
 
-  if (!with_inotify)
+  if (!with_inotify || g_hash_table_contains (monitored, directory))
     return;
+  g_hash_table_add (monitored, g_strdup (directory));
 
   sub = _ih_sub_new (directory, NULL, NULL);
   _ip_start_watching (sub);
@@ -437,144 +852,823 @@ find_and_destroy (GtkWidget *widget, gpointer data)
     gtk_widget_destroy (widget);
 }
 */
+#endif
 
 static TakuMenuItem *
 _find_item (TakuMenu *menu, const gchar *path)
 {
-  TakuMenuPrivate *priv;
-  GList *l;
-
   g_return_val_if_fail (TAKU_IS_MENU (menu), NULL);
-  priv = menu->priv;
-
-  for (l = priv->items; l; l = l->next)
-  {
-    TakuMenuItem *item = l->data;
 
-    if (strcmp (item->path, path) == 0)
-      return item;
-  }
-  return NULL;
+  return taku_menu_store_lookup_path (menu->priv->store, path);
 }
 
 static void
 _remove_item (TakuMenu *menu, TakuMenuItem *item)
 {
-  TakuMenuPrivate *priv;
-
   g_return_if_fail (TAKU_IS_MENU (menu));
-  priv = menu->priv;
 
-  priv->items = g_list_remove (priv->items, item);
+  /* Tiles showing the item hold their own references */
+  if (taku_menu_store_remove (menu->priv->store, item))
+    taku_menu_item_unref (item);
+}
+
+/* Drop whatever was loaded from @path */
+static void
+unload_desktop_file (TakuMenu *menu, const char *path)
+{
+  TakuMenuItem *item;
 
-  g_hash_table_remove (priv->path_items_hash, item->path);
+  item = _find_item (menu, path);
 
-  /* TODO: Lots of leaks here */
-  g_slice_free (TakuMenuItem, item);
+  if (item) {
+    g_signal_emit (menu, _menu_signals[ITEM_REMOVED], 0, item);
+    _remove_item (menu, item);
+    queue_save_cache (menu);
+  } else if (g_hash_table_remove (menu->priv->hidden, path)) {
+    queue_save_cache (menu);
+  }
 }
 
+/* Load @path, announcing the item if there is one */
 static void
-inotify_event (ik_event_t *event, inotify_sub *sub)
+reload_desktop_file (TakuMenu *menu, const char *path)
 {
-  char *path;
-  TakuMenu *menu = taku_menu_get_default ();
   TakuMenuItem *item = NULL;
+  struct stat st;
+
+  if (g_stat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+    item = load_desktop_file (menu, path, &st);
+    queue_save_cache (menu);
+  }
+
+  if (item)
+    g_signal_emit (menu, _menu_signals[ITEM_ADDED], 0, item);
+}
+
+/*
+ * A desktop file which inotify says has appeared or gone.  They are handled
+ * from a queue, so that installing a large package doesn't stall the desktop.
+ */
+typedef struct {
+  char *path;
+  gboolean created;
+} FileChange;
 
-  if (event->mask & IN_MOVED_TO || event->mask & IN_CREATE) {
-    if (g_str_has_suffix (event->name, ".desktop")) {
-      path = g_build_filename (sub->dirname, event->name, NULL);
-      item = load_desktop_file (taku_menu_get_default (), path);
+static void
+file_change_free (gpointer data)
+{
+  FileChange *change = data;
 
-      if (item)
-        g_signal_emit (menu, _menu_signals[ITEM_ADDED], 0, item);
+  g_free (change->path);
+  g_slice_free (FileChange, change);
+}
 
-      g_free (path);
+static void
+handle_change (gpointer data, gpointer user_data)
+{
+  FileChange *change = data;
+  TakuMenu *menu = user_data;
+  const char *path = change->path;
+  char *other;
+
+  if (change->created) {
+    if (!g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+      file_change_free (change);
+      return;
     }
-  } else if (event->mask & IN_MOVED_FROM || event->mask & IN_DELETE) {
-    path = g_build_filename (sub->dirname, event->name, NULL);
-    item = _find_item (menu, path);
 
-    if (item) {
-      g_signal_emit (menu, _menu_signals[ITEM_REMOVED], 0, item);
-      _remove_item (menu, item);
+    /* A file which is shadowed by a more important one isn't loaded, and a
+       file which shadows the one in use replaces it */
+    if (add_provider (menu, path, &other)) {
+      if (other)
+        unload_desktop_file (menu, other);
+      reload_desktop_file (menu, path);
+      g_free (other);
     }
+  } else {
+    if (remove_provider (menu, path, &other)) {
+      unload_desktop_file (menu, path);
+
+      /* Shadowed files are remembered, but look for a flat one in the
+         directories after this one in case one was missed */
+      if (other == NULL) {
+        char *id;
+        guint rank;
+
+        id = taku_menu_get_desktop_id (path, &rank);
+        if (rank != G_MAXUINT)
+          other = taku_menu_find_desktop_file (id, rank + 1);
+        g_free (id);
+
+        if (other)
+          add_provider (menu, other, NULL);
+      }
 
-    g_free (path);
+      if (other)
+        reload_desktop_file (menu, other);
+      g_free (other);
+    } else {
+      unload_desktop_file (menu, path);
+    }
   }
+
+  file_change_free (change);
+}
+
+/*
+ * Queue the desktop file @path as @created or deleted, as inotify does.  Used
+ * by the soak test to churn items without waiting for inotify.
+ */
+void
+taku_menu_file_changed (TakuMenu *menu, const char *path, gboolean created)
+{
+  FileChange *change;
+
+  g_return_if_fail (TAKU_IS_MENU (menu));
+  g_return_if_fail (path);
+
+  change = g_slice_new (FileChange);
+  change->path = g_strdup (path);
+  change->created = created;
+
+  taku_queue_push (menu->priv->changes, change);
+}
+
+#if WITH_INOTIFY
+static void
+inotify_event (ik_event_t *event, inotify_sub *sub)
+{
+  char *path;
+
+  if (!g_str_has_suffix (event->name, ".desktop"))
+    return;
+
+  if (!(event->mask & (IN_MOVED_TO | IN_CREATE | IN_MOVED_FROM | IN_DELETE)))
+    return;
+
+  path = g_build_filename (sub->dirname, event->name, NULL);
+  taku_menu_file_changed (taku_menu_get_default (), path,
+                          (event->mask & (IN_MOVED_TO | IN_CREATE)) != 0);
+  g_free (path);
 }
 #endif
 
 /*
- * Recursively load all desktop files in @directory
+ * Loading is a pipeline: a scanner thread walks the application directories and
+ * hands every desktop file to a pool of parser threads.  They post the results
+ * back to the main loop through a TakuQueue, which sorts them into categories
+ * and announces them a few milliseconds' worth at a time.
  */
+
+/* Number of results handled between progress signals */
+#define PROGRESS_INTERVAL 32
+
+typedef enum {
+  LOAD_DIRECTORY,
+  LOAD_ITEM,
+  LOAD_HIDDEN,
+  /* A desktop file which isn't loaded as its ID is provided by another */
+  LOAD_SHADOWED,
+  LOAD_DONE
+} LoadResultType;
+
+typedef struct {
+  LoadResultType type;
+  TakuMenuCacheStamp *stamp;
+  TakuMenuItem *item;
+  /* If the result came from the cache */
+  gboolean cached;
+} LoadResult;
+
+typedef struct {
+  TakuMenu *menu;
+  GCancellable *cancellable;
+  /* The cache of the last run, or NULL */
+  TakuMenuCache *cache;
+  gchar **dirs;
+  GThreadPool *pool;
+  /* Paths handed to the parsers, so duplicate data dirs are only read once */
+  GHashTable *seen;
+  /* DirIds of the directories scanned, to catch symlink loops */
+  GHashTable *visited;
+  /* Desktop file IDs found so far.  The directories are scanned in order of
+     precedence, so later files with these IDs are shadowed */
+  GHashTable *ids;
+  /* System calls made, and directories which didn't need reading, for the
+     debug output */
+  guint n_opens;
+  guint n_stats;
+  guint n_entries;
+  guint n_unchanged;
+} ScanContext;
+
+/* Identifies a directory however it was reached */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} DirId;
+
+static guint
+dir_id_hash (gconstpointer key)
+{
+  const DirId *id = key;
+
+  return (guint) id->ino ^ ((guint) id->dev << 16);
+}
+
+static gboolean
+dir_id_equal (gconstpointer a, gconstpointer b)
+{
+  const DirId *id_a = a, *id_b = b;
+
+  return id_a->dev == id_b->dev && id_a->ino == id_b->ino;
+}
+
 static void
-load_desktop_files (TakuMenu *menu, const char *directory)
+dir_id_free (gpointer data)
 {
-  GError *error = NULL;
-  GDir *dir;
-  const char *name;
+  g_slice_free (DirId, data);
+}
 
-  g_assert (menu);
-  g_assert (directory);
+static void
+finish_loading (TakuMenu *menu)
+{
+  TakuMenuPrivate *priv = menu->priv;
+  TakuStringArenaStats stats;
+  gboolean cancelled;
+
+  g_thread_join (priv->scan_thread);
+  priv->scan_thread = NULL;
+
+  cancelled = g_cancellable_is_cancelled (priv->cancellable);
+  if (priv->cancellable) {
+    g_object_unref (priv->cancellable);
+    priv->cancellable = NULL;
+  }
+
+  /* Rewrite the cache if anything was parsed or has gone away since */
+  if (priv->cache == NULL ||
+      priv->cache_hits != taku_menu_cache_get_n_entries (priv->cache))
+    priv->cache_dirty = TRUE;
+
+  if (priv->cache) {
+    taku_menu_cache_close (priv->cache);
+    priv->cache = NULL;
+  }
+
+  /* Drop the reference taken by taku_menu_load_async(), the result handler
+     which called us still holds one */
+  g_object_unref (menu);
+
+  /* A partial sweep would drop entries from the cache, and isn't loaded */
+  if (cancelled)
+    return;
+
+  if (priv->cache_dirty)
+    save_cache (menu);
+
+  taku_string_arena_get_stats (&stats);
+  g_debug ("Loaded %u items: %u strings in %" G_GSIZE_FORMAT " bytes, "
+           "%u shared saving %" G_GSIZE_FORMAT " bytes, %u chunks of %"
+           G_GSIZE_FORMAT " bytes, %u directories",
+           taku_menu_store_get_n_items (priv->store),
+           stats.n_strings, stats.bytes,
+           stats.n_shared, stats.bytes_saved,
+           stats.n_chunks, stats.chunk_bytes, stats.n_dirs);
+
+  priv->loaded = TRUE;
+  g_signal_emit (menu, _menu_signals[LOADED], 0);
+}
+
+/* Free a result which isn't wanted any more as loading was cancelled */
+static void
+discard_result (LoadResult *result)
+{
+  if (result->item)
+    taku_menu_item_unref (result->item);
+  if (result->stamp)
+    taku_menu_cache_stamp_free (result->stamp);
+
+  g_slice_free (LoadResult, result);
+}
+
+static void
+emit_progress (TakuMenu *menu)
+{
+  TakuMenuPrivate *priv = menu->priv;
+
+  g_signal_emit (menu, _menu_signals[PROGRESS], 0,
+                 priv->n_done, (guint) g_atomic_int_get (&priv->n_found));
+}
+
+/* Handle a result of the pipeline, in the main loop */
+static void
+handle_result (gpointer data, gpointer user_data)
+{
+  LoadResult *result = data;
+  TakuMenu *menu = user_data;
+  TakuMenuPrivate *priv = menu->priv;
+  char *path;
 
-  /* Check if the directory exists */
-  if (! g_file_test (directory, G_FILE_TEST_IS_DIR)) {
+  if (result->type != LOAD_DONE &&
+      g_cancellable_is_cancelled (priv->cancellable)) {
+    discard_result (result);
     return;
   }
 
+  switch (result->type) {
+  case LOAD_DIRECTORY:
+    /* Record the new mtime of directories which changed */
+    if (!result->cached)
+      priv->cache_dirty = TRUE;
 #if WITH_INOTIFY
-  monitor (directory);
+    monitor (menu, result->stamp->path);
 #endif
+    g_ptr_array_add (priv->dirs, result->stamp);
+    break;
+  case LOAD_ITEM:
+    if (result->cached)
+      priv->cache_hits++;
+    else
+      priv->cache_dirty = TRUE;
+
+    path = taku_menu_item_dup_path (result->item);
+    add_provider (menu, path, NULL);
+    g_free (path);
+
+    if (add_item (menu, result->item))
+      g_signal_emit (menu, _menu_signals[ITEM_ADDED], 0, result->item);
+    else
+      taku_menu_item_unref (result->item);
+    break;
+  case LOAD_HIDDEN:
+    if (result->cached)
+      priv->cache_hits++;
+    else
+      priv->cache_dirty = TRUE;
+
+    /* Hidden files still shadow others with the same ID */
+    add_provider (menu, result->stamp->path, NULL);
+
+    /* Remember unchanged hidden files so they aren't parsed next time */
+    g_hash_table_replace (priv->hidden, g_strdup (result->stamp->path),
+                          result->stamp);
+    break;
+  case LOAD_SHADOWED:
+    /* Only a cached shadowed file is known to be unchanged */
+    if (result->cached)
+      priv->cache_hits++;
+    else
+      priv->cache_dirty = TRUE;
+
+    add_provider (menu, result->stamp->path, NULL);
+    taku_menu_cache_stamp_free (result->stamp);
+    break;
+  case LOAD_DONE:
+    /* Report the final count before saying we are done, and keep the menu
+       alive while finishing drops the loading reference */
+    g_object_ref (menu);
+    emit_progress (menu);
+    finish_loading (menu);
+    g_object_unref (menu);
+    break;
+  }
+
+  if (result->type == LOAD_ITEM || result->type == LOAD_HIDDEN) {
+    priv->n_done++;
+    if (priv->n_done % PROGRESS_INTERVAL == 0)
+      emit_progress (menu);
+  }
+
+  g_slice_free (LoadResult, result);
+}
+
+/* Can be called from any thread */
+static void
+post_result (TakuMenu           *menu,
+             LoadResultType      type,
+             TakuMenuCacheStamp *stamp,
+             TakuMenuItem       *item,
+             gboolean            cached)
+{
+  TakuMenuPrivate *priv = menu->priv;
+  LoadResult *result;
+
+  result = g_slice_new (LoadResult);
+  result->type = type;
+  result->stamp = stamp;
+  result->item = item;
+  result->cached = cached;
+
+  taku_queue_push (priv->results, result);
+}
+
+/*
+ * Parser thread: turn the desktop file described by the stamp @data into an
+ * item, straight from the cache if it is unchanged.
+ */
+static void
+parse_job (gpointer data, gpointer user_data)
+{
+  TakuMenuCacheStamp *stamp = data;
+  TakuMenu *menu = user_data;
+  TakuMenuItem *item = NULL;
+  TakuMenuCacheResult result = TAKU_MENU_CACHE_MISS;
+
+  if (g_cancellable_is_cancelled (menu->priv->cancellable)) {
+    taku_menu_cache_stamp_free (stamp);
+    return;
+  }
+
+  if (menu->priv->cache)
+    result = taku_menu_cache_lookup (menu->priv->cache, stamp->path,
+                                     stamp->mtime, stamp->size, &item);
+
+  if (result == TAKU_MENU_CACHE_MISS) {
+    g_atomic_int_inc (&menu->priv->n_parsed);
+    item = parse_desktop_file (stamp->path);
+  }
 
-  dir = g_dir_open (directory, 0, &error);
-  if (error) {
-    g_warning ("Cannot read %s: %s", directory, error->message);
-    g_error_free (error);
+  if (item) {
+    item->mtime = stamp->mtime;
+    item->size = stamp->size;
+    post_result (menu, LOAD_ITEM, NULL, item,
+                 result == TAKU_MENU_CACHE_HIT);
+    taku_menu_cache_stamp_free (stamp);
+  } else {
+    post_result (menu, LOAD_HIDDEN, stamp, NULL,
+                 result == TAKU_MENU_CACHE_HIDDEN);
+  }
+}
+
+/*
+ * Claim the desktop file ID of @path, returning FALSE if a more important
+ * directory already provides it.  Shadowed files are never opened, but are
+ * remembered so that the next run can load them if that one has gone.
+ * @cached says if the cache already had @path as shadowed.
+ */
+static gboolean
+claim_desktop_id (ScanContext *ctx, const char *path, gboolean cached)
+{
+  char *id;
+
+  id = taku_menu_get_desktop_id (path, NULL);
+
+  if (g_hash_table_contains (ctx->ids, id)) {
+    g_free (id);
+    post_result (ctx->menu, LOAD_SHADOWED,
+                 taku_menu_cache_stamp_new (path, 0, 0), NULL, cached);
+    return FALSE;
+  }
+
+  g_hash_table_add (ctx->ids, id);
+  return TRUE;
+}
+
+/* Hand the desktop file @path, described by @st, to the parsers */
+static void
+queue_desktop_file (ScanContext *ctx, const char *path, struct stat *st)
+{
+  TakuMenuCacheStamp *stamp;
+
+  if (g_hash_table_contains (ctx->seen, path))
+    return;
+
+  g_hash_table_add (ctx->seen, g_strdup (path));
+  g_atomic_int_inc (&ctx->menu->priv->n_found);
+  stamp = taku_menu_cache_stamp_new (path, taku_menu_cache_get_mtime (st),
+                                     st->st_size);
+  g_thread_pool_push (ctx->pool, stamp, NULL);
+}
+
+static void scan_directory (ScanContext *ctx, int parent_fd,
+                            const char *name, const char *path);
+
+/*
+ * Pass a desktop file of an unchanged directory on as it was last time.  The
+ * directory's mtime doesn't change when a file in it is edited in place, so
+ * each file is still stat()ed, and parsed again if its stamp is different.
+ */
+static void
+replay_file (const char          *path,
+             gint64               mtime,
+             gint64               size,
+             TakuMenuCacheResult  result,
+             TakuMenuItem        *item,
+             gpointer             data)
+{
+  ScanContext *ctx = data;
+  struct stat st;
+
+  if (g_hash_table_contains (ctx->seen, path) ||
+      !claim_desktop_id (ctx, path, result == TAKU_MENU_CACHE_SHADOWED)) {
+    if (item)
+      taku_menu_item_unref (item);
+    return;
+  }
+
+  ctx->n_stats++;
+  if (stat (path, &st) != 0 || !S_ISREG (st.st_mode)) {
+    if (item)
+      taku_menu_item_unref (item);
+    return;
+  }
+
+  /* Shadowed files were never read, and misses weren't usable from the cache,
+     so both have to be parsed like a new file */
+  if (result == TAKU_MENU_CACHE_SHADOWED || result == TAKU_MENU_CACHE_MISS ||
+      taku_menu_cache_get_mtime (&st) != mtime || st.st_size != size) {
+    if (item)
+      taku_menu_item_unref (item);
+    queue_desktop_file (ctx, path, &st);
+    return;
+  }
+
+  g_hash_table_add (ctx->seen, g_strdup (path));
+  g_atomic_int_inc (&ctx->menu->priv->n_found);
+
+  if (result == TAKU_MENU_CACHE_HIT)
+    post_result (ctx->menu, LOAD_ITEM, NULL, item, TRUE);
+  else
+    post_result (ctx->menu, LOAD_HIDDEN,
+                 taku_menu_cache_stamp_new (path, mtime, size), NULL, TRUE);
+}
+
+static void
+replay_subdir (gpointer data, gpointer user_data)
+{
+  const char *path = data;
+
+  scan_directory (user_data, AT_FDCWD, path, path);
+}
+
+/*
+ * Scanner thread: recursively find all desktop files in the directory @name,
+ * relative to @parent_fd, which is at @path.  The entry types from readdir()
+ * mean only desktop files and entries of unknown type are stat()ed.
+ *
+ * A directory's mtime changes when files are added to or removed from it, so a
+ * directory with the same mtime as in the cache isn't read at all.  Its files
+ * are passed on from the cache, after a stat() each to catch edits in place,
+ * and its known subdirectories are checked in turn.  Only the directories which changed are read, so the menu ends up with
+ * the items of the last run plus and minus what changed since.
+ */
+static void
+scan_directory (ScanContext *ctx, int parent_fd,
+                const char *name, const char *path)
+{
+  struct dirent *entry;
+  struct stat st;
+  gboolean unchanged;
+  gint64 mtime;
+  DirId *id;
+  DIR *dir;
+  int fd;
+
+  g_assert (ctx);
+  g_assert (name);
+  g_assert (path);
+
+  ctx->n_stats++;
+  if (fstatat (parent_fd, name, &st, 0) != 0) {
+    /* Data directories without applications are normal */
+    if (errno != ENOENT && errno != ENOTDIR)
+      g_warning ("Cannot read %s: %s", path, g_strerror (errno));
+    return;
+  }
+
+  if (!S_ISDIR (st.st_mode))
+    return;
+
+  /* Don't go round in circles if a symlink points back up the tree */
+  id = g_slice_new (DirId);
+  id->dev = st.st_dev;
+  id->ino = st.st_ino;
+  if (g_hash_table_contains (ctx->visited, id)) {
+    dir_id_free (id);
+    return;
+  }
+  g_hash_table_add (ctx->visited, id);
+
+  mtime = taku_menu_cache_get_mtime (&st);
+  unchanged = ctx->cache &&
+    taku_menu_cache_dir_unchanged (ctx->cache, path, mtime);
+
+  post_result (ctx->menu, LOAD_DIRECTORY,
+               taku_menu_cache_stamp_new (path, mtime, 0),
+               NULL, unchanged);
+
+  if (unchanged) {
+    ctx->n_unchanged++;
+    taku_menu_cache_foreach_file (ctx->cache, path, replay_file, ctx);
+    taku_menu_cache_foreach_subdir (ctx->cache, path, replay_subdir, ctx);
     return;
   }
 
-  while ((name = g_dir_read_name (dir)) != NULL) {
+  ctx->n_opens++;
+  fd = openat (parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    g_warning ("Cannot read %s: %s", path, g_strerror (errno));
+    return;
+  }
+
+  dir = fdopendir (fd);
+  if (dir == NULL) {
+    g_warning ("Cannot read %s: %s", path, g_strerror (errno));
+    close (fd);
+    return;
+  }
+
+  while ((entry = readdir (dir)) != NULL) {
+    gboolean is_desktop;
     char *filename;
 
-    filename = g_build_filename (directory, name, NULL);
+    if (g_cancellable_is_cancelled (ctx->cancellable))
+      break;
+
+    ctx->n_entries++;
 
-    if (g_file_test (filename, G_FILE_TEST_IS_DIR)) {
-      load_desktop_files (menu, filename);
-    } else if (g_file_test (filename, G_FILE_TEST_IS_REGULAR) &&
-               g_str_has_suffix (name, ".desktop")) {
-      load_desktop_file (menu, filename);
+    if (entry->d_name[0] == '.' &&
+        (entry->d_name[1] == '\0' ||
+         (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+      continue;
+
+    is_desktop = g_str_has_suffix (entry->d_name, ".desktop");
+
+    switch (entry->d_type) {
+    case DT_DIR:
+      break;
+    case DT_REG:
+      if (!is_desktop)
+        continue;
+      break;
+    case DT_LNK:
+    case DT_UNKNOWN:
+      /* Could be anything, so have to look */
+      break;
+    default:
+      continue;
+    }
+
+    filename = g_strconcat (path, G_DIR_SEPARATOR_S, entry->d_name, NULL);
+
+    if (entry->d_type == DT_DIR) {
+      scan_directory (ctx, dirfd (dir), entry->d_name, filename);
+    } else if (entry->d_type == DT_REG &&
+               (g_hash_table_contains (ctx->seen, filename) ||
+                !claim_desktop_id (ctx, filename, FALSE))) {
+      /* Already queued, or shadowed, so don't even stat it */
+    } else {
+      /* Desktop files need the stamp to validate the cache anyway */
+      ctx->n_stats++;
+      if (fstatat (dirfd (dir), entry->d_name, &st, 0) == 0) {
+        if (S_ISDIR (st.st_mode))
+          scan_directory (ctx, dirfd (dir), entry->d_name, filename);
+        else if (S_ISREG (st.st_mode) && is_desktop &&
+                 (entry->d_type == DT_REG ||
+                  (!g_hash_table_contains (ctx->seen, filename) &&
+                   claim_desktop_id (ctx, filename, FALSE))))
+          queue_desktop_file (ctx, filename, &st);
+      }
     }
 
     g_free (filename);
   }
 
-  g_dir_close (dir);
+  closedir (dir);
+}
+
+static gpointer
+scan_thread (gpointer data)
+{
+  ScanContext *ctx = data;
+  char **dir;
+
+  for (dir = ctx->dirs; *dir; dir++)
+    scan_directory (ctx, AT_FDCWD, *dir, *dir);
+
+  g_debug ("Scanned %u directory entries with %u opens and %u stats, "
+           "%u directories unchanged",
+           ctx->n_entries, ctx->n_opens, ctx->n_stats, ctx->n_unchanged);
+
+  /* Read in the main thread once the result below has been handled */
+  ctx->menu->priv->scan_stats.n_entries = ctx->n_entries;
+  ctx->menu->priv->scan_stats.n_opens = ctx->n_opens;
+  ctx->menu->priv->scan_stats.n_stats = ctx->n_stats;
+  ctx->menu->priv->scan_stats.n_unchanged = ctx->n_unchanged;
+
+  /* Wait for the parsers to finish everything before saying we're done */
+  g_thread_pool_free (ctx->pool, FALSE, TRUE);
+
+  post_result (ctx->menu, LOAD_DONE, NULL, NULL, FALSE);
+
+  g_hash_table_destroy (ctx->seen);
+  g_hash_table_destroy (ctx->visited);
+  g_hash_table_destroy (ctx->ids);
+  g_strfreev (ctx->dirs);
+  g_slice_free (ScanContext, ctx);
+
+  return NULL;
 }
 
 /*
- * Load all .desktop files in @datadir/applications/.
+ * Start loading all .desktop files in the applications/ directory of the system
+ * data directories and the user data directory.  Items are announced with
+ * item-added as they are found, with progress along the way, and loaded is
+ * emitted when the sweep has finished.  Cancelling @cancellable stops the
+ * sweep, in which case loaded isn't emitted and loading can be started again.
  */
-static void
-load_data_dir (TakuMenu *menu, const char *datadir)
+void
+taku_menu_load_async (TakuMenu *menu, GCancellable *cancellable)
 {
-  char *directory;
+  TakuMenuPrivate *priv;
+  const gchar * const *dirs;
+  ScanContext *ctx;
+  GPtrArray *paths;
 
   g_return_if_fail (TAKU_IS_MENU (menu));
-  g_return_if_fail (datadir);
+  priv = menu->priv;
+
+  /* Already loading or loaded */
+  if (priv->scan_thread || priv->loaded)
+    return;
 
-  directory = g_build_filename (datadir, "applications", NULL);
-  load_desktop_files (menu, directory);
-  g_free (directory);
+  if (cancellable)
+    priv->cancellable = g_object_ref (cancellable);
+
+  /* Released when loading finishes, so the menu outlives the threads */
+  g_object_ref (menu);
+
+  priv->cache = taku_menu_cache_open (priv->categories);
+  priv->cache_hits = 0;
+  memset (&priv->scan_stats, 0, sizeof (TakuMenuScanStats));
+  priv->n_parsed = 0;
+  /* A cancelled sweep may have left counts behind, start progress afresh */
+  priv->n_found = 0;
+  priv->n_done = 0;
+
+  /* The stamps and providers are found again by this sweep.  Items already
+     posted stay, as add_item() turns away the second copy of each */
+  g_ptr_array_set_size (priv->dirs, 0);
+  g_hash_table_remove_all (priv->hidden);
+  g_hash_table_remove_all (priv->desktop_ids);
+
+  /* In order of precedence, so that the first file with an ID is the one
+     which is used */
+  paths = g_ptr_array_new ();
+  g_ptr_array_add (paths, g_build_filename (g_get_user_data_dir (),
+                                            "applications", NULL));
+  for (dirs = g_get_system_data_dirs (); *dirs; dirs++)
+    g_ptr_array_add (paths, g_build_filename (*dirs, "applications", NULL));
+  g_ptr_array_add (paths, NULL);
+
+  ctx = g_slice_new0 (ScanContext);
+  ctx->menu = menu;
+  ctx->cancellable = priv->cancellable;
+  ctx->cache = priv->cache;
+  ctx->dirs = (gchar **) g_ptr_array_free (paths, FALSE);
+  ctx->seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  ctx->visited = g_hash_table_new_full (dir_id_hash, dir_id_equal,
+                                        dir_id_free, NULL);
+  ctx->ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  ctx->pool = g_thread_pool_new (parse_job, menu,
+                                 g_get_num_processors (), TRUE, NULL);
+
+  priv->scan_thread = g_thread_new ("taku-menu-scan", scan_thread, ctx);
 }
 
 
 /* GObject stuff */
 
 static void
-taku_menu_finalize (GObject *menu)
+taku_menu_finalize (GObject *object)
 {
-  /* TODO */
-  G_OBJECT_CLASS (taku_menu_parent_class)->finalize (menu);
+  TakuMenu *menu = TAKU_MENU (object);
+  TakuMenuPrivate *priv = menu->priv;
+  GList *l;
+
+  /* Loading holds a reference, so it has finished by now.  Write out any
+     changes which are still waiting to be saved. */
+  if (priv->cache_save_id) {
+    g_source_remove (priv->cache_save_id);
+    save_cache (menu);
+  }
+
+  for (l = taku_menu_store_get_list (priv->store); l; l = l->next)
+    taku_menu_item_unref (l->data);
+  taku_menu_store_free (priv->store);
+
+  g_list_free_full (priv->categories,
+                    (GDestroyNotify) taku_launcher_category_unref);
+  g_hash_table_destroy (priv->token_index);
+  g_hash_table_destroy (priv->hidden);
+  g_hash_table_destroy (priv->desktop_ids);
+  g_ptr_array_free (priv->dirs, TRUE);
+  g_hash_table_destroy (priv->monitored);
+  taku_queue_free (priv->results);
+  taku_queue_free (priv->changes);
+
+  G_OBJECT_CLASS (taku_menu_parent_class)->finalize (object);
 }
 
 static void
@@ -603,6 +1697,24 @@ taku_menu_class_init (TakuMenuClass *klass)
                   g_cclosure_marshal_VOID__POINTER,
                   G_TYPE_NONE, 1, G_TYPE_POINTER);
 
+  _menu_signals[LOADED] =
+    g_signal_new ("loaded",
+                  G_OBJECT_CLASS_TYPE (obj_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TakuMenuClass, loaded),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
+
+  _menu_signals[PROGRESS] =
+    g_signal_new ("progress",
+                  G_OBJECT_CLASS_TYPE (obj_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TakuMenuClass, progress),
+                  NULL, NULL,
+                  g_cclosure_marshal_generic,
+                  G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
+
   g_type_class_add_private (obj_class, sizeof(TakuMenuPrivate));
 
 }
@@ -612,15 +1724,24 @@ taku_menu_init (TakuMenu *menu)
 {
   TakuMenuPrivate *priv;
   gchar *vfolder_dir = NULL;
-  const gchar * const *dirs;
 
   priv = menu->priv = TAKU_MENU_GET_PRIVATE (menu);
 
-  priv->path_items_hash = g_hash_table_new_full (g_str_hash,
-                                                 g_str_equal,
-                                                 NULL,
-                                                 NULL);
-
+  priv->store = taku_menu_store_new ();
+  priv->token_index = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  priv->hidden = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)taku_menu_cache_stamp_free);
+  priv->dirs = g_ptr_array_new_with_free_func
+    ((GDestroyNotify)taku_menu_cache_stamp_free);
+  priv->monitored = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, NULL);
+  priv->desktop_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             provider_list_free);
+  priv->results = taku_queue_new (TAKU_QUEUE_PRIORITY_DEFAULT, handle_result,
+                                  menu, (GDestroyNotify) discard_result);
+
+  priv->changes = taku_queue_new (TAKU_QUEUE_PRIORITY_LOW, handle_change,
+                                  menu, file_change_free);
 #if WITH_INOTIFY
   with_inotify = _ip_startup (inotify_event);
 #endif
@@ -634,15 +1755,9 @@ taku_menu_init (TakuMenu *menu)
     load_vfolder_dir (menu, PKGDATADIR "/vfolders");
   g_free (vfolder_dir);
 
-  /*
-   * Load all desktop files in the system data directories, and the user data
-   * directory. TODO: would it be best to do this in an idle handler and
-   * populate the desktop incrementally?
-   */
-  for (dirs = g_get_system_data_dirs (); *dirs; dirs++) {
-    load_data_dir (menu, *dirs);
-  }
-  load_data_dir (menu, g_get_user_data_dir ());
+  index_categories (menu);
+
+  /* Nothing else is read until taku_menu_load_async() is called */
 }
 
 /*
@@ -653,8 +1768,10 @@ taku_menu_get_default (void)
 {
   static TakuMenu *menu = NULL;
 
-  if (menu == NULL)
+  if (menu == NULL) {
     menu = g_object_new (TAKU_TYPE_MENU, NULL);
+    g_object_add_weak_pointer (G_OBJECT (menu), (gpointer *) &menu);
+  }
 
   return menu;
 }
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_MENU_PRIVATE_H
+#define HAVE_TAKU_MENU_PRIVATE_H
+
+#include "taku-menu.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Shared between the menu and the modules which create items on its behalf,
+ * nothing outside of libtaku should poke at these fields.
+ */
+struct _TakuMenuItem
+{
+  gint ref_count;
+
+  /* The desktop file, as a directory id and file name in the string arena */
+  guint dir;
+  const gchar *basename;
+
+  /* All of the strings are references into the string arena */
+  const gchar *name;
+  const gchar *description;
+  const gchar *icon_name;
+  /* The Categories line, split up when the item is placed */
+  const gchar *cats;
+  GList *categories;
+  /* The categories again, as a bitset of TakuLauncherCategory indexes */
+  guint64 category_bits;
+  const gchar *collation_key;
+
+  /* The raw Exec line.  It is only split into argv, which is owned by the
+     item, on the first launch; executable is from the arena */
+  const gchar *exec;
+  gchar **argv;
+  const gchar *executable;
+  gboolean use_sn;
+  gboolean single_instance;
+
+  /* Stamp of the desktop file this item was loaded from */
+  gint64 mtime;
+  gint64 size;
+
+  /* Position in the menu's item store */
+  guint index;
+};
+
+TakuMenuItem *taku_menu_item_new (void);
+
+char *taku_menu_item_dup_path (TakuMenuItem *item);
+
+void taku_menu_file_changed (TakuMenu *menu, const char *path, gboolean created);
+
+gboolean taku_menu_is_loading (TakuMenu *menu);
+
+guint taku_menu_get_n_dirs (TakuMenu *menu);
+
+G_END_DECLS
+
+#endif
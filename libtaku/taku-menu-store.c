@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+
+#include "taku-menu-store.h"
+#include "taku-string-arena.h"
+
+struct _TakuMenuStore {
+  /* Indexed by item->index, holes are NULL */
+  GPtrArray *slots;
+  /* Indexes of the holes, reused before the array grows */
+  GArray *free_slots;
+  guint n_items;
+
+  /* Keyed by the items themselves, on their directory and file name */
+  GHashTable *by_path;
+  /* Desktop file ID -> item.  Shadowed files aren't loaded, so there is only
+     one item per ID, but if there are more the first one added wins */
+  GHashTable *by_id;
+
+  /* The items as a list for taku_menu_get_items(), rebuilt when stale */
+  GList *list;
+  gboolean list_valid;
+};
+
+/* File names are interned, so can be compared by pointer */
+static guint
+path_hash (gconstpointer key)
+{
+  const TakuMenuItem *item = key;
+
+  return item->dir * 31 + g_direct_hash (item->basename);
+}
+
+static gboolean
+path_equal (gconstpointer a, gconstpointer b)
+{
+  const TakuMenuItem *item_a = a, *item_b = b;
+
+  return item_a->dir == item_b->dir && item_a->basename == item_b->basename;
+}
+
+TakuMenuStore *
+taku_menu_store_new (void)
+{
+  TakuMenuStore *store;
+
+  store = g_slice_new0 (TakuMenuStore);
+  store->slots = g_ptr_array_new ();
+  store->free_slots = g_array_new (FALSE, FALSE, sizeof (guint));
+  store->by_path = g_hash_table_new (path_hash, path_equal);
+  store->by_id = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  return store;
+}
+
+/* Frees the store, but not the items in it */
+void
+taku_menu_store_free (TakuMenuStore *store)
+{
+  g_return_if_fail (store);
+
+  g_ptr_array_free (store->slots, TRUE);
+  g_array_free (store->free_slots, TRUE);
+  g_hash_table_destroy (store->by_path);
+  g_hash_table_destroy (store->by_id);
+  g_list_free (store->list);
+
+  g_slice_free (TakuMenuStore, store);
+}
+
+/*
+ * The applications/ data directories in order of precedence, the user's first,
+ * each with a trailing separator.
+ */
+static char **
+get_roots (void)
+{
+  static gsize initialised = 0;
+  static char **roots;
+
+  if (g_once_init_enter (&initialised)) {
+    const gchar * const *dirs = g_get_system_data_dirs ();
+    guint i, n = g_strv_length ((char **) dirs);
+
+    roots = g_new0 (char *, n + 2);
+    roots[0] = g_build_filename (g_get_user_data_dir (),
+                                 "applications", G_DIR_SEPARATOR_S, NULL);
+    for (i = 0; i < n; i++)
+      roots[i + 1] = g_build_filename (dirs[i],
+                                       "applications", G_DIR_SEPARATOR_S, NULL);
+
+    g_once_init_leave (&initialised, 1);
+  }
+
+  return roots;
+}
+
+/*
+ * The desktop file ID of @path, as in the Desktop Entry Specification: the path
+ * below an applications/ data directory, with / replaced by -.  If @rank isn't
+ * NULL it is set to the precedence of that directory, lower is more important,
+ * or G_MAXUINT if @path isn't in one.
+ */
+char *
+taku_menu_get_desktop_id (const char *path, guint *rank)
+{
+  const char *relative = NULL;
+  char **roots, *id, *p;
+  guint i;
+
+  g_return_val_if_fail (path, NULL);
+
+  roots = get_roots ();
+
+  for (i = 0; roots[i]; i++) {
+    if (g_str_has_prefix (path, roots[i])) {
+      relative = path + strlen (roots[i]);
+      break;
+    }
+  }
+
+  if (rank)
+    *rank = relative ? i : G_MAXUINT;
+
+  /* Not in an applications/ directory, so just use the name */
+  if (relative == NULL) {
+    relative = strrchr (path, G_DIR_SEPARATOR);
+    relative = relative ? relative + 1 : path;
+  }
+
+  id = g_strdup (relative);
+  for (p = id; *p; p++) {
+    if (*p == G_DIR_SEPARATOR)
+      *p = '-';
+  }
+
+  return id;
+}
+
+/*
+ * Look for a desktop file with the ID @desktop_id in the applications/
+ * directories of precedence @rank and lower.  Only files directly in those
+ * directories are found, as the - in an ID could also have been a /.  Returns
+ * the path, which should be freed, or NULL.
+ */
+char *
+taku_menu_find_desktop_file (const char *desktop_id, guint rank)
+{
+  char **roots, *path;
+  guint i;
+
+  g_return_val_if_fail (desktop_id, NULL);
+
+  roots = get_roots ();
+
+  for (i = 0; roots[i]; i++) {
+    if (i < rank)
+      continue;
+
+    path = g_strconcat (roots[i], desktop_id, NULL);
+    if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+      return path;
+    g_free (path);
+  }
+
+  return NULL;
+}
+
+/*
+ * Add @item to the store, returning its index or TAKU_MENU_STORE_INVALID if
+ * there is already an item for the same path.
+ */
+guint
+taku_menu_store_add (TakuMenuStore *store, TakuMenuItem *item)
+{
+  char *path, *id;
+
+  g_return_val_if_fail (store, TAKU_MENU_STORE_INVALID);
+  g_return_val_if_fail (item, TAKU_MENU_STORE_INVALID);
+
+  if (g_hash_table_lookup (store->by_path, item))
+    return TAKU_MENU_STORE_INVALID;
+
+  if (store->free_slots->len) {
+    item->index = g_array_index (store->free_slots, guint,
+                                 store->free_slots->len - 1);
+    g_array_set_size (store->free_slots, store->free_slots->len - 1);
+    g_ptr_array_index (store->slots, item->index) = item;
+  } else {
+    item->index = store->slots->len;
+    g_ptr_array_add (store->slots, item);
+  }
+  store->n_items++;
+
+  g_hash_table_add (store->by_path, item);
+
+  path = taku_menu_item_dup_path (item);
+  id = taku_menu_get_desktop_id (path, NULL);
+  g_free (path);
+  if (g_hash_table_lookup (store->by_id, id))
+    g_free (id);
+  else
+    g_hash_table_insert (store->by_id, id, item);
+
+  store->list_valid = FALSE;
+
+  return item->index;
+}
+
+/* Remove @item from the store, returning FALSE if it wasn't in it */
+gboolean
+taku_menu_store_remove (TakuMenuStore *store, TakuMenuItem *item)
+{
+  char *path, *id;
+
+  g_return_val_if_fail (store, FALSE);
+  g_return_val_if_fail (item, FALSE);
+
+  if (item->index >= store->slots->len ||
+      g_ptr_array_index (store->slots, item->index) != item)
+    return FALSE;
+
+  g_ptr_array_index (store->slots, item->index) = NULL;
+  g_array_append_val (store->free_slots, item->index);
+  store->n_items--;
+
+  g_hash_table_remove (store->by_path, item);
+
+  path = taku_menu_item_dup_path (item);
+  id = taku_menu_get_desktop_id (path, NULL);
+  g_free (path);
+  if (g_hash_table_lookup (store->by_id, id) == item)
+    g_hash_table_remove (store->by_id, id);
+  g_free (id);
+
+  item->index = TAKU_MENU_STORE_INVALID;
+  store->list_valid = FALSE;
+
+  return TRUE;
+}
+
+guint
+taku_menu_store_get_n_items (TakuMenuStore *store)
+{
+  g_return_val_if_fail (store, 0);
+
+  return store->n_items;
+}
+
+/* Returns the item at @index, or NULL if the slot is empty */
+TakuMenuItem *
+taku_menu_store_get (TakuMenuStore *store, guint index)
+{
+  g_return_val_if_fail (store, NULL);
+
+  if (index >= store->slots->len)
+    return NULL;
+
+  return g_ptr_array_index (store->slots, index);
+}
+
+TakuMenuItem *
+taku_menu_store_lookup_path (TakuMenuStore *store, const char *path)
+{
+  TakuMenuItem key;
+
+  g_return_val_if_fail (store, NULL);
+  g_return_val_if_fail (path, NULL);
+
+  /* If the arena has never seen the path, no item can have it */
+  if (!taku_string_arena_lookup_path (path, &key.dir, &key.basename))
+    return NULL;
+
+  return g_hash_table_lookup (store->by_path, &key);
+}
+
+TakuMenuItem *
+taku_menu_store_lookup_id (TakuMenuStore *store, const char *desktop_id)
+{
+  g_return_val_if_fail (store, NULL);
+  g_return_val_if_fail (desktop_id, NULL);
+
+  return g_hash_table_lookup (store->by_id, desktop_id);
+}
+
+/*
+ * Returns the items in index order.  The list is owned by the store and is only
+ * valid until the store is next changed.
+ */
+GList *
+taku_menu_store_get_list (TakuMenuStore *store)
+{
+  guint i;
+
+  g_return_val_if_fail (store, NULL);
+
+  if (store->list_valid)
+    return store->list;
+
+  g_list_free (store->list);
+  store->list = NULL;
+
+  for (i = store->slots->len; i > 0; i--) {
+    TakuMenuItem *item = g_ptr_array_index (store->slots, i - 1);
+
+    if (item)
+      store->list = g_list_prepend (store->list, item);
+  }
+  store->list_valid = TRUE;
+
+  return store->list;
+}
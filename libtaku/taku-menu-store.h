@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_MENU_STORE_H
+#define HAVE_TAKU_MENU_STORE_H
+
+#include <glib.h>
+
+#include "taku-menu-private.h"
+
+G_BEGIN_DECLS
+
+/*
+ * The items of a menu.  Every item gets an index which doesn't change while it
+ * is in the store, and can be found by path or desktop file ID.
+ */
+typedef struct _TakuMenuStore TakuMenuStore;
+
+#define TAKU_MENU_STORE_INVALID G_MAXUINT
+
+TakuMenuStore *taku_menu_store_new (void);
+void taku_menu_store_free (TakuMenuStore *store);
+
+guint taku_menu_store_add (TakuMenuStore *store, TakuMenuItem *item);
+gboolean taku_menu_store_remove (TakuMenuStore *store, TakuMenuItem *item);
+
+guint taku_menu_store_get_n_items (TakuMenuStore *store);
+TakuMenuItem *taku_menu_store_get (TakuMenuStore *store, guint index);
+TakuMenuItem *taku_menu_store_lookup_path (TakuMenuStore *store,
+                                           const char    *path);
+TakuMenuItem *taku_menu_store_lookup_id (TakuMenuStore *store,
+                                         const char    *desktop_id);
+
+GList *taku_menu_store_get_list (TakuMenuStore *store);
+
+char *taku_menu_get_desktop_id (const char *path, guint *rank);
+char *taku_menu_find_desktop_file (const char *desktop_id, guint rank);
+
+G_END_DECLS
+
+#endif
@@ -62,10 +62,10 @@ struct _TakuMenuClass
   /* signals */
   void (*item_added) (TakuMenu *menu, TakuMenuItem *item);
   void (*item_removed) (TakuMenu *menu, TakuMenuItem *item);
+  void (*loaded) (TakuMenu *menu);
+  void (*progress) (TakuMenu *menu, guint n_loaded, guint n_found);
   
   /* future padding */
-  void (*_taku_menu_1) (void);
-  void (*_taku_menu_2) (void);
   void (*_taku_menu_3) (void);
   void (*_taku_menu_4) (void);
 };
@@ -75,11 +75,22 @@ GType taku_menu_get_type (void) G_GNUC_CONST;
 /*< Menu functions />*/
 
 /* 
- * Expected to create a list of TakuTakuCategorys and TakuMenuItems 
+ * Expected to create a list of TakuTakuCategorys, the TakuMenuItems are
+ * loaded by taku_menu_load_async()
  */
 TakuMenu*
 taku_menu_get_default (void);
 
+/*
+ * Starts loading the TakuMenuItems, announcing them with item-added and
+ * emitting loaded when done
+ */
+void
+taku_menu_load_async (TakuMenu *menu, GCancellable *cancellable);
+
+gboolean
+taku_menu_is_loaded (TakuMenu *menu);
+
 /* 
  * Returns a list of TakuTakuCategorys 
  */
@@ -87,20 +98,49 @@ GList*
 taku_menu_get_categories (TakuMenu *menu);
 
 /* 
- * Returns a list of TakuMenuItems 
+ * Returns a list of the TakuMenuItems loaded so far, the rest are announced
+ * with item-added as they are loaded.  The list is owned by the menu and only
+ * valid until the next item-added or item-removed; don't free or keep it.
  */
 GList*
 taku_menu_get_items (TakuMenu *menu);
 
+/* What the last sweep of the application directories cost */
+typedef struct {
+  /* Directory entries read, and the opens and stats made for them */
+  guint n_entries;
+  guint n_opens;
+  guint n_stats;
+  /* Directories which hadn't changed, so weren't read */
+  guint n_unchanged;
+  /* Desktop files which weren't in the cache, so were opened and parsed */
+  guint n_parsed;
+} TakuMenuScanStats;
+
+void
+taku_menu_get_scan_stats (TakuMenu *menu, TakuMenuScanStats *stats);
+
 
 /*< MenuItem functions />*/
 
+TakuMenuItem*
+taku_menu_item_ref (TakuMenuItem *item);
+
+void
+taku_menu_item_unref (TakuMenuItem *item);
+
 const gchar*
 taku_menu_item_get_name (TakuMenuItem *item);
 
 const gchar*
 taku_menu_item_get_description (TakuMenuItem *item);
 
+const gchar*
+taku_menu_item_get_collation_key (TakuMenuItem *item);
+
+const gchar*
+taku_menu_item_get_icon_name (TakuMenuItem *item);
+
 GdkPixbuf*
 taku_menu_item_get_icon (TakuMenuItem *item, 
                          int           size);
@@ -108,6 +148,9 @@ taku_menu_item_get_icon (TakuMenuItem *item,
 GList*
 taku_menu_item_get_categories (TakuMenuItem *item);
 
+guint64
+taku_menu_item_get_category_bits (TakuMenuItem *item);
+
 gboolean
 taku_menu_item_launch (TakuMenuItem *item, GtkWidget *widget);
 
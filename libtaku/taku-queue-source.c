@@ -20,66 +20,205 @@
 #include <glib.h>
 #include "taku-queue-source.h"
 
-typedef struct {
-  GSource source;
-  GQueue *queue;
-} TakuQueueSource;
+/* Microseconds of work to do per main loop iteration */
+#define TIME_BUDGET 4000
+
+struct _TakuQueue {
+  gint priority;
+  TakuQueueFunc func;
+  gpointer user_data;
+  GDestroyNotify item_destroy;
+  GQueue items;
+};
+
+static GMutex lock;
+/* All of the queues, most urgent first */
+static GList *queues;
+/* The source running the queues, only attached while there is work */
+static GSource *queue_source;
+
+/* Called with the lock held */
+static TakuQueue *
+find_work (void)
+{
+  GList *l;
+
+  for (l = queues; l; l = l->next) {
+    TakuQueue *queue = l->data;
+
+    if (!g_queue_is_empty (&queue->items))
+      return queue;
+  }
+
+  return NULL;
+}
+
+static gboolean
+has_work (void)
+{
+  gboolean ready;
+
+  g_mutex_lock (&lock);
+  ready = find_work () != NULL;
+  g_mutex_unlock (&lock);
+
+  return ready;
+}
 
 static gboolean 
 prepare (GSource *source, gint *timeout)
 {
-  TakuQueueSource *queue_source = (TakuQueueSource*)source;
   *timeout = -1;
-  return !g_queue_is_empty (queue_source->queue);
+  return has_work ();
 }
 
 static gboolean 
 check (GSource *source)
 {
-  TakuQueueSource *queue_source = (TakuQueueSource*)source;
-  return !g_queue_is_empty (queue_source->queue);
+  return has_work ();
 }
 
 static gboolean
 dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
 {
-  if (!callback) {
-    g_warning ("Queue source dispatched without callback\n"
-               "You must call g_source_set_callback().");
+  gint64 deadline;
+  TakuQueue *queue;
+  TakuQueueFunc func;
+  gpointer item, data;
+
+  deadline = g_get_monotonic_time () + TIME_BUDGET;
+
+  /* Always do at least one item, however long it takes */
+  do {
+    g_mutex_lock (&lock);
+
+    queue = find_work ();
+    if (queue == NULL) {
+      /* Go away until there is something to do */
+      queue_source = NULL;
+      g_mutex_unlock (&lock);
+      return FALSE;
+    }
+
+    item = g_queue_pop_head (&queue->items);
+    func = queue->func;
+    data = queue->user_data;
+
+    g_mutex_unlock (&lock);
+
+    func (item, data);
+  } while (g_get_monotonic_time () < deadline);
+
+  /* Out of time, but if that was the last item there is nothing to come back
+     for.  Staying attached would leave pushes from other threads waiting for
+     something else to wake the main loop. */
+  g_mutex_lock (&lock);
+  if (find_work () == NULL) {
+    queue_source = NULL;
+    g_mutex_unlock (&lock);
     return FALSE;
   }
-  
-  return callback (user_data);
+  g_mutex_unlock (&lock);
+
+  return TRUE;
 }
 
 static GSourceFuncs funcs = {
   prepare, check, dispatch, NULL
 };
 
+static gint
+compare_queues (gconstpointer a, gconstpointer b)
+{
+  const TakuQueue *qa = a, *qb = b;
+
+  return qa->priority - qb->priority;
+}
+
 /**
- * taku_idle_queue_add:
- * @queue: the #GQueue to watch
- * @function: the #GSourceFunc to call when @queue is not empty
- * @data: user data to pass to @function
+ * taku_queue_new:
+ * @priority: the priority of the queue, lower runs first
+ * @func: the #TakuQueueFunc to call for every item
+ * @user_data: user data to pass to @func
+ * @item_destroy: function to free items which are never handled, or %NULL
  *
- * Add a function to be called whenever @queue has items in.
+ * Make a new queue, whose items are passed to @func in the main loop.
  */
-guint
-taku_idle_queue_add (GQueue *queue, GSourceFunc function, gpointer data)
+TakuQueue *
+taku_queue_new (gint           priority,
+                TakuQueueFunc  func,
+                gpointer       user_data,
+                GDestroyNotify item_destroy)
 {
-  GSource *source;
-  TakuQueueSource *queue_source;
-  guint32 id;
+  TakuQueue *queue;
+
+  g_return_val_if_fail (func, NULL);
+
+  queue = g_slice_new0 (TakuQueue);
+  queue->priority = priority;
+  queue->func = func;
+  queue->user_data = user_data;
+  queue->item_destroy = item_destroy;
+  g_queue_init (&queue->items);
+
+  g_mutex_lock (&lock);
+  queues = g_list_insert_sorted (queues, queue, compare_queues);
+  g_mutex_unlock (&lock);
+
+  return queue;
+}
+
+/**
+ * taku_queue_free:
+ * @queue: a #TakuQueue
+ *
+ * Free @queue, and any items which are still waiting in it.
+ */
+void
+taku_queue_free (TakuQueue *queue)
+{
+  gpointer item;
+
+  g_return_if_fail (queue);
 
-  source = g_source_new (&funcs, sizeof (TakuQueueSource));
-  g_source_set_priority (source, G_PRIORITY_DEFAULT_IDLE);
+  g_mutex_lock (&lock);
+  queues = g_list_remove (queues, queue);
+  g_mutex_unlock (&lock);
 
-  queue_source = (TakuQueueSource*)source;
-  queue_source->queue = queue;
-  
-  g_source_set_callback (source, function, data, NULL);
-  id = g_source_attach (source, NULL);
-  g_source_unref (source);
+  while ((item = g_queue_pop_head (&queue->items))) {
+    if (queue->item_destroy)
+      queue->item_destroy (item);
+  }
+
+  g_slice_free (TakuQueue, queue);
+}
+
+/**
+ * taku_queue_push:
+ * @queue: a #TakuQueue
+ * @item: the item to add, which can't be %NULL
+ *
+ * Add @item to the end of @queue.  This can be called from any thread.
+ */
+void
+taku_queue_push (TakuQueue *queue, gpointer item)
+{
+  g_return_if_fail (queue);
+  g_return_if_fail (item);
+
+  g_mutex_lock (&lock);
+
+  g_queue_push_tail (&queue->items, item);
+
+  if (queue_source == NULL) {
+    queue_source = g_source_new (&funcs, sizeof (GSource));
+    g_source_set_priority (queue_source, G_PRIORITY_DEFAULT_IDLE);
+    g_source_attach (queue_source, NULL);
+    g_source_unref (queue_source);
+  } else {
+    /* The main loop may be asleep, having last seen every queue empty */
+    g_main_context_wakeup (NULL);
+  }
 
-  return id;
+  g_mutex_unlock (&lock);
 }
@@ -23,7 +23,31 @@
 
 G_BEGIN_DECLS
 
-guint taku_idle_queue_add (GQueue *queue, GSourceFunc function, gpointer data);
+/*
+ * Queues of work for the main loop.  All of the queues are run from one idle
+ * source, most urgent queue first, for a few milliseconds per main loop
+ * iteration so that input and painting are never held up for long.  When every
+ * queue is empty the source is removed, so nothing wakes the main loop.  Items
+ * can be pushed from any thread, and are always handled in the main thread.
+ */
+
+typedef struct _TakuQueue TakuQueue;
+
+/* Handle one item taken from a queue */
+typedef void (*TakuQueueFunc) (gpointer item, gpointer user_data);
+
+/* Queues with lower priorities are run first */
+#define TAKU_QUEUE_PRIORITY_HIGH 0
+#define TAKU_QUEUE_PRIORITY_DEFAULT 100
+#define TAKU_QUEUE_PRIORITY_LOW 200
+
+TakuQueue *taku_queue_new (gint           priority,
+                           TakuQueueFunc  func,
+                           gpointer       user_data,
+                           GDestroyNotify item_destroy);
+void taku_queue_free (TakuQueue *queue);
+
+void taku_queue_push (TakuQueue *queue, gpointer item);
 
 G_END_DECLS
 
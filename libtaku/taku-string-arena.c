@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib.h>
+
+#include "taku-string-arena.h"
+
+/* Size of the chunks strings are packed into.  Strings longer than half of
+   that get a chunk of their own. */
+#define CHUNK_SIZE 4096
+
+/* A block of strings, freed once none of them is referenced */
+typedef struct {
+  /* Strings in the chunk which are still referenced */
+  guint n_live;
+  gsize size;
+  gsize used;
+  char data[1];
+} Chunk;
+
+/* A string in a chunk, which is found from the string's offset in it */
+typedef struct {
+  guint32 ref_count;
+  guint32 offset;
+  char str[1];
+} Stored;
+
+#define STORED(s) ((Stored *) ((char *) (s) - G_STRUCT_OFFSET (Stored, str)))
+#define STORED_CHUNK(stored) \
+  ((Chunk *) ((char *) (stored) - (stored)->offset \
+              - G_STRUCT_OFFSET (Chunk, data)))
+
+static GMutex arena_lock;
+/* Stored string -> itself */
+static GHashTable *strings;
+/* The chunk new strings go into */
+static Chunk *current;
+/* Directory ids index this, and the hash maps the stored string to id + 1 */
+static GPtrArray *dirs;
+static GHashTable *dir_ids;
+static TakuStringArenaStats stats;
+
+/* Called with the lock held */
+static void
+ensure_arena (void)
+{
+  if (strings)
+    return;
+
+  strings = g_hash_table_new (g_str_hash, g_str_equal);
+  dirs = g_ptr_array_new ();
+  dir_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+/* Called with the lock held */
+static Chunk *
+chunk_new (gsize size)
+{
+  Chunk *chunk;
+
+  chunk = g_malloc (G_STRUCT_OFFSET (Chunk, data) + size);
+  chunk->n_live = 0;
+  chunk->size = size;
+  chunk->used = 0;
+
+  stats.n_chunks++;
+  stats.chunk_bytes += size;
+
+  return chunk;
+}
+
+/* Called with the lock held */
+static void
+chunk_free (Chunk *chunk)
+{
+  stats.n_chunks--;
+  stats.chunk_bytes -= chunk->size;
+  g_free (chunk);
+}
+
+/* Called with the lock held.  Copies the @size - 1 bytes of @s into a chunk,
+   with a nul after them. */
+static char *
+store (const char *s, gsize size)
+{
+  Stored *stored;
+  Chunk *chunk;
+  gsize needed;
+
+  /* Keep the headers aligned */
+  needed = (G_STRUCT_OFFSET (Stored, str) + size + 3) & ~(gsize) 3;
+
+  if (needed > CHUNK_SIZE / 2) {
+    /* Rather than waste the rest of the current chunk */
+    chunk = chunk_new (needed);
+  } else {
+    /* The old chunk goes when its last string does */
+    if (current == NULL || current->size - current->used < needed)
+      current = chunk_new (CHUNK_SIZE);
+    chunk = current;
+  }
+
+  stored = (Stored *) (chunk->data + chunk->used);
+  stored->ref_count = 1;
+  stored->offset = chunk->used;
+  memcpy (stored->str, s, size - 1);
+  stored->str[size - 1] = '\0';
+
+  chunk->used += needed;
+  chunk->n_live++;
+
+  return stored->str;
+}
+
+/* Called with the lock held.  Finds the stored copy of the first @length bytes
+   of @s, or all of it if @length is negative. */
+static char *
+lookup_len (const char *s, gssize length)
+{
+  char *copy;
+
+  ensure_arena ();
+
+  if (length < 0)
+    return g_hash_table_lookup (strings, s);
+
+  copy = g_alloca (length + 1);
+  memcpy (copy, s, length);
+  copy[length] = '\0';
+
+  return g_hash_table_lookup (strings, copy);
+}
+
+/* Called with the lock held */
+static const char *
+intern_len (const char *s, gssize length)
+{
+  char *stored;
+  gsize size;
+
+  size = (length < 0 ? strlen (s) : (gsize) length) + 1;
+
+  stored = lookup_len (s, length);
+  if (stored) {
+    STORED (stored)->ref_count++;
+    stats.n_shared++;
+    stats.bytes_saved += size;
+    return stored;
+  }
+
+  stored = store (s, size);
+  g_hash_table_add (strings, stored);
+  stats.n_strings++;
+  stats.bytes += size;
+
+  return stored;
+}
+
+/*
+ * Returns the stored copy of @s with a new reference to it, adding it if
+ * needed.  The result can be compared by pointer with other interned strings,
+ * and stays valid until it is passed to taku_string_arena_release().
+ */
+const char *
+taku_string_arena_intern (const char *s)
+{
+  const char *stored;
+
+  if (s == NULL)
+    return NULL;
+
+  g_mutex_lock (&arena_lock);
+  stored = intern_len (s, -1);
+  g_mutex_unlock (&arena_lock);
+
+  return stored;
+}
+
+/*
+ * Drop a reference to @s, which was returned by taku_string_arena_intern() or
+ * as the basename of taku_string_arena_add_path().  @s may be NULL.
+ */
+void
+taku_string_arena_release (const char *s)
+{
+  Stored *stored;
+  Chunk *chunk;
+  gsize size;
+
+  if (s == NULL)
+    return;
+
+  stored = STORED (s);
+  size = strlen (s) + 1;
+
+  g_mutex_lock (&arena_lock);
+
+  if (--stored->ref_count > 0) {
+    stats.n_shared--;
+    stats.bytes_saved -= size;
+    g_mutex_unlock (&arena_lock);
+    return;
+  }
+
+  g_hash_table_remove (strings, s);
+  stats.n_strings--;
+  stats.bytes -= size;
+
+  /* The current chunk is reused from the start once it is empty */
+  chunk = STORED_CHUNK (stored);
+  if (--chunk->n_live == 0) {
+    if (chunk == current)
+      chunk->used = 0;
+    else
+      chunk_free (chunk);
+  }
+
+  g_mutex_unlock (&arena_lock);
+}
+
+/* Split @path at the last separator, the directory part may be empty */
+static const char *
+split_path (const char *path, gssize *dir_length)
+{
+  const char *slash;
+
+  slash = strrchr (path, G_DIR_SEPARATOR);
+  if (slash == NULL) {
+    *dir_length = 0;
+    return path;
+  }
+
+  *dir_length = slash - path;
+  return slash + 1;
+}
+
+/*
+ * Store @path, returning the id of its directory in @dir and the stored file
+ * name, with a reference, in @basename.  Directories are few, so they are
+ * kept for the life of the process.
+ */
+void
+taku_string_arena_add_path (const char  *path,
+                            guint       *dir,
+                            const char **basename)
+{
+  const char *name, *stored;
+  gssize dir_length;
+  gpointer id;
+
+  g_return_if_fail (path);
+  g_return_if_fail (dir);
+  g_return_if_fail (basename);
+
+  name = split_path (path, &dir_length);
+
+  g_mutex_lock (&arena_lock);
+
+  /* A known directory isn't another reference to it */
+  stored = lookup_len (path, dir_length);
+  id = stored ? g_hash_table_lookup (dir_ids, stored) : NULL;
+  if (id == NULL) {
+    /* The directory list keeps the reference */
+    stored = intern_len (path, dir_length);
+    g_ptr_array_add (dirs, (gpointer) stored);
+    id = GUINT_TO_POINTER (dirs->len);
+    g_hash_table_insert (dir_ids, (gpointer) stored, id);
+    stats.n_dirs++;
+  }
+
+  *dir = GPOINTER_TO_UINT (id) - 1;
+  *basename = intern_len (name, -1);
+
+  g_mutex_unlock (&arena_lock);
+}
+
+/*
+ * Like taku_string_arena_add_path(), but returns FALSE instead of storing
+ * anything if @path hasn't been stored before.
+ */
+gboolean
+taku_string_arena_lookup_path (const char  *path,
+                               guint       *dir,
+                               const char **basename)
+{
+  const char *name, *stored;
+  char *dirname;
+  gssize dir_length;
+  gpointer id = NULL;
+
+  g_return_val_if_fail (path, FALSE);
+  g_return_val_if_fail (dir, FALSE);
+  g_return_val_if_fail (basename, FALSE);
+
+  *basename = NULL;
+
+  name = split_path (path, &dir_length);
+  dirname = g_alloca (dir_length + 1);
+  memcpy (dirname, path, dir_length);
+  dirname[dir_length] = '\0';
+
+  g_mutex_lock (&arena_lock);
+
+  if (strings) {
+    stored = g_hash_table_lookup (strings, dirname);
+    if (stored)
+      id = g_hash_table_lookup (dir_ids, stored);
+    *basename = g_hash_table_lookup (strings, name);
+  }
+
+  g_mutex_unlock (&arena_lock);
+
+  if (id == NULL || *basename == NULL)
+    return FALSE;
+
+  *dir = GPOINTER_TO_UINT (id) - 1;
+  return TRUE;
+}
+
+/* Returns the path made from @dir and @basename, which should be freed */
+char *
+taku_string_arena_build_path (guint dir, const char *basename)
+{
+  const char *dirname = NULL;
+
+  g_return_val_if_fail (basename, NULL);
+
+  g_mutex_lock (&arena_lock);
+  if (dirs && dir < dirs->len)
+    dirname = g_ptr_array_index (dirs, dir);
+  g_mutex_unlock (&arena_lock);
+
+  g_return_val_if_fail (dirname, NULL);
+
+  return g_strconcat (dirname, G_DIR_SEPARATOR_S, basename, NULL);
+}
+
+void
+taku_string_arena_get_stats (TakuStringArenaStats *out)
+{
+  g_return_if_fail (out);
+
+  g_mutex_lock (&arena_lock);
+  *out = stats;
+  g_mutex_unlock (&arena_lock);
+}
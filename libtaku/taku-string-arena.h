@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef HAVE_TAKU_STRING_ARENA_H
+#define HAVE_TAKU_STRING_ARENA_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Storage for the strings of menu items.  Strings are packed one after another
+ * into large chunks, and are interned and reference counted so the many items
+ * sharing an icon name or a Categories line only store it once.  A chunk is
+ * freed when the last string in it is released.  Paths are split into an
+ * interned directory, known by a small id, and the file name.  All of these
+ * functions can be called from any thread.
+ */
+
+typedef struct {
+  /* Strings stored now, and the bytes they use */
+  guint n_strings;
+  gsize bytes;
+  /* References to strings which were already stored, and the bytes they would
+     have used as copies */
+  guint n_shared;
+  gsize bytes_saved;
+  /* Chunks held, and their size including space freed strings left behind */
+  guint n_chunks;
+  gsize chunk_bytes;
+  /* Distinct directories */
+  guint n_dirs;
+} TakuStringArenaStats;
+
+const char *taku_string_arena_intern (const char *s);
+void taku_string_arena_release (const char *s);
+
+void taku_string_arena_add_path (const char  *path,
+                                 guint       *dir,
+                                 const char **basename);
+gboolean taku_string_arena_lookup_path (const char  *path,
+                                        guint       *dir,
+                                        const char **basename);
+char *taku_string_arena_build_path (guint dir, const char *basename);
+
+void taku_string_arena_get_stats (TakuStringArenaStats *stats);
+
+G_END_DECLS
+
+#endif
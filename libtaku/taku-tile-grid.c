@@ -0,0 +1,1040 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "taku-tile-grid.h"
+#include "taku-launcher-tile.h"
+
+G_DEFINE_TYPE_WITH_CODE (TakuTileGrid, taku_tile_grid, GTK_TYPE_CONTAINER,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_SCROLLABLE, NULL));
+
+#define GET_PRIVATE(o) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((o), TAKU_TYPE_TILE_GRID, TakuTileGridPrivate))
+
+#define ROW_SPACING 6
+#define COLUMN_SPACING 6
+/* Narrowest a column may be, which sets how many fit across */
+#define MIN_CELL_WIDTH 200
+/* Rows of tiles kept either side of the view, so scrolling a little doesn't
+   have to rebind anything */
+#define MARGIN_ROWS 2
+/* Batches up to this size are inserted an item at a time, rather than merged */
+#define SMALL_BATCH 16
+
+struct _TakuTileGridPrivate
+{
+  GtkAdjustment *hadjustment, *vadjustment;
+  guint hscroll_policy : 1;
+  guint vscroll_policy : 1;
+
+  /* All of the TakuMenuItems, in collation order, and where each one is in
+     the sequence so that they can be found without a search.  The sequence is
+     a balanced tree, so items are also found by index in O(log n) and adding
+     or removing one doesn't touch the others */
+  GSequence *items;
+  GHashTable *iters;
+
+  /* The recycled tiles.  Item i is in tiles[i % tiles->len], for i from first
+     for as many tiles as there are */
+  GPtrArray *tiles;
+  guint first;
+
+  int columns;
+  int cell_width, cell_height;
+
+  /* The selected item, and the one a button was pressed on */
+  TakuMenuItem *cursor;
+  TakuMenuItem *pressed;
+};
+
+enum {
+  PROP_0,
+  PROP_HADJUSTMENT,
+  PROP_VADJUSTMENT,
+  PROP_HSCROLL_POLICY,
+  PROP_VSCROLL_POLICY
+};
+
+enum {
+  CHILD_ACTIVATED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+static int
+compare_items (gconstpointer pa, gconstpointer pb, gpointer user_data)
+{
+  TakuMenuItem *a = (TakuMenuItem *) pa, *b = (TakuMenuItem *) pb;
+  const char *ka, *kb;
+
+  ka = taku_menu_item_get_collation_key (a);
+  kb = taku_menu_item_get_collation_key (b);
+
+  if (ka != NULL && kb == NULL)
+    return 1;
+  else if (ka == NULL && kb != NULL)
+    return -1;
+  else if (ka == NULL && kb == NULL)
+    return 0;
+  else
+    return strcmp (ka, kb);
+}
+
+static int
+get_n_items (TakuTileGrid *grid)
+{
+  return g_sequence_get_length (grid->priv->items);
+}
+
+/* The item at @index, which must be in range */
+static TakuMenuItem *
+get_item (TakuTileGrid *grid, int index)
+{
+  return g_sequence_get (g_sequence_get_iter_at_pos (grid->priv->items, index));
+}
+
+static int
+get_row_height (TakuTileGrid *grid)
+{
+  return grid->priv->cell_height + ROW_SPACING;
+}
+
+static double
+get_scroll (TakuTileGrid *grid)
+{
+  if (grid->priv->vadjustment == NULL)
+    return 0.0;
+
+  return gtk_adjustment_get_value (grid->priv->vadjustment);
+}
+
+/*
+ * Index of the selected item, or -1.  The sequence knows the position
+ * of its iter, so this doesn't walk the items.
+ */
+static int
+get_cursor_index (TakuTileGrid *grid)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  GSequenceIter *iter;
+
+  if (priv->cursor == NULL)
+    return -1;
+
+  iter = g_hash_table_lookup (priv->iters, priv->cursor);
+
+  return iter ? g_sequence_iter_get_position (iter) : -1;
+}
+
+/* The tile showing item @index, or NULL if it isn't bound */
+static TakuLauncherTile *
+get_tile (TakuTileGrid *grid, int index)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  TakuLauncherTile *tile;
+
+  if (index < 0 || priv->tiles->len == 0 ||
+      (guint) index < priv->first ||
+      (guint) index >= priv->first + priv->tiles->len ||
+      index >= get_n_items (grid))
+    return NULL;
+
+  tile = g_ptr_array_index (priv->tiles, index % priv->tiles->len);
+  if (taku_launcher_tile_get_item (tile) != get_item (grid, index))
+    return NULL;
+
+  return tile;
+}
+
+/* Index of the item at @x, @y in the window, or -1 */
+static int
+get_index_at (TakuTileGrid *grid, double x, double y)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  int row, column, index;
+
+  if (priv->columns == 0 || priv->cell_height == 0)
+    return -1;
+
+  y += get_scroll (grid);
+  if (x < 0 || y < 0)
+    return -1;
+
+  row = y / get_row_height (grid);
+  column = x / (priv->cell_width + COLUMN_SPACING);
+
+  /* In the gaps between tiles */
+  if (y - row * get_row_height (grid) >= priv->cell_height ||
+      x - column * (priv->cell_width + COLUMN_SPACING) >= priv->cell_width)
+    return -1;
+
+  index = row * priv->columns + column;
+  if (column >= priv->columns || index >= get_n_items (grid))
+    return -1;
+
+  return index;
+}
+
+static void
+update_selection (TakuTileGrid *grid)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  guint i;
+
+  for (i = 0; i < priv->tiles->len; i++) {
+    GtkWidget *tile = g_ptr_array_index (priv->tiles, i);
+
+    if (priv->cursor &&
+        taku_launcher_tile_get_item (TAKU_LAUNCHER_TILE (tile)) == priv->cursor)
+      gtk_widget_set_state_flags (tile, GTK_STATE_FLAG_SELECTED, FALSE);
+    else
+      gtk_widget_unset_state_flags (tile, GTK_STATE_FLAG_SELECTED);
+  }
+
+  gtk_widget_queue_draw (GTK_WIDGET (grid));
+}
+
+/* Select item @index and scroll it into view */
+static void
+set_cursor (TakuTileGrid *grid, int index)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+
+  priv->cursor = get_item (grid, index);
+
+  if (priv->vadjustment && priv->columns) {
+    int y = (index / priv->columns) * get_row_height (grid);
+
+    gtk_adjustment_clamp_page (priv->vadjustment, y, y + priv->cell_height);
+  }
+
+  update_selection (grid);
+}
+
+static void
+activate_cursor (TakuTileGrid *grid)
+{
+  TakuLauncherTile *tile;
+
+  tile = get_tile (grid, get_cursor_index (grid));
+  if (tile)
+    g_signal_emit (grid, signals[CHILD_ACTIVATED], 0, tile);
+}
+
+static void
+on_value_changed (GtkAdjustment *adjustment, TakuTileGrid *grid)
+{
+  /* Rebinding and placing the tiles is done by the allocation, and scrolling
+     doesn't change the size the grid wants */
+  gtk_widget_queue_allocate (GTK_WIDGET (grid));
+}
+
+static void
+configure_adjustments (TakuTileGrid *grid)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  GtkAllocation allocation;
+  int rows, height;
+
+  gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+
+  if (priv->hadjustment)
+    gtk_adjustment_configure (priv->hadjustment, 0, 0, allocation.width,
+                              allocation.width * 0.1, allocation.width * 0.9,
+                              allocation.width);
+
+  if (priv->vadjustment == NULL)
+    return;
+
+  rows = priv->columns ? (get_n_items (grid) + priv->columns - 1) / priv->columns : 0;
+  height = MAX (rows * get_row_height (grid) - ROW_SPACING, allocation.height);
+
+  /* This is done while allocating, so don't queue another allocation */
+  g_signal_handlers_block_by_func (priv->vadjustment, on_value_changed, grid);
+  gtk_adjustment_configure (priv->vadjustment,
+                            CLAMP (gtk_adjustment_get_value (priv->vadjustment),
+                                   0, height - allocation.height),
+                            0, height,
+                            get_row_height (grid), allocation.height * 0.9,
+                            allocation.height);
+  g_signal_handlers_unblock_by_func (priv->vadjustment, on_value_changed, grid);
+}
+
+static void
+set_hadjustment (TakuTileGrid *grid, GtkAdjustment *adjustment)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+
+  if (adjustment && adjustment == priv->hadjustment)
+    return;
+
+  if (priv->hadjustment)
+    g_object_unref (priv->hadjustment);
+
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new (0, 0, 0, 0, 0, 0);
+  priv->hadjustment = g_object_ref_sink (adjustment);
+
+  configure_adjustments (grid);
+  g_object_notify (G_OBJECT (grid), "hadjustment");
+}
+
+static void
+set_vadjustment (TakuTileGrid *grid, GtkAdjustment *adjustment)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+
+  if (adjustment && adjustment == priv->vadjustment)
+    return;
+
+  if (priv->vadjustment) {
+    g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                          on_value_changed, grid);
+    g_object_unref (priv->vadjustment);
+  }
+
+  if (adjustment == NULL)
+    adjustment = gtk_adjustment_new (0, 0, 0, 0, 0, 0);
+  priv->vadjustment = g_object_ref_sink (adjustment);
+  g_signal_connect (adjustment, "value-changed",
+                    G_CALLBACK (on_value_changed), grid);
+
+  configure_adjustments (grid);
+  g_object_notify (G_OBJECT (grid), "vadjustment");
+}
+
+static void
+add_tile (TakuTileGrid *grid)
+{
+  GtkWidget *tile;
+
+  tile = taku_launcher_tile_new ();
+  g_ptr_array_add (grid->priv->tiles, tile);
+  gtk_widget_set_parent (tile, GTK_WIDGET (grid));
+  gtk_widget_show (tile);
+}
+
+/* Make or drop tiles so there are @n_tiles */
+static void
+resize_pool (TakuTileGrid *grid, guint n_tiles)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+
+  while (priv->tiles->len < n_tiles)
+    add_tile (grid);
+
+  while (priv->tiles->len > n_tiles) {
+    GtkWidget *tile;
+
+    tile = g_ptr_array_index (priv->tiles, priv->tiles->len - 1);
+    g_ptr_array_set_size (priv->tiles, priv->tiles->len - 1);
+    gtk_widget_unparent (tile);
+  }
+}
+
+/* Work out the columns and the size of a tile, which are all the same */
+static void
+measure_cells (TakuTileGrid *grid, int width)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  GtkWidget *tile;
+  int min_width;
+
+  priv->columns = priv->cell_width = priv->cell_height = 0;
+
+  if (get_n_items (grid) == 0)
+    return;
+
+  /* Measure with a real item, so the labels aren't empty */
+  if (priv->tiles->len == 0)
+    resize_pool (grid, 1);
+  tile = g_ptr_array_index (priv->tiles, 0);
+  if (taku_launcher_tile_get_item (TAKU_LAUNCHER_TILE (tile)) == NULL)
+    taku_launcher_tile_set_item (TAKU_LAUNCHER_TILE (tile),
+                                 g_sequence_get (g_sequence_get_begin_iter
+                                                 (priv->items)));
+
+  gtk_widget_get_preferred_width (tile, &min_width, NULL);
+  min_width = MAX (min_width, MIN_CELL_WIDTH);
+
+  priv->columns = MAX (1, (width + COLUMN_SPACING) / (min_width + COLUMN_SPACING));
+  priv->cell_width = MAX (1, (width - (priv->columns - 1) * COLUMN_SPACING) / priv->columns);
+  gtk_widget_get_preferred_height_for_width (tile, priv->cell_width,
+                                             NULL, &priv->cell_height);
+  priv->cell_height = MAX (priv->cell_height, 1);
+}
+
+/* Bind and place the tiles for the rows around the view */
+static void
+layout_tiles (TakuTileGrid *grid, int height)
+{
+  TakuTileGridPrivate *priv = grid->priv;
+  int row_height, top_row, bottom_row, first_row, n_rows;
+  double scroll;
+  GSequenceIter *iter;
+  guint i, n_tiles;
+
+  if (priv->columns == 0) {
+    resize_pool (grid, 0);
+    priv->first = 0;
+    return;
+  }
+
+  row_height = get_row_height (grid);
+  scroll = get_scroll (grid);
+
+  top_row = scroll / row_height;
+  bottom_row = (scroll + height) / row_height;
+  first_row = MAX (0, top_row - MARGIN_ROWS);
+  n_rows = bottom_row + MARGIN_ROWS + 1 - first_row;
+
+  n_tiles = MIN ((guint) (n_rows * priv->columns), (guint) get_n_items (grid));
+  resize_pool (grid, n_tiles);
+  priv->first = first_row * priv->columns;
+
+  /* One lookup for the first row, then the rows are walked in order */
+  iter = g_sequence_get_iter_at_pos (priv->items, priv->first);
+  for (i = priv->first; i < priv->first + n_tiles; i++) {
+    GtkWidget *tile = g_ptr_array_index (priv->tiles, i % n_tiles);
+    GtkAllocation allocation;
+    int row;
+
+    if (g_sequence_iter_is_end (iter)) {
+      gtk_widget_set_child_visible (tile, FALSE);
+      continue;
+    }
+
+    row = i / priv->columns;
+    taku_launcher_tile_set_icon_priority
+      (TAKU_LAUNCHER_TILE (tile),
+       row >= top_row && row <= bottom_row ? TAKU_ICON_PRIORITY_VISIBLE
+                                           : TAKU_ICON_PRIORITY_CURRENT);
+    taku_launcher_tile_set_item (TAKU_LAUNCHER_TILE (tile),
+                                 g_sequence_get (iter));
+    gtk_widget_set_child_visible (tile, TRUE);
+    iter = g_sequence_iter_next (iter);
+
+    allocation.x = (i % priv->columns) * (priv->cell_width + COLUMN_SPACING);
+    allocation.y = row * row_height - scroll;
+    allocation.width = priv->cell_width;
+    allocation.height = priv->cell_height;
+
+    /* Tiles must be measured before they are allocated */
+    gtk_widget_get_preferred_height_for_width (tile, priv->cell_width, NULL, NULL);
+    gtk_widget_size_allocate (tile, &allocation);
+  }
+
+  update_selection (grid);
+}
+
+static void
+taku_tile_grid_size_allocate (GtkWidget *widget, GtkAllocation *allocation)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+
+  gtk_widget_set_allocation (widget, allocation);
+
+  if (gtk_widget_get_realized (widget))
+    gdk_window_move_resize (gtk_widget_get_window (widget),
+                            allocation->x, allocation->y,
+                            allocation->width, allocation->height);
+
+  measure_cells (grid, allocation->width);
+  configure_adjustments (grid);
+  layout_tiles (grid, allocation->height);
+}
+
+static void
+taku_tile_grid_get_preferred_width (GtkWidget *widget, int *minimum, int *natural)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (widget)->priv;
+  int width = 0;
+
+  if (priv->tiles->len)
+    gtk_widget_get_preferred_width (g_ptr_array_index (priv->tiles, 0),
+                                    &width, NULL);
+
+  *minimum = *natural = width;
+}
+
+static void
+taku_tile_grid_get_preferred_height (GtkWidget *widget, int *minimum, int *natural)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  TakuTileGridPrivate *priv = grid->priv;
+  int rows = 0;
+
+  if (priv->columns)
+    rows = (get_n_items (grid) + priv->columns - 1) / priv->columns;
+
+  *minimum = 0;
+  *natural = MAX (rows * get_row_height (grid) - ROW_SPACING, 0);
+}
+
+static void
+taku_tile_grid_realize (GtkWidget *widget)
+{
+  GtkAllocation allocation;
+  GdkWindowAttr attributes;
+  GdkWindow *window;
+
+  gtk_widget_set_realized (widget, TRUE);
+  gtk_widget_get_allocation (widget, &allocation);
+
+  attributes.window_type = GDK_WINDOW_CHILD;
+  attributes.x = allocation.x;
+  attributes.y = allocation.y;
+  attributes.width = allocation.width;
+  attributes.height = allocation.height;
+  attributes.wclass = GDK_INPUT_OUTPUT;
+  attributes.visual = gtk_widget_get_visual (widget);
+  attributes.event_mask = gtk_widget_get_events (widget)
+    | GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK
+    | GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK;
+
+  window = gdk_window_new (gtk_widget_get_parent_window (widget), &attributes,
+                           GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL);
+  gtk_widget_set_window (widget, window);
+  gtk_widget_register_window (widget, window);
+}
+
+static gboolean
+taku_tile_grid_draw (GtkWidget *widget, cairo_t *cr)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  GtkStyleContext *context;
+  GtkWidget *tile;
+  GtkAllocation allocation;
+
+  context = gtk_widget_get_style_context (widget);
+  gtk_render_background (context, cr, 0, 0,
+                         gtk_widget_get_allocated_width (widget),
+                         gtk_widget_get_allocated_height (widget));
+
+  tile = (GtkWidget *) get_tile (grid, get_cursor_index (grid));
+  if (tile) {
+    gtk_widget_get_allocation (tile, &allocation);
+    gtk_render_background (gtk_widget_get_style_context (tile), cr,
+                           allocation.x, allocation.y,
+                           allocation.width, allocation.height);
+  }
+
+  GTK_WIDGET_CLASS (taku_tile_grid_parent_class)->draw (widget, cr);
+
+  if (tile && gtk_widget_has_visible_focus (widget))
+    gtk_render_focus (context, cr, allocation.x, allocation.y,
+                      allocation.width, allocation.height);
+
+  return FALSE;
+}
+
+static gboolean
+taku_tile_grid_button_press_event (GtkWidget *widget, GdkEventButton *event)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  int index;
+
+  if (event->button != 1 || event->type != GDK_BUTTON_PRESS)
+    return FALSE;
+
+  index = get_index_at (grid, event->x, event->y);
+  if (index < 0)
+    return FALSE;
+
+  grid->priv->pressed = get_item (grid, index);
+  set_cursor (grid, index);
+  gtk_widget_grab_focus (widget);
+
+  return TRUE;
+}
+
+static gboolean
+taku_tile_grid_button_release_event (GtkWidget *widget, GdkEventButton *event)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  TakuMenuItem *pressed;
+  int index;
+
+  if (event->button != 1 || grid->priv->pressed == NULL)
+    return FALSE;
+
+  pressed = grid->priv->pressed;
+  grid->priv->pressed = NULL;
+
+  /* Activate on a click, but not if the pointer moved off the tile */
+  index = get_index_at (grid, event->x, event->y);
+  if (index >= 0 && get_item (grid, index) == pressed)
+    activate_cursor (grid);
+
+  return TRUE;
+}
+
+static gboolean
+taku_tile_grid_key_press_event (GtkWidget *widget, GdkEventKey *event)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  TakuTileGridPrivate *priv = grid->priv;
+  int index, page, n_items;
+
+  n_items = get_n_items (grid);
+  if (n_items == 0 || priv->columns == 0)
+    goto chain;
+
+  index = MAX (get_cursor_index (grid), 0);
+  page = MAX (1, gtk_widget_get_allocated_height (widget) / get_row_height (grid))
+    * priv->columns;
+
+  switch (event->keyval) {
+  case GDK_KEY_Return:
+  case GDK_KEY_ISO_Enter:
+  case GDK_KEY_KP_Enter:
+  case GDK_KEY_space:
+  case GDK_KEY_KP_Space:
+    activate_cursor (grid);
+    return TRUE;
+  case GDK_KEY_Home:
+  case GDK_KEY_KP_Home:
+    set_cursor (grid, 0);
+    return TRUE;
+  case GDK_KEY_End:
+  case GDK_KEY_KP_End:
+    set_cursor (grid, n_items - 1);
+    return TRUE;
+  case GDK_KEY_Page_Up:
+  case GDK_KEY_KP_Page_Up:
+    set_cursor (grid, MAX (index - page, index % priv->columns));
+    return TRUE;
+  case GDK_KEY_Page_Down:
+  case GDK_KEY_KP_Page_Down:
+    set_cursor (grid, MIN (index + page, n_items - 1));
+    return TRUE;
+  default:
+    break;
+  }
+
+ chain:
+  return GTK_WIDGET_CLASS (taku_tile_grid_parent_class)->key_press_event (widget, event);
+}
+
+/*
+ * Keyboard navigation moves the selection between tiles.  Moving off an edge
+ * returns FALSE, so the focus signal can be used to handle that like
+ * GtkFlowBox.
+ */
+static gboolean
+taku_tile_grid_focus (GtkWidget *widget, GtkDirectionType direction)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (widget);
+  TakuTileGridPrivate *priv = grid->priv;
+  int index, last, columns;
+
+  if (get_n_items (grid) == 0)
+    return FALSE;
+
+  index = get_cursor_index (grid);
+
+  if (!gtk_widget_has_focus (widget)) {
+    gtk_widget_grab_focus (widget);
+    set_cursor (grid, MAX (index, 0));
+    return TRUE;
+  }
+
+  if (index < 0) {
+    set_cursor (grid, 0);
+    return TRUE;
+  }
+
+  last = get_n_items (grid) - 1;
+  columns = MAX (priv->columns, 1);
+
+  switch (direction) {
+  case GTK_DIR_LEFT:
+    if (index % columns == 0)
+      return FALSE;
+    index--;
+    break;
+  case GTK_DIR_RIGHT:
+    if (index % columns == columns - 1 || index == last)
+      return FALSE;
+    index++;
+    break;
+  case GTK_DIR_UP:
+    if (index < columns)
+      return FALSE;
+    index -= columns;
+    break;
+  case GTK_DIR_DOWN:
+    /* Into a short last row goes to its end */
+    if (index / columns == last / columns)
+      return FALSE;
+    index = MIN (index + columns, last);
+    break;
+  default:
+    return FALSE;
+  }
+
+  set_cursor (grid, index);
+  return TRUE;
+}
+
+static void
+taku_tile_grid_add_widget (GtkContainer *container, GtkWidget *widget)
+{
+  g_warning ("Tiles are made by TakuTileGrid, use taku_tile_grid_add() to add items");
+}
+
+static void
+taku_tile_grid_remove_widget (GtkContainer *container, GtkWidget *widget)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (container)->priv;
+
+  if (g_ptr_array_remove (priv->tiles, widget))
+    gtk_widget_unparent (widget);
+}
+
+static void
+taku_tile_grid_forall (GtkContainer *container,
+                       gboolean      include_internals,
+                       GtkCallback   callback,
+                       gpointer      callback_data)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (container)->priv;
+  guint i;
+
+  /* Backwards, as the callback may remove the tile */
+  for (i = priv->tiles->len; i > 0; i--)
+    callback (g_ptr_array_index (priv->tiles, i - 1), callback_data);
+}
+
+static GType
+taku_tile_grid_child_type (GtkContainer *container)
+{
+  return TAKU_TYPE_LAUNCHER_TILE;
+}
+
+static void
+taku_tile_grid_get_property (GObject *object, guint property_id,
+                             GValue *value, GParamSpec *pspec)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (object)->priv;
+
+  switch (property_id) {
+  case PROP_HADJUSTMENT:
+    g_value_set_object (value, priv->hadjustment);
+    break;
+  case PROP_VADJUSTMENT:
+    g_value_set_object (value, priv->vadjustment);
+    break;
+  case PROP_HSCROLL_POLICY:
+    g_value_set_enum (value, priv->hscroll_policy);
+    break;
+  case PROP_VSCROLL_POLICY:
+    g_value_set_enum (value, priv->vscroll_policy);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+taku_tile_grid_set_property (GObject *object, guint property_id,
+                             const GValue *value, GParamSpec *pspec)
+{
+  TakuTileGrid *grid = TAKU_TILE_GRID (object);
+
+  switch (property_id) {
+  case PROP_HADJUSTMENT:
+    set_hadjustment (grid, g_value_get_object (value));
+    break;
+  case PROP_VADJUSTMENT:
+    set_vadjustment (grid, g_value_get_object (value));
+    break;
+  case PROP_HSCROLL_POLICY:
+    grid->priv->hscroll_policy = g_value_get_enum (value);
+    gtk_widget_queue_resize (GTK_WIDGET (grid));
+    break;
+  case PROP_VSCROLL_POLICY:
+    grid->priv->vscroll_policy = g_value_get_enum (value);
+    gtk_widget_queue_resize (GTK_WIDGET (grid));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  }
+}
+
+static void
+taku_tile_grid_dispose (GObject *object)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (object)->priv;
+
+  if (priv->hadjustment) {
+    g_object_unref (priv->hadjustment);
+    priv->hadjustment = NULL;
+  }
+
+  if (priv->vadjustment) {
+    g_signal_handlers_disconnect_by_func (priv->vadjustment,
+                                          on_value_changed, object);
+    g_object_unref (priv->vadjustment);
+    priv->vadjustment = NULL;
+  }
+
+  G_OBJECT_CLASS (taku_tile_grid_parent_class)->dispose (object);
+}
+
+static void
+taku_tile_grid_finalize (GObject *object)
+{
+  TakuTileGridPrivate *priv = TAKU_TILE_GRID (object)->priv;
+
+  g_hash_table_destroy (priv->iters);
+  g_sequence_free (priv->items);
+  g_ptr_array_free (priv->tiles, TRUE);
+
+  G_OBJECT_CLASS (taku_tile_grid_parent_class)->finalize (object);
+}
+
+static void
+taku_tile_grid_class_init (TakuTileGridClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+  GtkContainerClass *container_class = GTK_CONTAINER_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (TakuTileGridPrivate));
+
+  object_class->get_property = taku_tile_grid_get_property;
+  object_class->set_property = taku_tile_grid_set_property;
+  object_class->dispose = taku_tile_grid_dispose;
+  object_class->finalize = taku_tile_grid_finalize;
+
+  widget_class->realize = taku_tile_grid_realize;
+  widget_class->size_allocate = taku_tile_grid_size_allocate;
+  widget_class->get_preferred_width = taku_tile_grid_get_preferred_width;
+  widget_class->get_preferred_height = taku_tile_grid_get_preferred_height;
+  widget_class->draw = taku_tile_grid_draw;
+  widget_class->button_press_event = taku_tile_grid_button_press_event;
+  widget_class->button_release_event = taku_tile_grid_button_release_event;
+  widget_class->key_press_event = taku_tile_grid_key_press_event;
+  widget_class->focus = taku_tile_grid_focus;
+
+  container_class->add = taku_tile_grid_add_widget;
+  container_class->remove = taku_tile_grid_remove_widget;
+  container_class->forall = taku_tile_grid_forall;
+  container_class->child_type = taku_tile_grid_child_type;
+
+  g_object_class_override_property (object_class, PROP_HADJUSTMENT, "hadjustment");
+  g_object_class_override_property (object_class, PROP_VADJUSTMENT, "vadjustment");
+  g_object_class_override_property (object_class, PROP_HSCROLL_POLICY, "hscroll-policy");
+  g_object_class_override_property (object_class, PROP_VSCROLL_POLICY, "vscroll-policy");
+
+  signals[CHILD_ACTIVATED] =
+    g_signal_new ("child-activated",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TakuTileGridClass, child_activated),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE, 1, TAKU_TYPE_TILE);
+}
+
+static void
+taku_tile_grid_init (TakuTileGrid *self)
+{
+  self->priv = GET_PRIVATE (self);
+
+  self->priv->items = g_sequence_new ((GDestroyNotify) taku_menu_item_unref);
+  self->priv->iters = g_hash_table_new (NULL, NULL);
+  self->priv->tiles = g_ptr_array_new ();
+
+  gtk_widget_set_has_window (GTK_WIDGET (self), TRUE);
+  gtk_widget_set_can_focus (GTK_WIDGET (self), TRUE);
+}
+
+GtkWidget *
+taku_tile_grid_new (void)
+{
+  return g_object_new (TAKU_TYPE_TILE_GRID, NULL);
+}
+
+/* Add @item to @grid, in collation order */
+void
+taku_tile_grid_add (TakuTileGrid *grid, TakuMenuItem *item)
+{
+  TakuTileGridPrivate *priv;
+  GSequenceIter *iter;
+
+  g_return_if_fail (TAKU_IS_TILE_GRID (grid));
+  g_return_if_fail (item);
+
+  priv = grid->priv;
+
+  if (g_hash_table_contains (priv->iters, item))
+    return;
+
+  iter = g_sequence_insert_sorted (priv->items, taku_menu_item_ref (item),
+                                   compare_items, NULL);
+  g_hash_table_insert (priv->iters, item, iter);
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+static int
+compare_item_ptrs (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return compare_items (*(TakuMenuItem **) a, *(TakuMenuItem **) b, user_data);
+}
+
+/*
+ * Add all of @items to @grid at once.  They are sorted together and merged
+ * into the grid in one pass from where the first belongs, which is much
+ * cheaper than adding them one at a time when there are many.
+ */
+void
+taku_tile_grid_add_items (TakuTileGrid *grid, GPtrArray *items)
+{
+  TakuTileGridPrivate *priv;
+  GPtrArray *sorted;
+  GSequenceIter *iter;
+  guint i;
+
+  g_return_if_fail (TAKU_IS_TILE_GRID (grid));
+  g_return_if_fail (items);
+
+  priv = grid->priv;
+
+  sorted = g_ptr_array_sized_new (items->len);
+  for (i = 0; i < items->len; i++) {
+    TakuMenuItem *item = g_ptr_array_index (items, i);
+
+    /* Reserve the item, so that duplicates are only added once */
+    if (item && !g_hash_table_contains (priv->iters, item)) {
+      g_hash_table_insert (priv->iters, item, NULL);
+      g_ptr_array_add (sorted, item);
+    }
+  }
+
+  if (sorted->len == 0) {
+    g_ptr_array_free (sorted, TRUE);
+    return;
+  }
+
+  if (sorted->len <= SMALL_BATCH) {
+    /* A few searches are cheaper than walking the items between them */
+    for (i = 0; i < sorted->len; i++) {
+      TakuMenuItem *item = g_ptr_array_index (sorted, i);
+
+      iter = g_sequence_insert_sorted (priv->items, taku_menu_item_ref (item),
+                                       compare_items, NULL);
+      g_hash_table_insert (priv->iters, item, iter);
+    }
+  } else {
+    g_ptr_array_sort_with_data (sorted, compare_item_ptrs, NULL);
+
+    /* Both are in order, so the place for each new item is after the last,
+       starting from where the first goes */
+    iter = g_sequence_search (priv->items, g_ptr_array_index (sorted, 0),
+                              compare_items, NULL);
+    for (i = 0; i < sorted->len; i++) {
+      TakuMenuItem *item = g_ptr_array_index (sorted, i);
+
+      while (!g_sequence_iter_is_end (iter) &&
+             compare_items (g_sequence_get (iter), item, NULL) <= 0)
+        iter = g_sequence_iter_next (iter);
+
+      g_hash_table_insert (priv->iters, item,
+                           g_sequence_insert_before (iter,
+                                                     taku_menu_item_ref (item)));
+    }
+  }
+
+  g_ptr_array_free (sorted, TRUE);
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+void
+taku_tile_grid_remove (TakuTileGrid *grid, TakuMenuItem *item)
+{
+  TakuTileGridPrivate *priv;
+  GSequenceIter *iter;
+
+  g_return_if_fail (TAKU_IS_TILE_GRID (grid));
+
+  priv = grid->priv;
+
+  iter = g_hash_table_lookup (priv->iters, item);
+  if (iter == NULL)
+    return;
+
+  if (priv->cursor == item)
+    priv->cursor = NULL;
+  if (priv->pressed == item)
+    priv->pressed = NULL;
+
+  /* Tiles showing the item keep a reference until they are rebound */
+  g_hash_table_remove (priv->iters, item);
+  g_sequence_remove (iter);
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+void
+taku_tile_grid_unselect_all (TakuTileGrid *grid)
+{
+  g_return_if_fail (TAKU_IS_TILE_GRID (grid));
+
+  grid->priv->cursor = NULL;
+  update_selection (grid);
+}
+
+/*
+ * Get how many items fill the view, and the size of their icons, so that icons
+ * can be loaded ahead of time for pages which haven't been shown.  Both are 0
+ * until the grid has been allocated with some items.
+ */
+void
+taku_tile_grid_get_page_size (TakuTileGrid *grid,
+                              guint        *n_items,
+                              guint        *icon_size)
+{
+  TakuTileGridPrivate *priv;
+  int rows;
+
+  g_return_if_fail (TAKU_IS_TILE_GRID (grid));
+  g_return_if_fail (n_items);
+  g_return_if_fail (icon_size);
+
+  priv = grid->priv;
+  *n_items = 0;
+  *icon_size = 0;
+
+  if (priv->columns == 0 || priv->tiles->len == 0)
+    return;
+
+  /* A partly visible row at the bottom counts */
+  rows = (gtk_widget_get_allocated_height (GTK_WIDGET (grid))
+          + get_row_height (grid) - 1) / get_row_height (grid);
+  *n_items = MAX (rows, 1) * priv->columns;
+
+  gtk_widget_style_get (g_ptr_array_index (priv->tiles, 0),
+                        "taku-icon-size", icon_size, NULL);
+}
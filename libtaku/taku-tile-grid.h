@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _TAKU_TILE_GRID
+#define _TAKU_TILE_GRID
+
+#include <gtk/gtk.h>
+#include "taku-tile.h"
+#include "taku-menu.h"
+
+G_BEGIN_DECLS
+
+#define TAKU_TYPE_TILE_GRID taku_tile_grid_get_type()
+
+#define TAKU_TILE_GRID(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+  TAKU_TYPE_TILE_GRID, TakuTileGrid))
+
+#define TAKU_TILE_GRID_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+  TAKU_TYPE_TILE_GRID, TakuTileGridClass))
+
+#define TAKU_IS_TILE_GRID(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+  TAKU_TYPE_TILE_GRID))
+
+#define TAKU_IS_TILE_GRID_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+  TAKU_TYPE_TILE_GRID))
+
+#define TAKU_TILE_GRID_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+  TAKU_TYPE_TILE_GRID, TakuTileGridClass))
+
+typedef struct _TakuTileGridPrivate TakuTileGridPrivate;
+
+/*
+ * A scrollable grid of launcher tiles for a sorted list of menu items.  Only
+ * enough tiles to cover the view, and a few rows either side, are created, and
+ * they are given new items as the grid scrolls.
+ */
+typedef struct {
+  GtkContainer parent;
+  TakuTileGridPrivate *priv;
+} TakuTileGrid;
+
+typedef struct {
+  GtkContainerClass parent_class;
+
+  void (* child_activated) (TakuTileGrid *grid, TakuTile *tile);
+} TakuTileGridClass;
+
+GType taku_tile_grid_get_type (void);
+
+GtkWidget* taku_tile_grid_new (void);
+
+void taku_tile_grid_add (TakuTileGrid *grid, TakuMenuItem *item);
+void taku_tile_grid_add_items (TakuTileGrid *grid, GPtrArray *items);
+void taku_tile_grid_remove (TakuTileGrid *grid, TakuMenuItem *item);
+
+void taku_tile_grid_unselect_all (TakuTileGrid *grid);
+
+void taku_tile_grid_get_page_size (TakuTileGrid *grid,
+                                   guint        *n_items,
+                                   guint        *icon_size);
+
+G_END_DECLS
+
+#endif /* _TAKU_TILE_GRID */
@@ -28,6 +28,9 @@
 #include "libtaku/taku-menu.h"
 #include "libtaku/taku-icon-tile.h"
 #include "libtaku/taku-launcher-tile.h"
+#include "libtaku/taku-tile-grid.h"
+#include "libtaku/taku-icon-loader.h"
+#include "libtaku/taku-queue-source.h"
 #include "taku-category-bar.h"
 
 #include "libtaku/xutil.h"
@@ -36,161 +39,340 @@
 
 static GList *categories;
 static TakuCategoryBar *bar;
-static GtkWidget *table;
+static GtkWidget *stack;
 static TakuMenu *menu;
 static GtkWidget *fixed, *box;
 
+/*
+ * TakuLauncherCategory to the TakuTileGrid on its page of the stack.  Pages are
+ * built the first time their category is shown, and kept up to date as items
+ * come and go.  Without categories there is one page, under NULL.
+ */
+static GHashTable *pages;
+
+/* Batches of items to add to the pages, and the batch still collecting the
+   items being announced */
+static TakuQueue *batches;
+static GPtrArray *added;
+
+/* Milliseconds a category has to be shown before the icons of its neighbours
+   are loaded, so flicking through categories doesn't load them all */
+#define PRELOAD_DELAY 300
+
+/* An icon loaded ahead of time for a page either side of the current one */
+typedef struct {
+  TakuIconRequest *request;
+} Preload;
+
+static GSList *preloads;
+static guint preload_id;
+
+static gboolean
+in_category (TakuMenuItem *item, TakuLauncherCategory *category)
+{
+  return category == NULL ||
+    (taku_menu_item_get_category_bits (item) & TAKU_CATEGORY_BIT (category));
+}
+
+/* Add the items in @items which are in @category to @grid */
 static void
-on_item_added (TakuMenu *menu, TakuMenuItem *item, gpointer null)
+add_items (TakuTileGrid *grid, TakuLauncherCategory *category, GPtrArray *items)
 {
-  GtkWidget *tile;
+  GPtrArray *matching;
+  guint i;
 
-  tile = taku_launcher_tile_new_from_item (item);
+  matching = g_ptr_array_sized_new (items->len);
+  for (i = 0; i < items->len; i++) {
+    TakuMenuItem *item = g_ptr_array_index (items, i);
 
-  if (tile) {
-    gtk_widget_show (tile);
-    gtk_container_add (GTK_CONTAINER (table), tile);
+    if (in_category (item, category))
+      g_ptr_array_add (matching, item);
   }
+
+  taku_tile_grid_add_items (grid, matching);
+  g_ptr_array_free (matching, TRUE);
+}
+
+static void
+add_batch (gpointer data, gpointer user_data)
+{
+  GPtrArray *batch = data;
+  GHashTableIter iter;
+  gpointer category, grid;
+
+  if (batch == added)
+    added = NULL;
+
+  g_hash_table_iter_init (&iter, pages);
+  while (g_hash_table_iter_next (&iter, &category, &grid))
+    add_items (grid, category, batch);
+
+  g_ptr_array_unref (batch);
+}
+
+/*
+ * Items arrive in bursts while loading or when packages are installed, so
+ * they are collected and merged into the pages together.  The batch runs
+ * after the menu has handled the results it has, so a whole burst tends to
+ * end up in one batch.
+ */
+static void
+on_item_added (TakuMenu *menu, TakuMenuItem *item, gpointer null)
+{
+  if (added == NULL) {
+    added = g_ptr_array_new_with_free_func
+      ((GDestroyNotify) taku_menu_item_unref);
+    taku_queue_push (batches, added);
+  }
+
+  g_ptr_array_add (added, taku_menu_item_ref (item));
 }
 
 static void
 on_item_removed (TakuMenu *menu, TakuMenuItem *item, gpointer null)
 {
-  TakuLauncherTile *tile = NULL;
-  GList *tiles, *t;
-
-  tiles = gtk_container_get_children (GTK_CONTAINER (table));
-  for (t = tiles; t; t = t->next)
-  {
-    if (!TAKU_IS_LAUNCHER_TILE (t->data))
-      continue;
-
-    if (item == taku_launcher_tile_get_item (t->data))
-    {
-      tile = t->data;
-      break;
-    }
+  GHashTableIter iter;
+  gpointer category, grid;
+
+  /* The waiting items are few, as they are added every main loop iteration */
+  while (added && g_ptr_array_remove (added, item))
+    ;
+
+  g_hash_table_iter_init (&iter, pages);
+  while (g_hash_table_iter_next (&iter, &category, &grid)) {
+    if (in_category (item, category))
+      taku_tile_grid_remove (grid, item);
   }
+}
+
+
+static gboolean focus_cb (GtkWidget *widget, GtkDirectionType direction,
+                          gpointer user_data);
 
-  if (GTK_IS_WIDGET (tile))
-    gtk_container_remove (GTK_CONTAINER (table), GTK_WIDGET (tile));
+static void
+table_child_activated_cb (TakuTileGrid *table,
+                          TakuTile     *tile,
+                          gpointer      userdata)
+{
+  if (TAKU_IS_LAUNCHER_TILE (tile))
+    taku_launcher_tile_activate (TAKU_LAUNCHER_TILE (tile));
 }
 
+/* Get the grid showing @category, building its page if this is the first
+   time it has been wanted */
+static GtkWidget *
+get_page (TakuLauncherCategory *category)
+{
+  GtkWidget *scrolled, *table;
+  GPtrArray *items;
+  GList *l;
 
-/* Handle failed focus events by switching between categories */
-static gboolean
-focus_cb (GtkWidget *widget, GtkDirectionType direction, gpointer user_data)
+  table = g_hash_table_lookup (pages, category);
+  if (table)
+    return table;
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_show (scrolled);
+
+  /* The grid only makes tiles for the rows in view, so it scrolls itself */
+  table = taku_tile_grid_new ();
+  g_signal_connect (table, "child-activated",
+                    G_CALLBACK (table_child_activated_cb), NULL);
+  g_signal_connect_after (table, "focus", G_CALLBACK (focus_cb), NULL);
+  gtk_widget_show (table);
+  gtk_container_add (GTK_CONTAINER (scrolled), table);
+
+  /* The items the menu already has, the rest arrive with item-added */
+  items = g_ptr_array_new ();
+  for (l = taku_menu_get_items (menu); l; l = l->next) {
+    if (l->data)
+      g_ptr_array_add (items, l->data);
+  }
+  add_items (TAKU_TILE_GRID (table), category, items);
+  g_ptr_array_free (items, TRUE);
+
+  gtk_container_add (GTK_CONTAINER (stack), scrolled);
+  g_hash_table_insert (pages, category, table);
+
+  return table;
+}
+
+static GtkWidget *
+get_current_page (void)
 {
-  /* If there are no categories, don't try switching */
-  if (categories == NULL)
-    return FALSE;
+  return get_page (categories ? taku_category_bar_get_current (bar) : NULL);
+}
 
-  if (direction == GTK_DIR_LEFT) {
-    taku_category_bar_previous (bar);
-    gtk_widget_child_focus (table, GTK_DIR_LEFT);
-    return TRUE;
-  } else if (direction == GTK_DIR_RIGHT) {
-    taku_category_bar_next (bar);
-    gtk_widget_child_focus (table, GTK_DIR_RIGHT);
-    return TRUE;
-  } else if (direction == GTK_DIR_UP) {
-    gtk_flow_box_unselect_all (GTK_FLOW_BOX (table));
+static void
+preload_done (GdkPixbuf *pixbuf, gpointer data)
+{
+  Preload *preload = data;
+
+  /* The icon is in the shared cache now, ready for the tiles */
+  preload->request = NULL;
+}
+
+static void
+cancel_preloads (void)
+{
+  GSList *l;
+
+  for (l = preloads; l; l = l->next) {
+    Preload *preload = l->data;
+
+    if (preload->request)
+      taku_icon_loader_cancel (preload->request);
+    g_slice_free (Preload, preload);
   }
 
-  return FALSE;
+  g_slist_free (preloads);
+  preloads = NULL;
 }
 
-/*
- * Load all .desktop files in @datadir/applications/.
- */
+static int
+compare_items (gconstpointer pa, gconstpointer pb)
+{
+  const char *ka, *kb;
+
+  ka = taku_menu_item_get_collation_key (*(TakuMenuItem **) pa);
+  kb = taku_menu_item_get_collation_key (*(TakuMenuItem **) pb);
+
+  return g_strcmp0 (ka, kb);
+}
+
+/* Load the icons of the first @n_items items of @category, which are the ones
+   its page shows when it is opened */
 static void
-load_items (TakuMenu *menu)
+preload_category (TakuLauncherCategory *category, guint n_items, guint size)
 {
+  GPtrArray *items;
   GList *l;
+  guint i;
 
-  for (l = taku_menu_get_items (menu); l; l = l->next)
-  {
-    GtkWidget *tile;
-
-    if (!l->data)
-      continue;
-    tile = taku_launcher_tile_new_from_item (l->data);
-    if (tile) {
-      gtk_widget_show (tile);
-      gtk_container_add (GTK_CONTAINER (table), tile);
-    }
+  items = g_ptr_array_new ();
+  for (l = taku_menu_get_items (menu); l; l = l->next) {
+    if (l->data && in_category (l->data, category))
+      g_ptr_array_add (items, l->data);
+  }
+  g_ptr_array_sort (items, compare_items);
+
+  for (i = 0; i < MIN (n_items, items->len); i++) {
+    TakuMenuItem *item = g_ptr_array_index (items, i);
+    Preload *preload;
+
+    preload = g_slice_new (Preload);
+    preload->request =
+      taku_icon_loader_request (taku_menu_item_get_icon_name (item), size,
+                                TAKU_ICON_PRIORITY_ADJACENT,
+                                preload_done, preload);
+
+    /* Cached icons don't need a request */
+    if (preload->request)
+      preloads = g_slist_prepend (preloads, preload);
+    else
+      g_slice_free (Preload, preload);
   }
+
+  g_ptr_array_free (items, TRUE);
 }
 
+/*
+ * Once a category has settled, load the first screenful of icons of the
+ * categories either side, behind those of the current page, so that switching
+ * shows real icons straight away.  No tiles are needed for this.
+ */
 static gboolean
-delete_event_cb (GtkWidget *widget, GdkEvent *event, gpointer user_data)
+preload_adjacent (gpointer data)
 {
-  /* prevent default handler from destroying the window */
-  return TRUE;
+  TakuLauncherCategory *previous, *next;
+  guint n_items, size;
+
+  preload_id = 0;
+
+  if (categories == NULL)
+    return FALSE;
+
+  taku_tile_grid_get_page_size (TAKU_TILE_GRID (get_current_page ()),
+                                &n_items, &size);
+  if (n_items == 0)
+    return FALSE;
+
+  taku_category_bar_get_adjacent (bar, &previous, &next);
+  if (previous)
+    preload_category (previous, n_items, size);
+  if (next && next != previous)
+    preload_category (next, n_items, size);
+
+  return FALSE;
 }
 
 static void
-workarea_changed (int x, int y, int w, int h)
+queue_preload (void)
 {
-  gtk_widget_set_size_request (box, w, h);
-  gtk_widget_queue_resize (box);
-  gtk_fixed_move (GTK_FIXED (fixed), box, x, y);
+  if (preload_id)
+    g_source_remove (preload_id);
+  preload_id = g_timeout_add (PRELOAD_DELAY, preload_adjacent, NULL);
 }
 
-static void table_size_allocate_cb (GtkWidget    *table,
-                                    GdkRectangle *allocation,
-                                    gpointer      user_data)
+/*
+ * Switching category is just flipping to its page.  The icons loaded for the
+ * old neighbours are dropped, as the new page's tiles now come first and the
+ * new neighbours are loaded once the switch settles.
+ */
+static void
+show_current_page (void)
 {
-  gtk_flow_box_set_min_children_per_line (GTK_FLOW_BOX (table), allocation->width / 200); 
+  gtk_stack_set_visible_child (GTK_STACK (stack),
+                               gtk_widget_get_parent (get_current_page ()));
+
+  cancel_preloads ();
+  queue_preload ();
 }
 
+/* Handle failed focus events by switching between categories */
 static gboolean
-table_filter (GtkFlowBoxChild *child, gpointer user_data)
+focus_cb (GtkWidget *widget, GtkDirectionType direction, gpointer user_data)
 {
-  TakuTile *tile = TAKU_TILE (gtk_bin_get_child (GTK_BIN (child)));
+  /* If there are no categories, don't try switching */
+  if (categories == NULL)
+    return FALSE;
 
-  return taku_tile_matches_filter (tile, taku_category_bar_get_current (bar));
+  if (direction == GTK_DIR_LEFT) {
+    taku_category_bar_previous (bar);
+    gtk_widget_child_focus (get_current_page (), GTK_DIR_LEFT);
+    return TRUE;
+  } else if (direction == GTK_DIR_RIGHT) {
+    taku_category_bar_next (bar);
+    gtk_widget_child_focus (get_current_page (), GTK_DIR_RIGHT);
+    return TRUE;
+  } else if (direction == GTK_DIR_UP) {
+    taku_tile_grid_unselect_all (TAKU_TILE_GRID (widget));
+  }
+
+  return FALSE;
 }
 
-static gint
-table_sort (GtkFlowBoxChild *child1,
-            GtkFlowBoxChild *child2,
-            gpointer user_data)
+static gboolean
+delete_event_cb (GtkWidget *widget, GdkEvent *event, gpointer user_data)
 {
-  GtkWidget *a, *b;
-  const char *ka, *kb;
-
-  a = gtk_bin_get_child (GTK_BIN(child1));
-  b = gtk_bin_get_child (GTK_BIN(child2));
-  ka = taku_tile_get_sort_key (TAKU_TILE (a));
-  kb = taku_tile_get_sort_key (TAKU_TILE (b));
-
-  if (ka != NULL && kb == NULL)
-    return 1;
-  else if (ka == NULL && kb != NULL)
-    return -1;
-  else if (ka == NULL && kb == NULL)
-    return 0;
-  else
-    return strcmp (ka, kb);
+  /* prevent default handler from destroying the window */
+  return TRUE;
 }
 
 static void
-table_child_activated_cb (GtkFlowBox *table,
-                          GtkFlowBoxChild *child,
-                          gpointer userdata)
+workarea_changed (int x, int y, int w, int h)
 {
-  GtkWidget *tile;
-
-  tile = gtk_bin_get_child (GTK_BIN (child));
-  if (TAKU_IS_LAUNCHER_TILE (tile))
-    taku_launcher_tile_activate (TAKU_LAUNCHER_TILE (tile));
+  gtk_widget_set_size_request (box, w, h);
+  gtk_widget_queue_resize (box);
+  gtk_fixed_move (GTK_FIXED (fixed), box, x, y);
 }
 
 GtkWidget *
 create_desktop (DesktopMode mode)
 {
-  GtkWidget *window, *scrolled, *viewport;
+  GtkWidget *window;
   GdkScreen *screen;
   int width, height;
 
@@ -248,50 +430,28 @@ create_desktop (DesktopMode mode)
   gtk_widget_show (GTK_WIDGET (bar));
   gtk_box_pack_start (GTK_BOX (box), GTK_WIDGET (bar), FALSE, TRUE, 0);
 
-  /* Table area */
-  scrolled = gtk_scrolled_window_new (NULL, NULL);
-  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
-                                  GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
-  gtk_widget_show (scrolled);
-  gtk_box_pack_start (GTK_BOX (box), scrolled, TRUE, TRUE, 0);
-
-  viewport = gtk_viewport_new (NULL, NULL);
-  gtk_widget_set_valign (viewport, GTK_ALIGN_START);
-  gtk_viewport_set_shadow_type (GTK_VIEWPORT (viewport),
-                                GTK_SHADOW_NONE);
-  gtk_widget_show (viewport);
-  gtk_container_add (GTK_CONTAINER (scrolled), viewport);
-
-  table = gtk_flow_box_new ();
-  gtk_flow_box_set_homogeneous (GTK_FLOW_BOX (table), TRUE);
-  gtk_flow_box_set_row_spacing (GTK_FLOW_BOX (table), 6);
-  gtk_flow_box_set_column_spacing (GTK_FLOW_BOX (table), 6);
-  g_signal_connect (table, "child-activated",
-                    G_CALLBACK (table_child_activated_cb), NULL);
-  g_signal_connect (table, "size-allocate",
-                    G_CALLBACK (table_size_allocate_cb), NULL);
-  g_signal_connect_after (table, "focus", G_CALLBACK (focus_cb), NULL);
-  gtk_flow_box_set_filter_func (GTK_FLOW_BOX (table),
-                                (GtkFlowBoxFilterFunc)table_filter,
-                                bar, NULL);
-  gtk_flow_box_set_sort_func (GTK_FLOW_BOX (table),
-                              (GtkFlowBoxSortFunc)table_sort,
-                              NULL, NULL);
-  gtk_widget_show (table);
-  gtk_container_add (GTK_CONTAINER (viewport), table);
-  gtk_flow_box_set_vadjustment (GTK_FLOW_BOX (table),
-                                gtk_scrollable_get_vadjustment (GTK_SCROLLABLE(viewport)));
+  /* Table area, a page for each category */
+  stack = gtk_stack_new ();
+  gtk_widget_show (stack);
+  gtk_box_pack_start (GTK_BOX (box), stack, TRUE, TRUE, 0);
+  pages = g_hash_table_new (NULL, NULL);
+  batches = taku_queue_new (TAKU_QUEUE_PRIORITY_LOW, add_batch, NULL,
+                            (GDestroyNotify) g_ptr_array_unref);
 
   menu = taku_menu_get_default ();
   categories = taku_menu_get_categories (menu);
 
-  taku_category_bar_set_table (bar, GTK_FLOW_BOX (table));
+  g_signal_connect_swapped (bar, "changed",
+                            G_CALLBACK (show_current_page), NULL);
   taku_category_bar_set_categories (bar, categories);
+  show_current_page ();
 
   g_signal_connect (menu, "item-added", G_CALLBACK (on_item_added), NULL);
   g_signal_connect (menu, "item-removed", G_CALLBACK (on_item_removed), NULL);
+  /* The first category was shown before there was anything to preload */
+  g_signal_connect_swapped (menu, "loaded", G_CALLBACK (queue_preload), NULL);
 
-  load_items (menu);
+  taku_menu_load_async (menu, NULL);
 
   return window;
 }
@@ -299,12 +459,14 @@ create_desktop (DesktopMode mode)
 void
 destroy_desktop (void)
 {
-  while (categories) {
-    TakuLauncherCategory *category = categories->data;
-
-    taku_launcher_category_free (category);
-
-    categories = g_list_delete_link (categories, categories);
-  }
+  /* The categories belong to the menu */
+  categories = NULL;
+  if (preload_id)
+    g_source_remove (preload_id);
+  preload_id = 0;
+  cancel_preloads ();
+  taku_queue_free (batches);
+  added = NULL;
+  g_hash_table_destroy (pages);
   g_object_unref (menu);
 }
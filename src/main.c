@@ -21,12 +21,16 @@
 #include <gtk/gtk.h>
 
 #include "desktop.h"
+#include "libtaku/taku-icon-atlas.h"
+#include "libtaku/taku-icon-cache.h"
 
 #if WITH_DBUS
 #include <dbus/dbus.h>
 
-static gboolean
-emit_loaded_signal (gpointer user_data)
+#include "libtaku/taku-menu.h"
+
+static void
+emit_loaded_signal (TakuMenu *menu, gpointer user_data)
 {
   DBusError error = DBUS_ERROR_INIT;
   DBusConnection *conn;
@@ -36,7 +40,7 @@ emit_loaded_signal (gpointer user_data)
   if (!conn) {
     g_printerr ("Cannot connect to system bus: %s", error.message);
     dbus_error_free (&error);
-    return FALSE;
+    return;
   }
 
   msg = dbus_message_new_signal ("/", "org.matchbox_project.desktop", "Loaded");
@@ -49,13 +53,15 @@ emit_loaded_signal (gpointer user_data)
      unlikely to block. */
   dbus_connection_flush (conn);
   dbus_connection_unref (conn);
-
-  return FALSE;
 }
 #endif
 
+/*
+ * Install the style before any widgets are made, so that tiles are only ever
+ * styled (and their icons loaded) once.
+ */
 static void
-load_style (GtkWidget *widget)
+load_style (void)
 {
   GtkCssProvider *provider;
   GError *error = NULL;
@@ -68,7 +74,7 @@ load_style (GtkWidget *widget)
     g_error_free (error);
   } else {
     gtk_style_context_add_provider_for_screen
-      (gtk_widget_get_screen (widget),
+      (gdk_screen_get_default (),
        GTK_STYLE_PROVIDER (provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
   }
   g_object_unref (provider);
@@ -77,14 +83,20 @@ load_style (GtkWidget *widget)
 int
 main (int argc, char **argv)
 {
-  GtkWidget *desktop;
   char *mode_string = NULL;
+  int icon_cache_size = -1;
+  gboolean icon_atlas = FALSE;
+  TakuIconCacheStats stats;
   GError *error = NULL;
   GOptionContext *option_context;
   GOptionGroup *option_group;
   GOptionEntry option_entries[] = {
     { "mode", 'm', 0, G_OPTION_ARG_STRING, &mode_string,
       N_("Desktop mode"), N_("DESKTOP|TITLEBAR|WINDOW") },
+    { "icon-cache-size", 0, 0, G_OPTION_ARG_INT, &icon_cache_size,
+      N_("Memory to keep icons in"), N_("KB") },
+    { "icon-atlas", 0, 0, G_OPTION_ARG_NONE, &icon_atlas,
+      N_("Draw icons from shared atlas surfaces"), NULL },
     { NULL }
   };
   DesktopMode mode = MODE_DESKTOP;
@@ -126,14 +138,26 @@ main (int argc, char **argv)
     g_free (mode_string);
   }
 
+  if (icon_cache_size >= 0)
+    taku_icon_cache_set_budget ((gsize) icon_cache_size * 1024);
+  taku_icon_atlas_set_enabled (icon_atlas);
+
+  load_style ();
+  create_desktop (mode);
+
 #if WITH_DBUS
-  g_idle_add (emit_loaded_signal, NULL);
+  /* Only announce that we're up once all of the applications are shown */
+  g_signal_connect (taku_menu_get_default (), "loaded",
+                    G_CALLBACK (emit_loaded_signal), NULL);
 #endif
-
-  desktop = create_desktop (mode);
-  load_style (desktop);
   gtk_main ();
   destroy_desktop ();
 
+  taku_icon_cache_get_stats (&stats);
+  g_debug ("Icon cache: %u hits (%u missing icons), %u misses, %u evictions, "
+           "%u icons in %" G_GSIZE_FORMAT " bytes",
+           stats.hits, stats.negative_hits, stats.misses, stats.evictions,
+           stats.n_icons, stats.bytes);
+
   return 0;
 }
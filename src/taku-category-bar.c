@@ -33,13 +33,19 @@ G_DEFINE_TYPE (TakuCategoryBar, taku_category_bar, GTK_TYPE_BOX);
 #define LIST_DATA "taku-category-bar:list"
 
 typedef struct {
-  GtkFlowBox *table;
   GList *categories;
   GList *current_category;
   GtkWidget *prev_button, *popup_button, *next_button;
   GtkLabel *switcher_label;
 } TakuCategoryBarPrivate;
 
+enum {
+  CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
 
 static void
 make_bold (GtkLabel *label)
@@ -65,7 +71,8 @@ make_bold (GtkLabel *label)
   gtk_label_set_attributes (label, list);
 }
 
-/* Changes the current category: Updates the switcher label and table filter */
+/* Changes the current category: Updates the switcher label and tells the
+   desktop to show its page */
 static void
 set_category (TakuCategoryBar *bar, GList *category_list_item)
 {
@@ -78,7 +85,8 @@ set_category (TakuCategoryBar *bar, GList *category_list_item)
 
   gtk_label_set_text (priv->switcher_label, category->name);
   priv->current_category = category_list_item;
-  gtk_flow_box_invalidate_filter (priv->table);
+
+  g_signal_emit (bar, signals[CHANGED], 0);
 }
 
 static void
@@ -209,6 +217,13 @@ static void
 taku_category_bar_class_init (TakuCategoryBarClass *klass)
 {
   g_type_class_add_private (klass, sizeof (TakuCategoryBarPrivate));
+
+  signals[CHANGED] = g_signal_new ("changed",
+                                   G_TYPE_FROM_CLASS (klass),
+                                   G_SIGNAL_RUN_LAST,
+                                   0, NULL, NULL,
+                                   g_cclosure_marshal_VOID__VOID,
+                                   G_TYPE_NONE, 0);
 }
 
 static void
@@ -267,21 +282,6 @@ taku_category_bar_new (void)
   return g_object_new (TAKU_TYPE_CATEGORY_BAR, NULL);
 }
 
-void
-taku_category_bar_set_table (TakuCategoryBar *bar, GtkFlowBox *table)
-{
-  TakuCategoryBarPrivate *priv;
-
-  g_return_if_fail (TAKU_IS_CATEGORY_BAR (bar));
-  g_return_if_fail (GTK_IS_FLOW_BOX (table));
-
-  priv = GET_PRIVATE (bar);
-  
-  /* TODO: ref table and unref in dispose */
-  
-  priv->table = table;
-}
-
 void
 taku_category_bar_set_categories (TakuCategoryBar *bar, GList *categories)
 {
@@ -315,6 +315,36 @@ taku_category_bar_get_current (TakuCategoryBar *bar)
   return (TakuLauncherCategory*)priv->current_category->data;
 }
 
+/*
+ * Get the categories either side of the current one, which are where the user
+ * can go next.  Either is NULL if there isn't one.
+ */
+void
+taku_category_bar_get_adjacent (TakuCategoryBar       *bar,
+                                TakuLauncherCategory **previous,
+                                TakuLauncherCategory **next)
+{
+  TakuCategoryBarPrivate *priv;
+  GList *l;
+
+  g_return_if_fail (TAKU_IS_CATEGORY_BAR (bar));
+  priv = GET_PRIVATE (bar);
+
+  *previous = *next = NULL;
+
+  if (priv->current_category == NULL || priv->categories->next == NULL)
+    return;
+
+  /* Moving wraps around at the ends */
+  l = priv->current_category->prev ? priv->current_category->prev
+                                   : g_list_last (priv->categories);
+  *previous = l->data;
+
+  l = priv->current_category->next ? priv->current_category->next
+                                   : priv->categories;
+  *next = l->data;
+}
+
 void
 taku_category_bar_next (TakuCategoryBar *bar)
 {
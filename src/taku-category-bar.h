@@ -58,10 +58,12 @@ GType taku_category_bar_get_type (void);
 
 GtkWidget* taku_category_bar_new (void);
 
-void taku_category_bar_set_table (TakuCategoryBar *bar, GtkFlowBox *table);
 void taku_category_bar_set_categories (TakuCategoryBar *bar, GList *categories);
 
 TakuLauncherCategory* taku_category_bar_get_current (TakuCategoryBar *bar);
+void taku_category_bar_get_adjacent (TakuCategoryBar       *bar,
+                                     TakuLauncherCategory **previous,
+                                     TakuLauncherCategory **next);
 void taku_category_bar_next (TakuCategoryBar *bar);
 void taku_category_bar_previous (TakuCategoryBar *bar);
 
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Parses every desktop file in a directory with the menu's parser and with
+ * GKeyFile, reports any field where they disagree and how long each took.
+ *
+ *   desktop-entry-compare [DIRECTORY]
+ *
+ * make check runs it over the files in desktop-entries/, with LANGUAGE and
+ * XDG_CURRENT_DESKTOP set to match the translations and OnlyShowIn lists
+ * there.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "libtaku/desktop-entry.h"
+
+/* Same order as DesktopEntryKey */
+static const char *key_names[DESKTOP_ENTRY_N_KEYS] = {
+  "Name",
+  "Comment",
+  "Icon",
+  "Exec",
+  "Categories",
+  "StartupNotify",
+  "SingleInstance",
+  "X-MB-SingleInstance",
+  "NoDisplay",
+  "Hidden",
+  "OnlyShowIn",
+  "NotShowIn",
+};
+
+#define FIRST_BOOLEAN_KEY DESKTOP_ENTRY_STARTUP_NOTIFY
+#define LAST_BOOLEAN_KEY DESKTOP_ENTRY_HIDDEN
+
+/* The fields of one file, as either parser sees them */
+typedef struct {
+  gboolean loaded;
+  char *strings[DESKTOP_ENTRY_N_LOCALE_KEYS];
+  gboolean booleans[LAST_BOOLEAN_KEY + 1];
+} Fields;
+
+static void
+fields_clear (Fields *fields)
+{
+  int i;
+
+  for (i = 0; i < DESKTOP_ENTRY_N_LOCALE_KEYS; i++)
+    g_free (fields->strings[i]);
+  memset (fields, 0, sizeof (Fields));
+}
+
+static void
+parse_entry (const char *path, Fields *fields)
+{
+  DesktopEntry entry;
+  int i;
+
+  memset (fields, 0, sizeof (Fields));
+
+  if (!desktop_entry_load (&entry, path))
+    return;
+
+  fields->loaded = TRUE;
+  for (i = 0; i < DESKTOP_ENTRY_N_LOCALE_KEYS; i++)
+    fields->strings[i] = desktop_entry_get_string (&entry, i);
+  for (i = FIRST_BOOLEAN_KEY; i <= LAST_BOOLEAN_KEY; i++)
+    fields->booleans[i] = desktop_entry_get_boolean (&entry, i, FALSE);
+
+  desktop_entry_clear (&entry);
+}
+
+/* Returns TRUE if the list @key has one of the current desktops */
+static gboolean
+key_file_shows_in (GKeyFile *key_file, const char *key, char **desktops)
+{
+  char **list, **d, **l;
+  gboolean found = FALSE;
+
+  list = g_key_file_get_string_list (key_file, G_KEY_FILE_DESKTOP_GROUP, key,
+                                     NULL, NULL);
+  if (list == NULL)
+    return FALSE;
+
+  for (d = desktops; *d && !found; d++) {
+    for (l = list; *l && !found; l++) {
+      if (**d != '\0' && strcmp (*d, *l) == 0)
+        found = TRUE;
+    }
+  }
+
+  g_strfreev (list);
+
+  return found;
+}
+
+/*
+ * What the parser does, done the long way with GKeyFile.  Returns FALSE if
+ * GKeyFile could not load the file at all.
+ */
+static gboolean
+parse_key_file (const char *path, char **desktops, Fields *fields)
+{
+  GKeyFile *key_file;
+  int i;
+
+  memset (fields, 0, sizeof (Fields));
+
+  key_file = g_key_file_new ();
+  /* Without a [Desktop Entry] every key is missing, as for the parser */
+  if (!g_key_file_load_from_file (key_file, path, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (key_file);
+    return FALSE;
+  }
+
+  for (i = FIRST_BOOLEAN_KEY; i <= LAST_BOOLEAN_KEY; i++)
+    fields->booleans[i] = g_key_file_get_boolean (key_file,
+                                                  G_KEY_FILE_DESKTOP_GROUP,
+                                                  key_names[i], NULL);
+
+  if (fields->booleans[DESKTOP_ENTRY_NO_DISPLAY] ||
+      fields->booleans[DESKTOP_ENTRY_HIDDEN] ||
+      (g_key_file_has_key (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                           "OnlyShowIn", NULL) &&
+       !key_file_shows_in (key_file, "OnlyShowIn", desktops)) ||
+      key_file_shows_in (key_file, "NotShowIn", desktops)) {
+    g_key_file_free (key_file);
+    return TRUE;
+  }
+
+  fields->loaded = TRUE;
+  for (i = 0; i < DESKTOP_ENTRY_N_LOCALE_KEYS; i++) {
+    char *s;
+
+    s = g_key_file_get_locale_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+                                      key_names[i], NULL, NULL);
+    if (s && *g_strstrip (s) == '\0') {
+      g_free (s);
+      s = NULL;
+    }
+    fields->strings[i] = s;
+  }
+
+  g_key_file_free (key_file);
+
+  return TRUE;
+}
+
+/*
+ * Both parsers only need the values they return to be UTF-8, but in case a
+ * GKeyFile refuses a file for its bytes rather than its syntax, such files are
+ * counted and left out.
+ */
+static gboolean
+is_utf8 (const char *path)
+{
+  char *contents;
+  gsize length;
+  gboolean valid;
+
+  if (!g_file_get_contents (path, &contents, &length, NULL))
+    return TRUE;
+
+  valid = g_utf8_validate (contents, length, NULL);
+  g_free (contents);
+
+  return valid;
+}
+
+/* Print the differences between @a and @b, returning how many there are */
+static int
+compare_fields (const char *path, Fields *a, Fields *b)
+{
+  int i, n = 0;
+
+  if (a->loaded != b->loaded) {
+    g_print ("%s: %s by the parser but %s by GKeyFile\n", path,
+             a->loaded ? "shown" : "hidden", b->loaded ? "shown" : "hidden");
+    return 1;
+  }
+
+  if (!a->loaded)
+    return 0;
+
+  for (i = 0; i < DESKTOP_ENTRY_N_LOCALE_KEYS; i++) {
+    if (g_strcmp0 (a->strings[i], b->strings[i]) != 0) {
+      g_print ("%s: %s is \"%s\" but GKeyFile has \"%s\"\n", path,
+               key_names[i], a->strings[i] ? a->strings[i] : "(null)",
+               b->strings[i] ? b->strings[i] : "(null)");
+      n++;
+    }
+  }
+
+  for (i = FIRST_BOOLEAN_KEY; i <= LAST_BOOLEAN_KEY; i++) {
+    if (a->booleans[i] != b->booleans[i]) {
+      g_print ("%s: %s is %d but GKeyFile has %d\n", path, key_names[i],
+               a->booleans[i], b->booleans[i]);
+      n++;
+    }
+  }
+
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *dirname = argc > 1 ? argv[1] : "/usr/share/applications";
+  const char *name, *current;
+  GPtrArray *paths;
+  char **desktops;
+  gint64 parser_time = 0, key_file_time = 0, start;
+  int differences = 0, skipped = 0;
+  GError *error = NULL;
+  GDir *dir;
+  guint i;
+
+  dir = g_dir_open (dirname, 0, &error);
+  if (dir == NULL) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  paths = g_ptr_array_new_with_free_func (g_free);
+  while ((name = g_dir_read_name (dir))) {
+    if (g_str_has_suffix (name, ".desktop"))
+      g_ptr_array_add (paths, g_build_filename (dirname, name, NULL));
+  }
+  g_dir_close (dir);
+
+  current = g_getenv ("XDG_CURRENT_DESKTOP");
+  desktops = g_strsplit (current ? current : "", ":", -1);
+
+  for (i = 0; i < paths->len; i++) {
+    const char *path = g_ptr_array_index (paths, i);
+    Fields parsed, expected;
+    gboolean readable;
+
+    start = g_get_monotonic_time ();
+    parse_entry (path, &parsed);
+    parser_time += g_get_monotonic_time () - start;
+
+    start = g_get_monotonic_time ();
+    readable = parse_key_file (path, desktops, &expected);
+    key_file_time += g_get_monotonic_time () - start;
+
+    if (!readable && !is_utf8 (path))
+      skipped++;
+    else
+      differences += compare_fields (path, &parsed, &expected);
+
+    fields_clear (&parsed);
+    fields_clear (&expected);
+  }
+
+  g_print ("%u files, %d refused by GKeyFile as not UTF-8, %d differences\n",
+           paths->len, skipped, differences);
+  g_print ("parser:  %8.3f ms\n", parser_time / 1000.0);
+  g_print ("GKeyFile: %7.3f ms\n", key_file_time / 1000.0);
+
+  /* An empty directory more likely means a wrong path than a pass */
+  if (paths->len == 0)
+    differences++;
+
+  g_strfreev (desktops);
+  g_ptr_array_free (paths, TRUE);
+
+  return differences ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Churns desktop files the way package updates do and checks that the menu's
+ * resident set size stays flat.  Every cycle writes a new desktop file and
+ * deletes an old one, and tells the menu as inotify would, so items go through
+ * the real add and remove paths: the desktop ID providers, the token index,
+ * the category lists and the item store.  Removed items are held for a cycle,
+ * as a tile still showing them would, and the last ones outlive the menu.
+ *
+ *   item-soak [CYCLES]
+ *
+ * Everything happens in a temporary HOME and XDG directories, which are
+ * removed afterwards.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libtaku/taku-menu.h"
+#include "libtaku/taku-menu-private.h"
+#include "libtaku/taku-launcher-tile.h"
+
+/* Desktop files in the menu at any time */
+#define N_LIVE 200
+/* Cycles before the RSS is taken as the baseline, so that the pools, hash
+   tables and arrays have reached their working size */
+#define WARM_UP 2000
+/* Growth allowed over the baseline, in kilobytes */
+#define TOLERANCE_KB 512
+
+/* What desktop file n is in, by n % 3, as the vfolders below set it up */
+static const char *categories_line[] = { "Utility;", "Game;", "Unknown;" };
+static const char *category_names[] = { "Utility", "Games", "Other" };
+
+static char *apps_dir;
+
+/* Items announced and not yet removed, each with a reference held */
+static GHashTable *live;
+/* Items removed this cycle, released at the start of the next */
+static GPtrArray *held;
+static guint n_added, n_removed;
+static gboolean failed;
+
+/* Returns the resident set size in kilobytes, or 0 if it can't be read */
+static glong
+get_rss_kb (void)
+{
+  glong pages = 0, rss = 0;
+  FILE *f;
+
+  f = fopen ("/proc/self/statm", "r");
+  if (f == NULL)
+    return 0;
+  if (fscanf (f, "%ld %ld", &pages, &rss) != 2)
+    rss = 0;
+  fclose (f);
+
+  return rss * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void
+write_file (const char *path, const char *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (path, contents, -1, &error))
+    g_error ("%s", error->message);
+}
+
+/* A HOME with three vfolders, one of them the fallback */
+static char *
+make_home (void)
+{
+  GError *error = NULL;
+  char *home, *dir, *path;
+
+  home = g_dir_make_tmp ("item-soak-XXXXXX", &error);
+  if (home == NULL)
+    g_error ("%s", error->message);
+
+  dir = g_build_filename (home, ".matchbox", "vfolders", NULL);
+  g_mkdir_with_parents (dir, 0755);
+
+  path = g_build_filename (dir, "Root.order", NULL);
+  write_file (path, "Utility\nGames\nOther\n");
+  g_free (path);
+
+  path = g_build_filename (dir, "Utility.directory", NULL);
+  write_file (path, "[Desktop Entry]\nName=Utility\nMatch=Utility;\n");
+  g_free (path);
+
+  path = g_build_filename (dir, "Games.directory", NULL);
+  write_file (path, "[Desktop Entry]\nName=Games\nMatch=Game;\n");
+  g_free (path);
+
+  path = g_build_filename (dir, "Other.directory", NULL);
+  write_file (path, "[Desktop Entry]\nName=Other\nMatch=meta-fallback;\n");
+  g_free (path);
+
+  g_free (dir);
+
+  return home;
+}
+
+/* Remove @path and everything under it */
+static void
+remove_tree (const char *path)
+{
+  const char *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir))) {
+      char *child = g_build_filename (path, name, NULL);
+
+      remove_tree (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  g_remove (path);
+}
+
+static char *
+desktop_file_path (guint n)
+{
+  char name[32];
+
+  g_snprintf (name, sizeof (name), "soak-%u.desktop", n);
+
+  return g_build_filename (apps_dir, name, NULL);
+}
+
+/* Write desktop file @n, with strings which are new every time like those of
+   an upgraded package */
+static char *
+add_desktop_file (guint n)
+{
+  char *path, *contents;
+
+  path = desktop_file_path (n);
+  contents = g_strdup_printf ("[Desktop Entry]\n"
+                              "Type=Application\n"
+                              "Name=Application %u\n"
+                              "Comment=Version %u of an application\n"
+                              "Exec=soak-%u %%U\n"
+                              "Icon=application-x-executable\n"
+                              "Categories=%s\n",
+                              n, n, n, categories_line[n % 3]);
+  write_file (path, contents);
+  g_free (contents);
+
+  return path;
+}
+
+/* The item should be in exactly the category its desktop file asks for */
+static void
+check_categories (TakuMenuItem *item)
+{
+  TakuLauncherCategory *category;
+  GList *categories;
+  guint n;
+
+  categories = taku_menu_item_get_categories (item);
+  if (sscanf (taku_menu_item_get_name (item), "Application %u", &n) != 1 ||
+      categories == NULL || categories->next != NULL) {
+    g_print ("%s: wrong categories\n", taku_menu_item_get_name (item));
+    failed = TRUE;
+    return;
+  }
+
+  category = categories->data;
+  if (strcmp (category->name, category_names[n % 3]) != 0) {
+    g_print ("%s: in %s, not %s\n", taku_menu_item_get_name (item),
+             category->name, category_names[n % 3]);
+    failed = TRUE;
+  }
+}
+
+static void
+on_item_added (TakuMenu *menu, TakuMenuItem *item, gpointer user_data)
+{
+  n_added++;
+  check_categories (item);
+  g_hash_table_add (live, taku_menu_item_ref (item));
+}
+
+static void
+on_item_removed (TakuMenu *menu, TakuMenuItem *item, gpointer user_data)
+{
+  n_removed++;
+
+  /* Like a tile, keep showing it for a while */
+  if (g_hash_table_remove (live, item))
+    g_ptr_array_add (held, item);
+}
+
+static void
+release_held (void)
+{
+  guint i;
+
+  for (i = 0; i < held->len; i++) {
+    TakuMenuItem *item = g_ptr_array_index (held, i);
+
+    check_categories (item);
+    taku_menu_item_unref (item);
+  }
+  g_ptr_array_set_size (held, 0);
+}
+
+static void
+drain (void)
+{
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+/* The menu should show exactly the desktop files on disk */
+static void
+check_count (TakuMenu *menu, guint cycle)
+{
+  guint n_items = g_list_length (taku_menu_get_items (menu));
+
+  if (n_items != N_LIVE || g_hash_table_size (live) != N_LIVE) {
+    g_print ("cycle %u: %u items, %u announced, expected %u\n", cycle,
+             n_items, g_hash_table_size (live), N_LIVE);
+    failed = TRUE;
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  TakuMenu *menu;
+  GHashTableIter iter;
+  gpointer item;
+  char *home, *dir, *path;
+  guint cycles = 20000, i;
+  glong baseline = 0, rss = 0;
+
+  if (argc > 1)
+    cycles = MAX (atoi (argv[1]), WARM_UP + 1);
+
+  /* Before anything caches them */
+  home = make_home ();
+  g_setenv ("HOME", home, TRUE);
+  dir = g_build_filename (home, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", dir, TRUE);
+  g_free (dir);
+  dir = g_build_filename (home, "system", NULL);
+  g_setenv ("XDG_DATA_DIRS", dir, TRUE);
+  g_free (dir);
+  dir = g_build_filename (home, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", dir, TRUE);
+  g_free (dir);
+
+  apps_dir = g_build_filename (home, "data", "applications", NULL);
+  g_mkdir_with_parents (apps_dir, 0755);
+
+  for (i = 0; i < N_LIVE; i++)
+    g_free (add_desktop_file (i));
+
+  live = g_hash_table_new (NULL, NULL);
+  held = g_ptr_array_new ();
+
+  menu = taku_menu_get_default ();
+  g_signal_connect (menu, "item-added", G_CALLBACK (on_item_added), NULL);
+  g_signal_connect (menu, "item-removed", G_CALLBACK (on_item_removed), NULL);
+
+  taku_menu_load_async (menu, NULL);
+  while (!taku_menu_is_loaded (menu))
+    g_main_context_iteration (NULL, TRUE);
+  drain ();
+  check_count (menu, 0);
+
+  for (i = 0; i < cycles && !failed; i++) {
+    release_held ();
+
+    path = add_desktop_file (N_LIVE + i);
+    taku_menu_file_changed (menu, path, TRUE);
+    g_free (path);
+
+    path = desktop_file_path (i);
+    g_unlink (path);
+    taku_menu_file_changed (menu, path, FALSE);
+    g_free (path);
+
+    drain ();
+
+    if (i + 1 == WARM_UP)
+      baseline = get_rss_kb ();
+
+    if ((i + 1) % 1000 == 0) {
+      check_count (menu, i + 1);
+      rss = get_rss_kb ();
+      g_print ("%8u cycles: %ld kB\n", i + 1, rss);
+    }
+  }
+
+  release_held ();
+
+  /* The items still showing keep their categories after the menu has gone */
+  g_object_unref (menu);
+  g_hash_table_iter_init (&iter, live);
+  while (g_hash_table_iter_next (&iter, &item, NULL)) {
+    check_categories (item);
+    taku_menu_item_unref (item);
+  }
+  g_hash_table_destroy (live);
+  g_ptr_array_free (held, TRUE);
+
+  remove_tree (home);
+  g_free (home);
+  g_free (apps_dir);
+
+  if (failed)
+    return EXIT_FAILURE;
+
+  if (n_added - n_removed != N_LIVE) {
+    g_print ("%u items added but %u removed\n", n_added, n_removed);
+    return EXIT_FAILURE;
+  }
+
+  if (baseline == 0 || rss == 0) {
+    g_print ("RSS not available, only the items were checked\n");
+    return EXIT_SUCCESS;
+  }
+
+  g_print ("grew %ld kB after warming up\n", rss - baseline);
+
+  return rss - baseline > TOLERANCE_KB ? EXIT_FAILURE : EXIT_SUCCESS;
+}
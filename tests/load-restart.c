@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Cancels a sweep as soon as the first item arrives, starts another, and
+ * checks that the menu ends up the same as one which loaded in one go: every
+ * desktop file once, and each directory stamped once.
+ *
+ *   load-restart
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libtaku/taku-menu.h"
+#include "libtaku/taku-menu-private.h"
+
+/* Enough that the sweep is still going when the first item arrives */
+#define N_FILES 2000
+#define N_SUBDIRS 4
+
+static GHashTable *added;
+static GCancellable *cancellable;
+
+static void
+write_file (const char *path, const char *contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (path, contents, -1, &error))
+    g_error ("%s", error->message);
+}
+
+/* A HOME with one vfolder for everything and N_FILES desktop files */
+static char *
+make_home (void)
+{
+  GError *error = NULL;
+  char *home, *dir, *path, *contents;
+  guint i;
+
+  home = g_dir_make_tmp ("load-restart-XXXXXX", &error);
+  if (home == NULL)
+    g_error ("%s", error->message);
+
+  dir = g_build_filename (home, ".matchbox", "vfolders", NULL);
+  g_mkdir_with_parents (dir, 0755);
+  path = g_build_filename (dir, "Root.order", NULL);
+  write_file (path, "All\n");
+  g_free (path);
+  path = g_build_filename (dir, "All.directory", NULL);
+  write_file (path, "[Desktop Entry]\nName=All\nMatch=meta-all;\n");
+  g_free (path);
+  g_free (dir);
+
+  for (i = 0; i < N_FILES; i++) {
+    char name[32];
+
+    g_snprintf (name, sizeof (name), "sub-%u", i % N_SUBDIRS);
+    dir = g_build_filename (home, "data", "applications", name, NULL);
+    g_mkdir_with_parents (dir, 0755);
+
+    g_snprintf (name, sizeof (name), "app-%u.desktop", i);
+    path = g_build_filename (dir, name, NULL);
+    contents = g_strdup_printf ("[Desktop Entry]\nType=Application\n"
+                                "Name=Application %u\nExec=app-%u\n", i, i);
+    write_file (path, contents);
+    g_free (contents);
+    g_free (path);
+    g_free (dir);
+  }
+
+  return home;
+}
+
+static void
+remove_tree (const char *path)
+{
+  const char *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir))) {
+      char *child = g_build_filename (path, name, NULL);
+
+      remove_tree (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  g_remove (path);
+}
+
+static void
+on_item_added (TakuMenu *menu, TakuMenuItem *item, gpointer user_data)
+{
+  if (!g_hash_table_contains (added, item))
+    g_hash_table_add (added, item);
+  else
+    g_print ("%s announced twice\n", taku_menu_item_get_name (item));
+
+  /* Stop the first sweep as soon as it has posted something */
+  if (cancellable)
+    g_cancellable_cancel (cancellable);
+}
+
+static void
+wait_for_sweep (TakuMenu *menu)
+{
+  while (taku_menu_is_loading (menu))
+    g_main_context_iteration (NULL, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  TakuMenu *menu, *reference;
+  char *home, *dir, *cache;
+  guint n_items, n_dirs;
+  gboolean ok = TRUE;
+
+  home = make_home ();
+  g_setenv ("HOME", home, TRUE);
+  dir = g_build_filename (home, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", dir, TRUE);
+  g_free (dir);
+  dir = g_build_filename (home, "system", NULL);
+  g_setenv ("XDG_DATA_DIRS", dir, TRUE);
+  g_free (dir);
+  cache = g_build_filename (home, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", cache, TRUE);
+
+  added = g_hash_table_new (NULL, NULL);
+
+  menu = taku_menu_get_default ();
+  g_signal_connect (menu, "item-added", G_CALLBACK (on_item_added), NULL);
+
+  cancellable = g_cancellable_new ();
+  taku_menu_load_async (menu, cancellable);
+  wait_for_sweep (menu);
+  g_object_unref (cancellable);
+  cancellable = NULL;
+
+  if (taku_menu_is_loaded (menu)) {
+    g_print ("the cancelled sweep still loaded the menu\n");
+    ok = FALSE;
+  }
+  g_print ("cancelled after %u items\n", g_hash_table_size (added));
+
+  taku_menu_load_async (menu, NULL);
+  while (!taku_menu_is_loaded (menu))
+    g_main_context_iteration (NULL, TRUE);
+
+  n_items = g_list_length (taku_menu_get_items (menu));
+  n_dirs = taku_menu_get_n_dirs (menu);
+
+  /* The restarted sweep saved a cache, which would hide any difference */
+  remove_tree (cache);
+
+  reference = g_object_new (TAKU_TYPE_MENU, NULL);
+  taku_menu_load_async (reference, NULL);
+  while (!taku_menu_is_loaded (reference))
+    g_main_context_iteration (NULL, TRUE);
+
+  if (n_items != N_FILES || g_hash_table_size (added) != N_FILES) {
+    g_print ("%u items, %u announced, expected %u\n",
+             n_items, g_hash_table_size (added), N_FILES);
+    ok = FALSE;
+  }
+
+  if (n_dirs != taku_menu_get_n_dirs (reference)) {
+    g_print ("%u directories stamped, expected %u\n",
+             n_dirs, taku_menu_get_n_dirs (reference));
+    ok = FALSE;
+  }
+
+  g_object_unref (reference);
+  g_object_unref (menu);
+  g_hash_table_destroy (added);
+
+  remove_tree (home);
+  g_free (home);
+  g_free (cache);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
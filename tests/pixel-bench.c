@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Checks that the vector paths of pixel-util give exactly the scalar results,
+ * and times pixel_scale_pixbuf() against gdk_pixbuf_scale_simple().
+ *
+ *   pixel-bench [ITERATIONS]
+ *
+ * Built with PIXEL_CHECK as pixel-check, it only does the comparison, over
+ * more sizes and seeds, for make check.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "libtaku/pixel-util.h"
+
+typedef struct {
+  int src_width, src_height;
+  gboolean has_alpha;
+  int width, height;
+} Case;
+
+/* Sizes icons are typically shrunk from and to, and odd widths for the tails
+   of the vector loops */
+static const Case cases[] = {
+  { 256, 256, TRUE, 64, 64 },
+  { 256, 256, TRUE, 48, 48 },
+  { 128, 128, TRUE, 64, 64 },
+  { 128, 128, FALSE, 48, 48 },
+  { 97, 61, TRUE, 31, 17 },
+  { 33, 33, TRUE, 33, 33 },
+};
+
+/* Random pixels, with alpha runs of fully transparent and opaque too */
+static GdkPixbuf *
+make_pixbuf (GRand *rand, int width, int height, gboolean has_alpha)
+{
+  GdkPixbuf *pixbuf;
+  guint8 *pixels;
+  int x, y, n_channels, rowstride;
+
+  pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+
+  for (y = 0; y < height; y++) {
+    guint8 *p = pixels + y * rowstride;
+
+    for (x = 0; x < width * n_channels; x++)
+      p[x] = g_rand_int_range (rand, 0, 256);
+
+    if (has_alpha && y % 3 != 2) {
+      for (x = 0; x < width; x++)
+        p[x * 4 + 3] = y % 3 ? 0xff : 0;
+    }
+  }
+
+  return pixbuf;
+}
+
+static gboolean
+same_pixels (GdkPixbuf *a, GdkPixbuf *b)
+{
+  int y, width, height;
+  gsize row;
+
+  width = gdk_pixbuf_get_width (a);
+  height = gdk_pixbuf_get_height (a);
+  if (width != gdk_pixbuf_get_width (b) ||
+      height != gdk_pixbuf_get_height (b) ||
+      gdk_pixbuf_get_n_channels (a) != gdk_pixbuf_get_n_channels (b))
+    return FALSE;
+
+  row = (gsize) width * gdk_pixbuf_get_n_channels (a);
+  for (y = 0; y < height; y++) {
+    if (memcmp (gdk_pixbuf_read_pixels (a) + y * gdk_pixbuf_get_rowstride (a),
+                gdk_pixbuf_read_pixels (b) + y * gdk_pixbuf_get_rowstride (b),
+                row) != 0)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns TRUE if the vector and scalar paths agree on @c */
+static gboolean
+check_case (GRand *rand, const Case *c)
+{
+  GdkPixbuf *src, *vector, *scalar;
+  guint32 *premul_vector, *premul_scalar;
+  gsize n_pixels;
+  gboolean ok;
+
+  src = make_pixbuf (rand, c->src_width, c->src_height, c->has_alpha);
+  n_pixels = (gsize) c->src_width * c->src_height;
+  premul_vector = g_new (guint32, n_pixels);
+  premul_scalar = g_new (guint32, n_pixels);
+
+  pixel_set_vectors_enabled (TRUE);
+  vector = pixel_scale_pixbuf (src, c->width, c->height);
+  pixel_premultiply (gdk_pixbuf_read_pixels (src),
+                     gdk_pixbuf_get_rowstride (src), c->has_alpha,
+                     premul_vector, c->src_width * 4,
+                     c->src_width, c->src_height);
+
+  pixel_set_vectors_enabled (FALSE);
+  scalar = pixel_scale_pixbuf (src, c->width, c->height);
+  pixel_premultiply (gdk_pixbuf_read_pixels (src),
+                     gdk_pixbuf_get_rowstride (src), c->has_alpha,
+                     premul_scalar, c->src_width * 4,
+                     c->src_width, c->src_height);
+
+  pixel_set_vectors_enabled (TRUE);
+
+  ok = same_pixels (vector, scalar) &&
+    memcmp (premul_vector, premul_scalar, n_pixels * 4) == 0;
+
+  g_free (premul_vector);
+  g_free (premul_scalar);
+  g_object_unref (vector);
+  g_object_unref (scalar);
+  g_object_unref (src);
+
+  return ok;
+}
+
+#ifdef PIXEL_CHECK
+/*
+ * Every case with a few seeds, then every width up to a few vectors wide so
+ * each length of loop tail is covered, shrunk by odd and even factors.
+ */
+static gboolean
+check_all (void)
+{
+  GRand *rand;
+  gboolean ok = TRUE;
+  guint i, seed;
+  int width;
+
+  for (seed = 1; seed <= 4; seed++) {
+    rand = g_rand_new_with_seed (seed);
+
+    for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+      if (!check_case (rand, &cases[i])) {
+        g_print ("case %u, seed %u: vector and scalar differ\n", i, seed);
+        ok = FALSE;
+      }
+    }
+
+    for (width = 1; width <= 40; width++) {
+      Case c = { width * 3, width * 2 + 1, width % 2 == 0, width, width };
+
+      if (!check_case (rand, &c)) {
+        g_print ("%dx%d -> %dx%d, seed %u: vector and scalar differ\n",
+                 c.src_width, c.src_height, c.width, c.height, seed);
+        ok = FALSE;
+      }
+    }
+
+    g_rand_free (rand);
+  }
+
+  return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+  /* 77 tells the test driver this was skipped */
+  if (!pixel_get_vectors_enabled ()) {
+    g_print ("vector paths not built, nothing to compare\n");
+    return 77;
+  }
+
+  return check_all () ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+/* Microseconds per call of pixel_scale_pixbuf(), or of GdkPixbuf if @gdk */
+static double
+time_case (GRand *rand, const Case *c, int iterations, gboolean gdk)
+{
+  GdkPixbuf *src, *scaled;
+  gint64 start;
+  int i;
+
+  src = make_pixbuf (rand, c->src_width, c->src_height, c->has_alpha);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++) {
+    if (gdk)
+      scaled = gdk_pixbuf_scale_simple (src, c->width, c->height,
+                                        GDK_INTERP_BILINEAR);
+    else
+      scaled = pixel_scale_pixbuf (src, c->width, c->height);
+    g_object_unref (scaled);
+  }
+
+  g_object_unref (src);
+
+  return (double) (g_get_monotonic_time () - start) / iterations;
+}
+
+int
+main (int argc, char **argv)
+{
+  GRand *rand;
+  int iterations = 1000;
+  gboolean failed = FALSE;
+  guint i;
+
+  if (argc > 1)
+    iterations = MAX (atoi (argv[1]), 1);
+
+  /* The same pixels every run */
+  rand = g_rand_new_with_seed (42);
+
+  g_print ("vector paths: %s\n",
+           pixel_get_vectors_enabled () ? "enabled" : "not built");
+  g_print ("%-20s %8s %10s %10s %10s %8s\n",
+           "case", "check", "scalar us", "vector us", "gdk us", "speedup");
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+    const Case *c = &cases[i];
+    double scalar, vector, gdk;
+    gboolean ok;
+    char *name;
+
+    ok = check_case (rand, c);
+    failed |= !ok;
+
+    pixel_set_vectors_enabled (FALSE);
+    scalar = time_case (rand, c, iterations, FALSE);
+    pixel_set_vectors_enabled (TRUE);
+    vector = time_case (rand, c, iterations, FALSE);
+    gdk = time_case (rand, c, iterations, TRUE);
+
+    name = g_strdup_printf ("%dx%d%s -> %dx%d", c->src_width, c->src_height,
+                            c->has_alpha ? "a" : "", c->width, c->height);
+    g_print ("%-20s %8s %10.1f %10.1f %10.1f %7.2fx\n",
+             name, ok ? "ok" : "FAILED", scalar, vector, gdk, gdk / vector);
+    g_free (name);
+  }
+
+  g_rand_free (rand);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
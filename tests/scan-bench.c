@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2007 OpenedHand Ltd
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Loads the menu from a made up set of application directories, with no
+ * cache, with an up to date cache, after one directory has changed and after
+ * one file has been edited in place, and reports the time and the system calls
+ * each load made.
+ *
+ *   scan-bench [N_FILES]
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "libtaku/taku-menu.h"
+
+/* The desktop files are spread over this many subdirectories */
+#define N_SUBDIRS 16
+
+static const char *categories[] = {
+  "Utility", "Game", "Office", "Graphics", "Network", "AudioVideo", "System",
+};
+
+static void
+write_desktop_file (const char *dir, int n)
+{
+  char *path, *contents;
+
+  path = g_strdup_printf ("%s/bench-%d.desktop", dir, n);
+  contents = g_strdup_printf ("[Desktop Entry]\n"
+                              "Type=Application\n"
+                              "Name=Application %d\n"
+                              "Name[de]=Anwendung %d\n"
+                              "Comment=Benchmark application number %d\n"
+                              "Icon=application-x-executable\n"
+                              "Exec=true %%U\n"
+                              "Categories=%s;\n",
+                              n, n, n,
+                              categories[n % G_N_ELEMENTS (categories)]);
+  g_file_set_contents (path, contents, -1, NULL);
+  g_free (contents);
+  g_free (path);
+}
+
+/* Rewrite the file in place, which leaves the mtime of its directory alone */
+static void
+edit_desktop_file (const char *dir, int n)
+{
+  char *path;
+  FILE *f;
+
+  path = g_strdup_printf ("%s/bench-%d.desktop", dir, n);
+  f = fopen (path, "w");
+  if (f) {
+    fprintf (f, "[Desktop Entry]\n"
+             "Type=Application\n"
+             "Name=Edited application %d\n"
+             "Exec=true\n", n);
+    fclose (f);
+  }
+  g_free (path);
+}
+
+static char *
+make_tree (const char *root, int n_files)
+{
+  char *apps, *dir;
+  int i;
+
+  apps = g_build_filename (root, "data", "applications", NULL);
+
+  for (i = 0; i < n_files; i++) {
+    dir = g_strdup_printf ("%s/sub%d", apps, i % N_SUBDIRS);
+    g_mkdir_with_parents (dir, 0755);
+    write_desktop_file (dir, i);
+    g_free (dir);
+  }
+
+  return apps;
+}
+
+static void
+remove_tree (const char *path)
+{
+  const char *name;
+  GDir *dir;
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir) {
+    while ((name = g_dir_read_name (dir))) {
+      char *child = g_build_filename (path, name, NULL);
+
+      remove_tree (child);
+      g_free (child);
+    }
+    g_dir_close (dir);
+  }
+
+  g_remove (path);
+}
+
+static void
+on_loaded (TakuMenu *menu, GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static void
+run (const char *label)
+{
+  TakuMenuScanStats stats;
+  GMainLoop *loop;
+  TakuMenu *menu;
+  gint64 start;
+  double ms;
+  guint n_items;
+
+  loop = g_main_loop_new (NULL, FALSE);
+  menu = g_object_new (TAKU_TYPE_MENU, NULL);
+  g_signal_connect (menu, "loaded", G_CALLBACK (on_loaded), loop);
+
+  start = g_get_monotonic_time ();
+  taku_menu_load_async (menu, NULL);
+  g_main_loop_run (loop);
+  ms = (g_get_monotonic_time () - start) / 1000.0;
+
+  taku_menu_get_scan_stats (menu, &stats);
+  n_items = g_list_length (taku_menu_get_items (menu));
+
+  g_print ("%-12s %6u %8.1f %8u %6u %6u %9u %7u\n",
+           label, n_items, ms, stats.n_entries, stats.n_opens,
+           stats.n_stats, stats.n_unchanged, stats.n_parsed);
+
+  g_object_unref (menu);
+  g_main_loop_unref (loop);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *root, *apps, *path, *dir;
+  int n_files = 2000;
+
+  if (argc > 1)
+    n_files = MAX (atoi (argv[1]), 1);
+
+  root = g_dir_make_tmp ("scan-bench-XXXXXX", NULL);
+  if (root == NULL) {
+    g_printerr ("Cannot make a temporary directory\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Before GLib reads and caches them */
+  path = g_build_filename (root, "data", NULL);
+  g_setenv ("XDG_DATA_HOME", path, TRUE);
+  g_free (path);
+  path = g_build_filename (root, "none", NULL);
+  g_setenv ("XDG_DATA_DIRS", path, TRUE);
+  g_free (path);
+  path = g_build_filename (root, "cache", NULL);
+  g_setenv ("XDG_CACHE_HOME", path, TRUE);
+  g_free (path);
+
+  apps = make_tree (root, n_files);
+
+  g_print ("%-12s %6s %8s %8s %6s %6s %9s %7s\n", "load", "items", "ms",
+           "entries", "opens", "stats", "unchanged", "parsed");
+
+  run ("cold");
+  run ("cached");
+
+  /* A new file changes the mtime of its directory, and only that one */
+  dir = g_strdup_printf ("%s/sub0", apps);
+  write_desktop_file (dir, n_files);
+  g_free (dir);
+  run ("one changed");
+
+  dir = g_strdup_printf ("%s/sub1", apps);
+  edit_desktop_file (dir, 1);
+  g_free (dir);
+  run ("one edited");
+
+  remove_tree (root);
+  g_free (apps);
+  g_free (root);
+
+  return EXIT_SUCCESS;
+}